@@ -0,0 +1,44 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture the TextureManager has loaded, indexed by handle
+layout(set = 0, binding = 2) uniform sampler2D textures[];
+
+layout(location = 0) in vec3 inColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 inFragPos;
+layout(location = 3) in vec3 inNormal;
+layout(location = 4) in vec3 inLightPos;
+layout(location = 5) in vec3 inCameraView;
+layout(location = 6) flat in uint inTextureIndex;
+
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    vec3 norm = normalize(inNormal);
+
+    vec3 lightDir = normalize(inLightPos - inFragPos);
+
+    vec3 lightColor = vec3(1.0, 1.0, 1.0);
+
+    float diffuseStrength = max(dot(norm, lightDir), 0.15);
+
+    vec3 diffuse =  diffuseStrength * lightColor;
+
+
+    vec3 viewDir = normalize(inCameraView);
+
+    float specularStrength = 0.5;
+    // Reflect the lightDirection, and calcuate angle between reflect and viewDir)
+    vec3 reflectDir = reflect(lightDir, norm);
+
+    int shininess = 128;
+    float specularPower = pow(max(dot(viewDir, reflectDir), 0), shininess);
+
+    vec3 specular = specularStrength * specularPower * lightColor;
+
+    vec3 texColor = texture(textures[nonuniformEXT(inTextureIndex)], fragTexCoord).rgb;
+
+    vec3 result = (diffuse + specular) * inColor * texColor;
+    outColor = vec4(result, 1.0);
+}
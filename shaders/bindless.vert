@@ -0,0 +1,51 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 light;
+    vec3 camerPos;
+} ubo;
+
+struct ObjectData {
+    mat4 modelPos;
+    uint textureIndex;
+};
+
+// One entry per entity, the draw's firstInstance selects it
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inColor;
+layout(location = 3) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 outFragPos;
+layout(location = 3) out vec3 outNormal;
+layout(location = 4) out vec3 outLightPos;
+layout(location = 5) out vec3 outCameraView;
+layout(location = 6) flat out uint outTextureIndex;
+
+
+void main() {
+    ObjectData object = objectBuffer.objects[gl_InstanceIndex];
+
+    gl_Position = ubo.proj * ubo.view * object.modelPos * vec4(inPosition, 1.0);
+    fragTexCoord = inTexCoord;
+    fragColor = inColor;
+
+    // Output the position in world coord to feed into frag shader
+    outFragPos = vec3(object.modelPos * vec4(inPosition, 1.0));
+
+    outNormal = inNormal;
+
+    outLightPos = ubo.light.xyz;
+
+    outCameraView = outFragPos - ubo.camerPos;
+
+    outTextureIndex = object.textureIndex;
+}
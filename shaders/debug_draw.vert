@@ -0,0 +1,27 @@
+#version 450 core
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec4 inColor;
+
+layout (push_constant) uniform PushConstants {
+	mat4 viewProj;
+	// Vertices from here on are drawn over the scene
+	uint overlayFirst;
+} pushConstants;
+
+layout (location = 0) out vec4 outColor;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main(void)
+{
+	gl_Position = pushConstants.viewProj * vec4(inPosition, 1.0);
+	// On the near plane the depth test always passes
+	if (uint(gl_VertexIndex) >= pushConstants.overlayFirst) {
+		gl_Position.z = 0.0;
+	}
+	outColor = inColor;
+}
@@ -9,8 +9,10 @@ layout(binding = 0) uniform UniformBufferObject {
     vec3 camerPos;
 } ubo;
 
-layout(binding = 1) uniform UniformBufferObjectModel {
+// Set per draw with vkCmdPushConstants, matches Utils::ModelPushConstants
+layout(push_constant) uniform ModelPushConstants {
     mat4 modelPos;
+    uint objectIndex;
 } uboModel;
 
 layout(location = 0) in vec3 inPosition;
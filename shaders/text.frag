@@ -8,8 +8,11 @@ layout (location = 0) out vec4 outFragColor;
 
 void main(void)
 {
-	//Using the red channel value as transparency
-	//Only red channel has value
-	float color = texture(samplerFont, inUV).r;
-	outFragColor = vec4(color);
+	// Signed distance field, 0.5 is the glyph edge. fwidth is how much the
+	// distance changes across one screen pixel, so the edge is antialiased
+	// over about a pixel whatever size the text is drawn at
+	float dist = texture(samplerFont, inUV).r;
+	float width = max(fwidth(dist) * 0.5, 0.0001);
+	float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+	outFragColor = vec4(alpha);
 }
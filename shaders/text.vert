@@ -1,7 +1,8 @@
 #version 450 core
 
-layout (location = 0) in vec2 inPos;
-layout (location = 1) in vec2 inUV;
+// One instance per glyph, gl_VertexIndex picks the corner of its quad
+layout (location = 0) in vec4 inRect;   // x0, y0, x1, y1 in NDC
+layout (location = 1) in vec4 inUVRect; // u0, v0, u1, v1
 
 layout (location = 0) out vec2 outUV;
 
@@ -12,6 +13,8 @@ out gl_PerVertex
 
 void main(void)
 {
-	gl_Position = vec4(inPos, 0.0, 1.0);
-	outUV = inUV;
+	// Triangle strip: 0 top left, 1 top right, 2 bottom left, 3 bottom right
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	gl_Position = vec4(mix(inRect.xy, inRect.zw, corner), 0.0, 1.0);
+	outUV = mix(inUVRect.xy, inUVRect.zw, corner);
 }
@@ -0,0 +1,232 @@
+#include "debug_draw.hpp"
+
+#if VKGAME_DEBUG_DRAW
+
+#include <cstring>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vulkan_helper.hpp>
+
+namespace VulkanEngine {
+
+void DebugDraw::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t imageCount, VkFormat colorFormat,
+                     VkFormat depthFormat, VkSampleCountFlagBits samples, const std::vector<char> &vertSpirv,
+                     const std::vector<char> &fragSpirv, VkPipelineCache pipelineCache) {
+  mPhysicalDevice = physicalDevice;
+  mDevice = device;
+  mImageCount = imageCount;
+  mDepthTested.reserve(mMaxVertices);
+  mOverlaid.reserve(mMaxVertices);
+  createBuffer();
+
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(PushConstants);
+  VkPipelineLayoutCreateInfo layoutInfo = VulkanInit::pipeline_layout_create_info(nullptr, 0);
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(mDevice, &layoutInfo, nullptr, &mPipelineLayout), "DebugDraw vkCreatePipelineLayout");
+
+  std::vector<VkPipelineShaderStageCreateInfo> shaderStages = {
+      VulkanHelper::loadShader(mDevice, vertSpirv, VK_SHADER_STAGE_VERTEX_BIT),
+      VulkanHelper::loadShader(mDevice, fragSpirv, VK_SHADER_STAGE_FRAGMENT_BIT)};
+
+  VkPipelineColorBlendAttachmentState blendAttachmentState{};
+  blendAttachmentState.blendEnable = VK_TRUE;
+  blendAttachmentState.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+  blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
+      VulkanInit::pipeline_input_assembly_state_create_info(VK_PRIMITIVE_TOPOLOGY_LINE_LIST, 0, VK_FALSE);
+  VkPipelineRasterizationStateCreateInfo rasterizationState =
+      VulkanInit::pipeline_rasterization_state_create_info(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE, 0);
+  VkPipelineColorBlendStateCreateInfo colorBlendState = VulkanInit::pipeline_colorblend_state_create_info(1, &blendAttachmentState);
+  // Tests against the scene but doesn't write, overlaid lines sit on the near plane (see debug_draw.vert)
+  VkPipelineDepthStencilStateCreateInfo depthStencilState =
+      VulkanInit::pipeline_depthstencil_state_create_info(VK_TRUE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
+  VkPipelineViewportStateCreateInfo viewportState = VulkanInit::pipeline_viewport_state_create_Info(1, 1, 0);
+  VkPipelineMultisampleStateCreateInfo multisampleState = VulkanInit::pipeline_multisample_state_create_info(samples, 0);
+  std::vector<VkDynamicState> dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = VulkanInit::pipeline_dynamic_state_create_info(dynamicStateEnables);
+
+  const std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
+      VulkanInit::vertex_input_binding_description(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX),
+  };
+  const std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
+      VulkanInit::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)),
+      VulkanInit::vertex_input_attribute_description(0, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(Vertex, color)),
+  };
+  VkPipelineVertexInputStateCreateInfo vertexInputState =
+      VulkanInit::pipeline_vertex_input_state_create_info(vertexInputBindings, vertexInputAttributes);
+
+  // Same attachments as the scene, it's drawn in the scene's pass
+  VkPipelineRenderingCreateInfoKHR renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &colorFormat;
+  renderingInfo.depthAttachmentFormat = depthFormat;
+  renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
+  VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+  pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineCreateInfo.pNext = &renderingInfo;
+  pipelineCreateInfo.layout = mPipelineLayout;
+  pipelineCreateInfo.basePipelineIndex = -1;
+  pipelineCreateInfo.pVertexInputState = &vertexInputState;
+  pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+  pipelineCreateInfo.pViewportState = &viewportState;
+  pipelineCreateInfo.pRasterizationState = &rasterizationState;
+  pipelineCreateInfo.pMultisampleState = &multisampleState;
+  pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+  pipelineCreateInfo.pColorBlendState = &colorBlendState;
+  pipelineCreateInfo.pDynamicState = &dynamicState;
+  pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+  pipelineCreateInfo.pStages = shaderStages.data();
+  VK_CHECK(vkCreateGraphicsPipelines(mDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &mPipeline),
+           "DebugDraw vkCreateGraphicsPipelines");
+
+  for (const VkPipelineShaderStageCreateInfo &stage : shaderStages) {
+    vkDestroyShaderModule(mDevice, stage.module, nullptr);
+  }
+}
+
+void DebugDraw::destroy() {
+  if (mDevice == VK_NULL_HANDLE) {
+    return;
+  }
+  destroyBuffer();
+  vkDestroyPipeline(mDevice, mPipeline, nullptr);
+  vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+  mPipeline = VK_NULL_HANDLE;
+  mPipelineLayout = VK_NULL_HANDLE;
+  mDevice = VK_NULL_HANDLE;
+}
+
+void DebugDraw::resize(uint32_t imageCount) {
+  if (mDevice == VK_NULL_HANDLE || imageCount == mImageCount) {
+    return;
+  }
+  mImageCount = imageCount;
+  destroyBuffer();
+  createBuffer();
+}
+
+void DebugDraw::createBuffer() {
+  VulkanHelper::createBuffer(mPhysicalDevice, mDevice, sizeof(Vertex) * mMaxVertices * mImageCount,
+                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &mBuffer,
+                             &mMemory);
+  void *data;
+  VK_CHECK(vkMapMemory(mDevice, mMemory, 0, VK_WHOLE_SIZE, 0, &data), "DebugDraw vkMapMemory");
+  mMapped = static_cast<Vertex *>(data);
+  mVertexCounts.assign(mImageCount, 0);
+  mOverlayFirst.assign(mImageCount, 0);
+}
+
+void DebugDraw::destroyBuffer() {
+  if (mBuffer != VK_NULL_HANDLE) {
+    vkUnmapMemory(mDevice, mMemory);
+    vkDestroyBuffer(mDevice, mBuffer, nullptr);
+    vkFreeMemory(mDevice, mMemory, nullptr);
+  }
+  mBuffer = VK_NULL_HANDLE;
+  mMemory = VK_NULL_HANDLE;
+  mMapped = nullptr;
+}
+
+void DebugDraw::line(const glm::vec3 &from, const glm::vec3 &to, const glm::vec4 &color, bool depthTest) {
+  std::vector<Vertex> &lines = depthTest ? mDepthTested : mOverlaid;
+  if (mDepthTested.size() + mOverlaid.size() + 2 > mMaxVertices) {
+    return;
+  }
+  uint32_t packed = glm::packUnorm4x8(color);
+  lines.push_back({from, packed});
+  lines.push_back({to, packed});
+}
+
+void DebugDraw::box(const Utils::AABB &bounds, const glm::vec4 &color, bool depthTest) {
+  // Corner i has the max x if bit 0 is set, max y for bit 1 and max z for bit 2
+  glm::vec3 corners[8];
+  for (int i = 0; i < 8; i++) {
+    corners[i] = glm::vec3(i & 1 ? bounds.max.x : bounds.min.x, i & 2 ? bounds.max.y : bounds.min.y,
+                           i & 4 ? bounds.max.z : bounds.min.z);
+  }
+  // Edges connect corners one bit apart
+  for (int i = 0; i < 8; i++) {
+    for (int bit = 1; bit < 8; bit <<= 1) {
+      if (!(i & bit)) {
+        line(corners[i], corners[i | bit], color, depthTest);
+      }
+    }
+  }
+}
+
+void DebugDraw::sphere(const glm::vec3 &center, float radius, const glm::vec4 &color, bool depthTest) {
+  const int segments = 32;
+  for (int i = 0; i < segments; i++) {
+    float a0 = glm::two_pi<float>() * i / segments;
+    float a1 = glm::two_pi<float>() * (i + 1) / segments;
+    glm::vec2 p0 = glm::vec2(cos(a0), sin(a0)) * radius;
+    glm::vec2 p1 = glm::vec2(cos(a1), sin(a1)) * radius;
+    line(center + glm::vec3(p0.x, p0.y, 0.0f), center + glm::vec3(p1.x, p1.y, 0.0f), color, depthTest);
+    line(center + glm::vec3(p0.x, 0.0f, p0.y), center + glm::vec3(p1.x, 0.0f, p1.y), color, depthTest);
+    line(center + glm::vec3(0.0f, p0.x, p0.y), center + glm::vec3(0.0f, p1.x, p1.y), color, depthTest);
+  }
+}
+
+void DebugDraw::frustum(const glm::mat4 &viewProj, const glm::vec4 &color, bool depthTest) {
+  // glm's projections map depth to -1..1
+  glm::mat4 inverse = glm::inverse(viewProj);
+  glm::vec3 corners[8];
+  for (int i = 0; i < 8; i++) {
+    glm::vec4 corner = inverse * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+    corners[i] = glm::vec3(corner) / corner.w;
+  }
+  for (int i = 0; i < 8; i++) {
+    for (int bit = 1; bit < 8; bit <<= 1) {
+      if (!(i & bit)) {
+        line(corners[i], corners[i | bit], color, depthTest);
+      }
+    }
+  }
+}
+
+void DebugDraw::prepareFrame(uint32_t imageIndex) {
+  Vertex *slot = mMapped + imageIndex * mMaxVertices;
+  memcpy(slot, mDepthTested.data(), mDepthTested.size() * sizeof(Vertex));
+  memcpy(slot + mDepthTested.size(), mOverlaid.data(), mOverlaid.size() * sizeof(Vertex));
+  mOverlayFirst[imageIndex] = static_cast<uint32_t>(mDepthTested.size());
+  mVertexCounts[imageIndex] = static_cast<uint32_t>(mDepthTested.size() + mOverlaid.size());
+  mDepthTested.clear();
+  mOverlaid.clear();
+}
+
+void DebugDraw::draw(VkCommandBuffer commandBuffer, uint32_t imageIndex, const glm::mat4 &viewProj, VkExtent2D extent) {
+  if (mVertexCounts[imageIndex] == 0) {
+    return;
+  }
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipeline);
+  VkViewport viewport = VulkanInit::viewport((float)extent.width, (float)extent.height, 0.0f, 1.0f);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor = VulkanInit::rect2D(extent.width, extent.height, 0, 0);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  PushConstants pushConstants{viewProj, mOverlayFirst[imageIndex]};
+  vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+
+  // Depth tested and overlaid lines in one draw
+  VkDeviceSize offset = imageIndex * mMaxVertices * sizeof(Vertex);
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mBuffer, &offset);
+  vkCmdDraw(commandBuffer, mVertexCounts[imageIndex], 1, 0, 0);
+}
+} // namespace VulkanEngine
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <utils.hpp>
+
+// Debug drawing is compiled out of release builds unless asked for
+#ifndef VKGAME_DEBUG_DRAW
+#ifdef NDEBUG
+#define VKGAME_DEBUG_DRAW 0
+#else
+#define VKGAME_DEBUG_DRAW 1
+#endif
+#endif
+
+namespace VulkanEngine {
+
+#if VKGAME_DEBUG_DRAW
+
+// Immediate mode lines for visualizing bounds, lights and cameras. Shapes are
+// collected as line segments every frame and drawn in the scene's pass with a
+// single draw. Depth tested shapes are hidden by the scene, the others are
+// drawn over it.
+// Every swapchain image has its own slot of a persistently mapped vertex
+// buffer, a slot is only written once the GPU is done with its last frame.
+class DebugDraw {
+public:
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t imageCount, VkFormat colorFormat,
+            VkFormat depthFormat, VkSampleCountFlagBits samples, const std::vector<char> &vertSpirv,
+            const std::vector<char> &fragSpirv, VkPipelineCache pipelineCache);
+  void destroy();
+  // Nothing may be in flight
+  void resize(uint32_t imageCount);
+
+  void line(const glm::vec3 &from, const glm::vec3 &to, const glm::vec4 &color, bool depthTest = true);
+  void box(const Utils::AABB &bounds, const glm::vec4 &color, bool depthTest = true);
+  // Three circles around the axes
+  void sphere(const glm::vec3 &center, float radius, const glm::vec4 &color, bool depthTest = true);
+  // The volume viewProj maps to clip space, e.g. another camera's
+  void frustum(const glm::mat4 &viewProj, const glm::vec4 &color, bool depthTest = true);
+
+  // Moves the lines added since the last call into the slot of imageIndex
+  void prepareFrame(uint32_t imageIndex);
+  // Inside the scene's rendering scope
+  void draw(VkCommandBuffer commandBuffer, uint32_t imageIndex, const glm::mat4 &viewProj, VkExtent2D extent);
+
+  // Segments past this are dropped until the next frame
+  static constexpr uint32_t mMaxVertices = 65536;
+
+private:
+  // Matches debug_draw.vert
+  struct Vertex {
+    glm::vec3 position;
+    // RGBA8
+    uint32_t color;
+  };
+  struct PushConstants {
+    glm::mat4 viewProj;
+    // Vertices from here on are overlaid
+    uint32_t overlayFirst;
+  };
+
+  VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline mPipeline = VK_NULL_HANDLE;
+
+  VkBuffer mBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory mMemory = VK_NULL_HANDLE;
+  Vertex *mMapped = nullptr;
+  uint32_t mImageCount = 0;
+  // Per slot, what prepareFrame() put there
+  std::vector<uint32_t> mVertexCounts;
+  std::vector<uint32_t> mOverlayFirst;
+
+  std::vector<Vertex> mDepthTested;
+  std::vector<Vertex> mOverlaid;
+
+  void createBuffer();
+  void destroyBuffer();
+};
+
+#else
+
+// Release builds, every call compiles to nothing
+class DebugDraw {
+public:
+  void init(VkPhysicalDevice, VkDevice, uint32_t, VkFormat, VkFormat, VkSampleCountFlagBits, const std::vector<char> &,
+            const std::vector<char> &, VkPipelineCache) {}
+  void destroy() {}
+  void resize(uint32_t) {}
+
+  void line(const glm::vec3 &, const glm::vec3 &, const glm::vec4 &, bool = true) {}
+  void box(const Utils::AABB &, const glm::vec4 &, bool = true) {}
+  void sphere(const glm::vec3 &, float, const glm::vec4 &, bool = true) {}
+  void frustum(const glm::mat4 &, const glm::vec4 &, bool = true) {}
+
+  void prepareFrame(uint32_t) {}
+  void draw(VkCommandBuffer, uint32_t, const glm::mat4 &, VkExtent2D) {}
+};
+
+#endif
+} // namespace VulkanEngine
@@ -0,0 +1,252 @@
+#include "descriptor_allocator.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include <vulkan_initializers.hpp>
+
+namespace VulkanEngine {
+
+//===================================================
+// DescriptorAllocator
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio> &ratios,
+                               VkDescriptorPoolCreateFlags flags) {
+  mDevice = device;
+  mSetsPerPool = std::max(setsPerPool, 1u);
+  mRatios = ratios;
+  mFlags = flags;
+}
+
+void DescriptorAllocator::destroy() {
+  for (VkDescriptorPool pool : mFreePools) {
+    vkDestroyDescriptorPool(mDevice, pool, nullptr);
+  }
+  for (VkDescriptorPool pool : mUsedPools) {
+    vkDestroyDescriptorPool(mDevice, pool, nullptr);
+  }
+  if (mCurrentPool != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(mDevice, mCurrentPool, nullptr);
+  }
+  mFreePools.clear();
+  mUsedPools.clear();
+  mCurrentPool = VK_NULL_HANDLE;
+  mStats.poolsInUse = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool() {
+  if (!mFreePools.empty()) {
+    VkDescriptorPool pool = mFreePools.back();
+    mFreePools.pop_back();
+    return pool;
+  }
+
+  std::vector<VkDescriptorPoolSize> poolSizes;
+  for (const PoolSizeRatio &ratio : mRatios) {
+    uint32_t count = static_cast<uint32_t>(ratio.ratio * mSetsPerPool);
+    poolSizes.push_back({ratio.type, std::max(count, 1u)});
+  }
+
+  VkDescriptorPoolCreateInfo poolInfo =
+      VulkanInit::descriptor_pool_create_info(static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), mSetsPerPool);
+  poolInfo.flags = mFlags;
+
+  VkDescriptorPool pool;
+  VK_CHECK(vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &pool), "vkCreateDescriptorPool");
+  mStats.poolsCreated++;
+
+  mSetsPerPool = std::min(static_cast<uint32_t>(mSetsPerPool * kGrowth), kMaxSetsPerPool);
+  return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void *pNext) {
+  if (mCurrentPool == VK_NULL_HANDLE) {
+    mCurrentPool = grabPool();
+    mStats.poolsInUse++;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = VulkanInit::descriptor_set_allocate_info(mCurrentPool, &layout, 1);
+  allocInfo.pNext = pNext;
+
+  VkDescriptorSet set;
+  VkResult result = vkAllocateDescriptorSets(mDevice, &allocInfo, &set);
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    // The current pool is full, move on to the next one
+    mUsedPools.push_back(mCurrentPool);
+    mCurrentPool = grabPool();
+    mStats.poolsInUse++;
+
+    allocInfo.descriptorPool = mCurrentPool;
+    result = vkAllocateDescriptorSets(mDevice, &allocInfo, &set);
+  }
+  VK_CHECK(result, "vkAllocateDescriptorSets");
+
+  mStats.setsAllocated++;
+  return set;
+}
+
+void DescriptorAllocator::reset() {
+  if (mCurrentPool != VK_NULL_HANDLE) {
+    mUsedPools.push_back(mCurrentPool);
+    mCurrentPool = VK_NULL_HANDLE;
+  }
+  for (VkDescriptorPool pool : mUsedPools) {
+    vkResetDescriptorPool(mDevice, pool, 0);
+    mFreePools.push_back(pool);
+  }
+  mUsedPools.clear();
+  mStats.poolsInUse = 0;
+  mStats.resets++;
+}
+
+//===================================================
+// DescriptorLayoutCache
+
+void DescriptorLayoutCache::init(VkDevice device) {
+  mDevice = device;
+}
+
+void DescriptorLayoutCache::destroy() {
+  for (auto &entry : mLayouts) {
+    vkDestroyDescriptorSetLayout(mDevice, entry.second, nullptr);
+  }
+  mLayouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getLayout(const VkDescriptorSetLayoutCreateInfo &createInfo) {
+  LayoutKey key;
+  key.flags = createInfo.flags;
+  key.bindings.assign(createInfo.pBindings, createInfo.pBindings + createInfo.bindingCount);
+
+  const VkBaseInStructure *next = static_cast<const VkBaseInStructure *>(createInfo.pNext);
+  for (; next != nullptr; next = next->pNext) {
+    if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO) {
+      const auto *flagsInfo = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo *>(next);
+      key.bindingFlags.assign(flagsInfo->pBindingFlags, flagsInfo->pBindingFlags + flagsInfo->bindingCount);
+    }
+  }
+  if (key.bindingFlags.empty()) {
+    key.bindingFlags.resize(key.bindings.size(), 0);
+  }
+
+  // Sort by binding so the same bindings in another order share a layout
+  std::vector<size_t> order(key.bindings.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&key](size_t a, size_t b) {
+    return key.bindings[a].binding < key.bindings[b].binding;
+  });
+  LayoutKey sorted;
+  sorted.flags = key.flags;
+  for (size_t i : order) {
+    sorted.bindings.push_back(key.bindings[i]);
+    sorted.bindings.back().pImmutableSamplers = nullptr;
+    sorted.bindingFlags.push_back(key.bindingFlags[i]);
+  }
+
+  auto found = mLayouts.find(sorted);
+  if (found != mLayouts.end()) {
+    mHits++;
+    return found->second;
+  }
+
+  VkDescriptorSetLayout layout;
+  VK_CHECK(vkCreateDescriptorSetLayout(mDevice, &createInfo, nullptr, &layout), "vkCreateDescriptorSetLayout");
+  mLayouts.emplace(std::move(sorted), layout);
+  return layout;
+}
+
+bool DescriptorLayoutCache::LayoutKey::operator==(const LayoutKey &other) const {
+  if (flags != other.flags || bindings.size() != other.bindings.size() || bindingFlags != other.bindingFlags) {
+    return false;
+  }
+  for (size_t i = 0; i < bindings.size(); i++) {
+    const VkDescriptorSetLayoutBinding &a = bindings[i];
+    const VkDescriptorSetLayoutBinding &b = other.bindings[i];
+    if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+        a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()(const LayoutKey &key) const {
+  size_t hash = std::hash<uint32_t>()(key.flags);
+  auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+  for (size_t i = 0; i < key.bindings.size(); i++) {
+    const VkDescriptorSetLayoutBinding &binding = key.bindings[i];
+    combine(binding.binding);
+    combine(binding.descriptorType);
+    combine(binding.descriptorCount);
+    combine(binding.stageFlags);
+    combine(key.bindingFlags[i]);
+  }
+  return hash;
+}
+
+//===================================================
+// PipelineLayoutCache
+
+void PipelineLayoutCache::init(VkDevice device) {
+  mDevice = device;
+}
+
+void PipelineLayoutCache::destroy() {
+  for (auto &entry : mLayouts) {
+    vkDestroyPipelineLayout(mDevice, entry.second, nullptr);
+  }
+  mLayouts.clear();
+}
+
+VkPipelineLayout PipelineLayoutCache::getLayout(const std::vector<VkDescriptorSetLayout> &setLayouts,
+                                                const std::vector<VkPushConstantRange> &pushConstantRanges) {
+  LayoutKey key{setLayouts, pushConstantRanges};
+  auto found = mLayouts.find(key);
+  if (found != mLayouts.end()) {
+    mHits++;
+    return found->second;
+  }
+
+  VkPipelineLayoutCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  createInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  createInfo.pSetLayouts = setLayouts.data();
+  createInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+  createInfo.pPushConstantRanges = pushConstantRanges.data();
+
+  VkPipelineLayout layout;
+  VK_CHECK(vkCreatePipelineLayout(mDevice, &createInfo, nullptr, &layout), "vkCreatePipelineLayout");
+  mLayouts.emplace(std::move(key), layout);
+  return layout;
+}
+
+bool PipelineLayoutCache::LayoutKey::operator==(const LayoutKey &other) const {
+  if (setLayouts != other.setLayouts || pushConstantRanges.size() != other.pushConstantRanges.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < pushConstantRanges.size(); i++) {
+    const VkPushConstantRange &a = pushConstantRanges[i];
+    const VkPushConstantRange &b = other.pushConstantRanges[i];
+    if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t PipelineLayoutCache::LayoutKeyHash::operator()(const LayoutKey &key) const {
+  size_t hash = 0;
+  auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+  for (VkDescriptorSetLayout setLayout : key.setLayouts) {
+    combine(std::hash<VkDescriptorSetLayout>()(setLayout));
+  }
+  for (const VkPushConstantRange &range : key.pushConstantRanges) {
+    combine(range.stageFlags);
+    combine(range.offset);
+    combine(range.size);
+  }
+  return hash;
+}
+} // namespace VulkanEngine
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// Hands out descriptor sets from a growing list of pools.
+// Pools are sized from mSetsPerPool and the per set ratios given to init(),
+// when the current pool runs out a fresh one is taken, so callers never have
+// to know up front how many sets they need. reset() gives every set back at
+// once and keeps the pools around, which is what per frame allocators want.
+class DescriptorAllocator {
+public:
+  // Descriptors of this type per set, e.g. {UNIFORM_BUFFER, 1.0f}
+  struct PoolSizeRatio {
+    VkDescriptorType type;
+    float ratio;
+  };
+
+  struct Stats {
+    uint32_t poolsCreated = 0;
+    uint32_t poolsInUse = 0;
+    uint64_t setsAllocated = 0;
+    uint32_t resets = 0;
+  };
+
+  void init(VkDevice device, uint32_t setsPerPool, const std::vector<PoolSizeRatio> &ratios,
+            VkDescriptorPoolCreateFlags flags = 0);
+  void destroy();
+
+  // pNext is passed on to VkDescriptorSetAllocateInfo, e.g. for variable descriptor counts
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void *pNext = nullptr);
+  // Frees every set allocated so far, the pools are reused
+  void reset();
+
+  const Stats &stats() const { return mStats; }
+
+private:
+  // Each new pool is this much bigger than the last, up to kMaxSetsPerPool
+  static constexpr float kGrowth = 1.5f;
+  static constexpr uint32_t kMaxSetsPerPool = 4096;
+
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkDescriptorPoolCreateFlags mFlags = 0;
+  std::vector<PoolSizeRatio> mRatios;
+  uint32_t mSetsPerPool = 0;
+
+  VkDescriptorPool mCurrentPool = VK_NULL_HANDLE;
+  // Full pools, and pools that have been reset and can be handed out again
+  std::vector<VkDescriptorPool> mUsedPools;
+  std::vector<VkDescriptorPool> mFreePools;
+
+  Stats mStats;
+
+  VkDescriptorPool grabPool();
+};
+
+// Creates each distinct descriptor set layout once.
+// Layouts are keyed by their bindings, the create flags and the binding flags
+// from a VkDescriptorSetLayoutBindingFlagsCreateInfo in pNext. Any other pNext
+// structure is ignored.
+class DescriptorLayoutCache {
+public:
+  void init(VkDevice device);
+  void destroy();
+
+  VkDescriptorSetLayout getLayout(const VkDescriptorSetLayoutCreateInfo &createInfo);
+
+  size_t size() const { return mLayouts.size(); }
+  uint64_t hits() const { return mHits; }
+
+private:
+  struct LayoutKey {
+    VkDescriptorSetLayoutCreateFlags flags = 0;
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    std::vector<VkDescriptorBindingFlags> bindingFlags;
+
+    bool operator==(const LayoutKey &other) const;
+  };
+
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey &key) const;
+  };
+
+  VkDevice mDevice = VK_NULL_HANDLE;
+  std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> mLayouts;
+  uint64_t mHits = 0;
+};
+
+// Creates each distinct pipeline layout once, keyed by the set layouts (which
+// DescriptorLayoutCache already made unique) and the push constant ranges.
+// Pipelines built from shaders with the same interface share one layout, so
+// descriptor sets stay compatible between them.
+class PipelineLayoutCache {
+public:
+  void init(VkDevice device);
+  void destroy();
+
+  VkPipelineLayout getLayout(const std::vector<VkDescriptorSetLayout> &setLayouts,
+                             const std::vector<VkPushConstantRange> &pushConstantRanges);
+
+  size_t size() const { return mLayouts.size(); }
+  uint64_t hits() const { return mHits; }
+
+private:
+  struct LayoutKey {
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+
+    bool operator==(const LayoutKey &other) const;
+  };
+
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey &key) const;
+  };
+
+  VkDevice mDevice = VK_NULL_HANDLE;
+  std::unordered_map<LayoutKey, VkPipelineLayout, LayoutKeyHash> mLayouts;
+  uint64_t mHits = 0;
+};
+} // namespace VulkanEngine
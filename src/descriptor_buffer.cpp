@@ -0,0 +1,157 @@
+#include "descriptor_buffer.hpp"
+
+#include <cstring>
+
+#include <vulkan_helper.hpp>
+
+namespace VulkanEngine {
+
+bool DescriptorBuffer::isSupported(VkPhysicalDevice physicalDevice) {
+  uint32_t extensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+  bool hasExtension = false;
+  for (const VkExtensionProperties &extension : extensions) {
+    if (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME) == 0) {
+      hasExtension = true;
+    }
+  }
+  if (!hasExtension) {
+    return false;
+  }
+
+  // Buffers are bound by device address, uniform buffer descriptors too
+  VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+  addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+  VkPhysicalDeviceDescriptorBufferFeaturesEXT bufferFeatures{};
+  bufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+  bufferFeatures.pNext = &addressFeatures;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &bufferFeatures;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+  return bufferFeatures.descriptorBuffer && addressFeatures.bufferDeviceAddress;
+}
+
+void DescriptorBuffer::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout layout,
+                            uint32_t maxSets) {
+  mDevice = device;
+  mLayout = layout;
+  mMaxSets = maxSets;
+  mNextSet = 0;
+
+  mGetLayoutSize = PFN_vkGetDescriptorSetLayoutSizeEXT(vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutSizeEXT"));
+  mGetBindingOffset = PFN_vkGetDescriptorSetLayoutBindingOffsetEXT(vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutBindingOffsetEXT"));
+  mGetDescriptor = PFN_vkGetDescriptorEXT(vkGetDeviceProcAddr(device, "vkGetDescriptorEXT"));
+  mCmdBindDescriptorBuffers = PFN_vkCmdBindDescriptorBuffersEXT(vkGetDeviceProcAddr(device, "vkCmdBindDescriptorBuffersEXT"));
+  mCmdSetDescriptorBufferOffsets = PFN_vkCmdSetDescriptorBufferOffsetsEXT(vkGetDeviceProcAddr(device, "vkCmdSetDescriptorBufferOffsetsEXT"));
+  if (!mGetLayoutSize || !mGetBindingOffset || !mGetDescriptor || !mCmdBindDescriptorBuffers ||
+      !mCmdSetDescriptorBufferOffsets) {
+    throw std::runtime_error("VK_EXT_descriptor_buffer entry points missing");
+  }
+
+  mProperties = {};
+  mProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2 properties2{};
+  properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties2.pNext = &mProperties;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+  VkDeviceSize layoutSize = 0;
+  mGetLayoutSize(device, layout, &layoutSize);
+  VkDeviceSize alignment = mProperties.descriptorBufferOffsetAlignment;
+  mSetSize = (layoutSize + alignment - 1) / alignment * alignment;
+  mBindingOffsets.clear();
+
+  // Combined image samplers need the sampler usage as well as the resource one
+  VkDeviceSize bufferSize = mSetSize * maxSets;
+  VulkanHelper::createBuffer(physicalDevice, device, bufferSize,
+                             VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+                                 VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &mBuffer, &mMemory, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+  void *data;
+  VK_CHECK(vkMapMemory(device, mMemory, 0, bufferSize, 0, &data), "vkMapMemory");
+  mMapped = static_cast<uint8_t *>(data);
+  mAddress = VulkanHelper::getBufferAddress(device, mBuffer);
+
+  std::cout << "Descriptor buffer: " << maxSets << " sets of " << mSetSize << " bytes\n";
+}
+
+void DescriptorBuffer::destroy() {
+  if (mBuffer != VK_NULL_HANDLE) {
+    vkUnmapMemory(mDevice, mMemory);
+    vkDestroyBuffer(mDevice, mBuffer, nullptr);
+    vkFreeMemory(mDevice, mMemory, nullptr);
+  }
+  mBuffer = VK_NULL_HANDLE;
+  mMemory = VK_NULL_HANDLE;
+  mMapped = nullptr;
+}
+
+VkDeviceSize DescriptorBuffer::allocateSet() {
+  // Sets are never given back, reusing one could overwrite descriptors of
+  // frames still in flight
+  if (mNextSet == mMaxSets) {
+    throw std::runtime_error("Descriptor buffer is full");
+  }
+  return mSetSize * mNextSet++;
+}
+
+VkDeviceSize DescriptorBuffer::bindingOffset(uint32_t binding) {
+  // Looked up on first use, the offsets never change for a layout
+  if (binding >= mBindingOffsets.size()) {
+    mBindingOffsets.resize(binding + 1, VK_WHOLE_SIZE);
+  }
+  if (mBindingOffsets[binding] == VK_WHOLE_SIZE) {
+    mGetBindingOffset(mDevice, mLayout, binding, &mBindingOffsets[binding]);
+  }
+  return mBindingOffsets[binding];
+}
+
+void DescriptorBuffer::writeUniformBuffer(VkDeviceSize set, uint32_t binding, VkBuffer buffer, VkDeviceSize range) {
+  VkDescriptorAddressInfoEXT addressInfo{};
+  addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+  addressInfo.address = VulkanHelper::getBufferAddress(mDevice, buffer);
+  addressInfo.range = range;
+  addressInfo.format = VK_FORMAT_UNDEFINED;
+
+  VkDescriptorGetInfoEXT getInfo{};
+  getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+  getInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  getInfo.data.pUniformBuffer = &addressInfo;
+  mGetDescriptor(mDevice, &getInfo, mProperties.uniformBufferDescriptorSize,
+                 mMapped + set + bindingOffset(binding));
+}
+
+void DescriptorBuffer::writeCombinedImageSampler(VkDeviceSize set, uint32_t binding,
+                                                 const VkDescriptorImageInfo &imageInfo) {
+  VkDescriptorGetInfoEXT getInfo{};
+  getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+  getInfo.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  getInfo.data.pCombinedImageSampler = &imageInfo;
+  mGetDescriptor(mDevice, &getInfo, mProperties.combinedImageSamplerDescriptorSize,
+                 mMapped + set + bindingOffset(binding));
+}
+
+void DescriptorBuffer::bind(VkCommandBuffer commandBuffer) {
+  VkDescriptorBufferBindingInfoEXT bindingInfo{};
+  bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+  bindingInfo.address = mAddress;
+  bindingInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+                      VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+  mCmdBindDescriptorBuffers(commandBuffer, 1, &bindingInfo);
+}
+
+void DescriptorBuffer::bindSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet,
+                               VkDeviceSize set) {
+  uint32_t bufferIndex = 0;
+  mCmdSetDescriptorBufferOffsets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, firstSet, 1,
+                                 &bufferIndex, &set);
+}
+} // namespace VulkanEngine
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// Descriptor sets that live in a host visible buffer (VK_EXT_descriptor_buffer).
+// There are no pools or VkDescriptorSets, a set is a range of the buffer laid
+// out as the driver reports for the layout and writing a descriptor copies
+// its bytes straight into the mapped memory.
+// Sets are handed out front to back and live as long as the buffer, init()
+// has to be given room for all of them.
+class DescriptorBuffer {
+public:
+  // True if the device has the extension and the features it needs
+  static bool isSupported(VkPhysicalDevice physicalDevice);
+
+  // layout has to be created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDescriptorSetLayout layout, uint32_t maxSets);
+  void destroy();
+
+  // Returns the offset of a new set in the buffer, throws when it is full
+  VkDeviceSize allocateSet();
+
+  void writeUniformBuffer(VkDeviceSize set, uint32_t binding, VkBuffer buffer, VkDeviceSize range);
+  void writeCombinedImageSampler(VkDeviceSize set, uint32_t binding, const VkDescriptorImageInfo &imageInfo);
+
+  // Binds the buffer, once per command buffer before any bindSet()
+  void bind(VkCommandBuffer commandBuffer);
+  void bindSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, VkDeviceSize set);
+
+  uint32_t capacity() const { return mMaxSets; }
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceDescriptorBufferPropertiesEXT mProperties{};
+
+  VkBuffer mBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory mMemory = VK_NULL_HANDLE;
+  uint8_t *mMapped = nullptr;
+  VkDeviceAddress mAddress = 0;
+
+  VkDescriptorSetLayout mLayout = VK_NULL_HANDLE;
+  // Size of one set, rounded up to descriptorBufferOffsetAlignment
+  VkDeviceSize mSetSize = 0;
+  uint32_t mMaxSets = 0;
+  uint32_t mNextSet = 0;
+  // Indexed by binding number
+  std::vector<VkDeviceSize> mBindingOffsets;
+
+  PFN_vkGetDescriptorSetLayoutSizeEXT mGetLayoutSize = nullptr;
+  PFN_vkGetDescriptorSetLayoutBindingOffsetEXT mGetBindingOffset = nullptr;
+  PFN_vkGetDescriptorEXT mGetDescriptor = nullptr;
+  PFN_vkCmdBindDescriptorBuffersEXT mCmdBindDescriptorBuffers = nullptr;
+  PFN_vkCmdSetDescriptorBufferOffsetsEXT mCmdSetDescriptorBufferOffsets = nullptr;
+
+  VkDeviceSize bindingOffset(uint32_t binding);
+};
+} // namespace VulkanEngine
@@ -0,0 +1,25 @@
+#include "entity_store.hpp"
+
+namespace VulkanEngine {
+
+Entity EntityStore::createEntity(glm::vec3 position, uint32_t mesh, uint32_t material) {
+  Entity entity = static_cast<Entity>(mPositions.size());
+
+  mPositions.push_back(position);
+  mMeshes.push_back(mesh);
+  mMaterials.push_back(material);
+  mBounds.push_back(Utils::AABB{position, position});
+  mVisible.push_back(1);
+
+  return entity;
+}
+
+void EntityStore::updateBounds(const std::vector<Utils::Mesh> &meshes) {
+  // Entities are only translated, so the bounds just move with the position
+  for (size_t i = 0; i < mPositions.size(); i++) {
+    const Utils::AABB &local = meshes[mMeshes[i]].mBounds;
+    mBounds[i].min = local.min + mPositions[i];
+    mBounds[i].max = local.max + mPositions[i];
+  }
+}
+} // namespace VulkanEngine
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+typedef uint32_t Entity;
+
+// Storage for everything that gets drawn.
+// Every renderable has the same set of components, so there is a single
+// archetype and each component is kept in its own tightly packed array that
+// is indexed by the entity. Systems only touch the arrays they need, e.g.
+// building the model matrices only walks mPositions.
+class EntityStore {
+public:
+  //===================================================
+  // Components
+  std::vector<glm::vec3> mPositions;
+  // Index into VulkanRenderer::mMeshes
+  std::vector<uint32_t> mMeshes;
+  // Index into VulkanRenderer::mMaterials
+  std::vector<uint32_t> mMaterials;
+  // World space bounds, kept up to date by updateBounds()
+  std::vector<Utils::AABB> mBounds;
+  std::vector<uint8_t> mVisible;
+
+  //===================================================
+  Entity createEntity(glm::vec3 position, uint32_t mesh, uint32_t material);
+
+  size_t size() const { return mPositions.size(); }
+
+  // Bounds system, moves the model space bounds of each mesh to where the
+  // entity is
+  void updateBounds(const std::vector<Utils::Mesh> &meshes);
+};
+} // namespace VulkanEngine
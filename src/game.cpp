@@ -2,6 +2,13 @@
 
 namespace GameEngine {
 Game::Game() {
+  Trace::setThreadName("main");
+  if (const char *tracePath = std::getenv("VKGAME_TRACE_FILE")) {
+    mTracePath = tracePath;
+    Trace::beginCapture();
+  }
+  TRACE_ZONE("Game::Game");
+
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0) {
     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't initialize SDL: %s",
                  SDL_GetError());
@@ -22,32 +29,39 @@ Game::Game() {
   // instantiate to identiy matrix
   mVulkanRenderer->mCameraRotation = glm::mat4(1.0);
 
-  mGLTFLoader->loadFile("/models/sphere/sphere.gltf");
-  Utils::Model lightModel = loadModel(glm::vec3(3.0f, 3.0f, 3.0f),
-                             mGLTFLoader->mVertices, 
-                             mGLTFLoader->mIndices); 
+  // Every entity uses the default material for now
+  mVulkanRenderer->mMaterials.push_back(Utils::Material{});
 
-  mVulkanRenderer->mModels.push_back(lightModel);
+  mGLTFLoader->loadFile("/models/sphere/sphere.gltf");
+  uint32_t sphereMesh = mVulkanRenderer->createMesh(mGLTFLoader->mVertices, mGLTFLoader->mIndices);
+  // First entity is the light
+  mVulkanRenderer->createEntity(glm::vec3(3.0f, 3.0f, 3.0f), sphereMesh, 0);
   
   mGLTFLoader->loadFile("/models/cube/cube.gltf");
-  Utils::Model cubeModel = loadModel(glm::vec3(0.0f, 0.0f, 0.0f),
-                             mGLTFLoader->mVertices, 
-                             mGLTFLoader->mIndices); 
-  mVulkanRenderer->mModels.push_back(cubeModel);
-
-  Utils::Model secondCube = loadModel(glm::vec3(1.0f, 0.0f, 0.0f),
-                             mGLTFLoader->mVertices, 
-                             mGLTFLoader->mIndices);
-  mVulkanRenderer->mModels.push_back(secondCube);
+  uint32_t cubeMesh = mVulkanRenderer->createMesh(mGLTFLoader->mVertices, mGLTFLoader->mIndices);
+  mVulkanRenderer->createEntity(glm::vec3(0.0f, 0.0f, 0.0f), cubeMesh, 0);
+  mVulkanRenderer->createEntity(glm::vec3(1.0f, 0.0f, 0.0f), cubeMesh, 0);
+
+  // Everything is on the GPU now, no need to keep the vertices around
+  mGLTFLoader->clear();
   
   mVulkanRenderer->beginVulkanObjectCreation();
 
+  mFpsText = mVulkanRenderer->mTextOverlay->createText(0.0f, 0.0f, TextOverlay::alignLeft);
+  mCameraText = mVulkanRenderer->mTextOverlay->createText(0.0f, 30.0f, TextOverlay::alignLeft);
+  mPerfHud.init(mVulkanRenderer->mTextOverlay, mVulkanRenderer->mPhysicalDevice, mVulkanRenderer->mMemoryBudget);
+
   isRunning = true;
   mLastTimestamp = std::chrono::high_resolution_clock::now();
 }
 
 Game::~Game() {
-  // delete vulkanRenderer;
+  if (Trace::capturing()) {
+    Trace::endCapture(mTracePath);
+  }
+  // Waits for the GPU and joins the pipeline, shader and streaming threads,
+  // the pipeline cache is saved with everything they compiled
+  delete mVulkanRenderer;
   SDL_DestroyWindow(mWindow);
   SDL_Quit();
 }
@@ -55,6 +69,7 @@ Game::~Game() {
 void Game::run() {
 
   while (isRunning) {
+    TRACE_ZONE("Game::frame");
     std::string event = getEvent();
 
     // Put into uniform buffer and view matrix to transform model coordinates in world space into camera space
@@ -69,20 +84,37 @@ void Game::run() {
     //std::cout << "fps: " << fps << "\n";
 
 
-    mVulkanRenderer->mTextOverlay->beginTextUpdate();
-    mVulkanRenderer->mTextOverlay->addText("FPS: " + std::to_string(fps) + " FrameTime:" + std::to_string(mDeltaTime), 0.0f, 0.0f, TextOverlay::alignLeft);
-    mVulkanRenderer->mTextOverlay->addText("Camera Pos- X:" + std::to_string(mVulkanRenderer->mCameraPos.x) + 
-                        " Y:"  + std::to_string(mVulkanRenderer->mCameraPos.y) + 
-                        " Z:"  + std::to_string(mVulkanRenderer->mCameraPos.z), 0.0f, 30.0f, TextOverlay::alignLeft);
-                        
-    mVulkanRenderer->mTextOverlay->endTextUpdate();
+    {
+      TRACE_ZONE("Game::updateText");
+      mVulkanRenderer->mTextOverlay->beginTextUpdate();
+      mStatsLine.clear().append("FPS: ").append(fps, 1).append(" FrameTime:").append(mDeltaTime, 3);
+      mVulkanRenderer->mTextOverlay->setText(mFpsText, mStatsLine.view());
+      mStatsLine.clear().append("Camera Pos- X:").append(mVulkanRenderer->mCameraPos.x)
+                        .append(" Y:").append(mVulkanRenderer->mCameraPos.y)
+                        .append(" Z:").append(mVulkanRenderer->mCameraPos.z);
+      mVulkanRenderer->mTextOverlay->setText(mCameraText, mStatsLine.view());
+      mPerfHud.update(mDeltaTime, mVulkanRenderer->mFrameStats, mVulkanRenderer->mGpuTimer.results());
+      if (mTextStressTest) {
+        // 32 lines of 64 printable characters, 2048 glyphs rewritten every frame
+        for (uint32_t line = 0; line < 32; line++) {
+          for (size_t c = 0; c < mTextStressLine.size(); c++) {
+            mTextStressLine[c] = static_cast<char>('!' + (mTextStressFrame + line + c) % 94);
+          }
+          mVulkanRenderer->mTextOverlay->addText(mTextStressLine, 0.0f, 60.0f + line * 20.0f, TextOverlay::alignLeft);
+        }
+        mTextStressFrame++;
+      }
+    }
     mVulkanRenderer->drawFrame();
+    // Keeps the threads' trace rings from filling up
+    Trace::collect();
     //SDL_Delay(10);
     //   isRunning = false;
   }
 }
 
 std::string Game::getEvent() {
+  TRACE_ZONE("Game::getEvent");
   std::string eventName = "NONE";
   // Poll for events. SDL_PollEvent() returns 0 when there are no
   // more events on the event queue, our while loop will exit when
@@ -129,11 +161,39 @@ std::string Game::getEvent() {
 
         // rotate the light model about the y axis
         glm::mat4 rot_mat = glm::rotate(glm::mat4(1.0f), glm::radians(10.0f),  glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::vec3 originalPos = mVulkanRenderer->mModels[0].mPosition;
-        mVulkanRenderer->mModels[0].mPosition = glm::vec4(originalPos.x, originalPos.y, originalPos.z, 1.0f) * rot_mat;
+        glm::vec3 originalPos = mVulkanRenderer->mEntities.mPositions[0];
+        mVulkanRenderer->mEntities.mPositions[0] = glm::vec4(originalPos.x, originalPos.y, originalPos.z, 1.0f) * rot_mat;
 
         break;
       }
+      case SDLK_t: {
+        eventName = "KEY_T";
+        mTextStressTest = !mTextStressTest;
+        std::cout << "Text stress test " << (mTextStressTest ? "on" : "off") << "\n";
+        break;
+      }
+      case SDLK_F12: {
+        eventName = "KEY_F12";
+        if (Trace::capturing()) {
+          Trace::endCapture(mTracePath);
+        } else {
+          std::cout << "Trace capture started\n";
+          Trace::beginCapture();
+        }
+        break;
+      }
+      case SDLK_p: {
+        eventName = "KEY_P";
+        mPerfHud.setVisible(!mPerfHud.visible());
+        std::cout << "Perf HUD " << (mPerfHud.visible() ? "on" : "off") << "\n";
+        break;
+      }
+      case SDLK_b: {
+        eventName = "KEY_B";
+        mVulkanRenderer->mDrawDebugBounds = !mVulkanRenderer->mDrawDebugBounds;
+        std::cout << "Debug bounds " << (mVulkanRenderer->mDrawDebugBounds ? "on" : "off") << "\n";
+        break;
+      }
       case SDLK_q: {
         eventName = "KEY_Q";
         //mRoll -= mLookSpeed * mDeltaTime;
@@ -195,19 +255,19 @@ std::string Game::getEvent() {
       case SDLK_z: {
         eventName = "KEY_z";
         std::cout << "Event: " << eventName << "\n";
-        mVulkanRenderer->mModels[0].mPosition.y +=0.1f;
+        mVulkanRenderer->mEntities.mPositions[0].y +=0.1f;
         break;
       }
       case SDLK_c: {
         eventName = "KEY_c";
         std::cout << "Event: " << eventName << "\n";
-        mVulkanRenderer->mModels[2].mPosition.y +=0.1f;
+        mVulkanRenderer->mEntities.mPositions[2].y +=0.1f;
         break;
       }
       case SDLK_x: {
         eventName = "KEY_x";
         std::cout << "Event: " << eventName << "\n";
-        mVulkanRenderer->mModels[0].mPosition.y -=0.1f;
+        mVulkanRenderer->mEntities.mPositions[0].y -=0.1f;
         break;
       }
       default:
@@ -268,23 +328,4 @@ std::string Game::getEvent() {
   return eventName;
 }
 
-Utils::Model Game::loadModel(glm::vec3                  position,
-                             std::vector<Utils::Vertex> vertices, 
-                             std::vector<uint32_t>      indices) {
-
-    Utils::Model cubeModel;
-
-    cubeModel.mPosition = position;
-
-    cubeModel.mVertices = vertices;
-    cubeModel.mIndices = indices;
-
-    mVulkanRenderer->createVertexBuffer(cubeModel.mVertices, &cubeModel.mVertexBuffer, &cubeModel.mVertexBufferMemory);
-    mVulkanRenderer->createIndexBuffer(cubeModel.mIndices, &cubeModel.mIndexBuffer, &cubeModel.mIndexBufferMemory);
-    mVulkanRenderer->createUniformBufferForModel(&cubeModel.mUniformBuffer, &cubeModel.mUniformBuffersMemory);
-
-    return cubeModel;
- 
-}
-
 } // namespace GameEngine
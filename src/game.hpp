@@ -2,11 +2,14 @@
 
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <gltf_loader.hpp>
 #include <vulkan_renderer.hpp>
+#include <perf_hud.hpp>
+#include <trace.hpp>
 
 namespace GameEngine {
 
@@ -33,6 +36,22 @@ public:
   VulkanEngine::VulkanRenderer *mVulkanRenderer;
 
   bool mIsCameraMoving = false;
+  // Stats lines, only laid out again where the numbers changed
+  TextOverlay::TextHandle mFpsText;
+  TextOverlay::TextHandle mCameraText;
+  // Formatted into every frame, no allocations on the way to the overlay
+  TextBuffer<128> mStatsLine;
+  // Toggled with P
+  VulkanEngine::PerfHud mPerfHud;
+  // Toggled with T, fills the text overlay to capacity with characters that
+  // change every frame to watch it on screen. tests/text_overlay_test checks
+  // the clamp and the per swapchain image slots
+  bool mTextStressTest = false;
+  uint32_t mTextStressFrame = 0;
+  std::string mTextStressLine = std::string(64, ' ');
+  // F12 starts and stops a trace capture written here, startup is captured
+  // too when VKGAME_TRACE_FILE gives the path
+  std::string mTracePath = "trace.json";
   int32_t mMouseXStart;
   int32_t mMouseYStart;
   Game();
@@ -41,9 +60,5 @@ public:
   void run();
 
   std::string getEvent();
-  Utils::Model loadModel(glm::vec3                  position,
-                         std::vector<Utils::Vertex> vertices, 
-                         std::vector<uint32_t>      indices); 
- 
 };
 } // namespace GameEngine
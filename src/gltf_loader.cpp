@@ -7,6 +7,7 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include <tiny_gltf.h>
+#include <trace.hpp>
 namespace GLTF {
 
 GLTFLoader::GLTFLoader(){
@@ -14,6 +15,7 @@ GLTFLoader::GLTFLoader(){
 }
 
 void GLTFLoader::loadFile(std::string filePath) {
+  TRACE_ZONE("GLTFLoader::loadFile");
 
   mVertices.clear();
   mIndices.clear();
@@ -48,6 +50,12 @@ void GLTFLoader::loadFile(std::string filePath) {
   }
 }
 
+void GLTFLoader::clear() {
+  // clear() keeps the capacity, swap with empty vectors to actually free it
+  std::vector<Utils::Vertex>().swap(mVertices);
+  std::vector<uint32_t>().swap(mIndices);
+}
+
 void GLTFLoader::loadNode(tinygltf::Node node, tinygltf::Model model){
   std::cout<< "looking at: " << node.name << "\n";
 
@@ -14,6 +14,8 @@ struct GLTFLoader {
   ~GLTFLoader();
 
   void loadFile(std::string filePath);
+  // Release the CPU copies of the last loaded file
+  void clear();
   void loadNode(tinygltf::Node node, tinygltf::Model model);
 
 };
@@ -0,0 +1,378 @@
+#include "glyph_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#define STBTT_STATIC
+#include "stb_truetype.h"
+
+namespace VulkanEngine {
+
+namespace {
+// Shelves are this many pixels apart in height, so glyphs of about the same
+// size share them
+const uint32_t kShelfGranularity = 4;
+// Between glyphs, keeps linear filtering from picking up the neighbour
+const uint32_t kGlyphGap = 1;
+} // namespace
+
+uint32_t decodeUtf8(std::string_view text, size_t &index) {
+  const uint32_t replacement = 0xFFFD;
+  auto byte = [&text](size_t i) { return static_cast<uint8_t>(text[i]); };
+
+  uint8_t lead = byte(index);
+  uint32_t length;
+  uint32_t codepoint;
+  if (lead < 0x80) {
+    index++;
+    return lead;
+  } else if ((lead & 0xE0) == 0xC0) {
+    length = 2;
+    codepoint = lead & 0x1F;
+  } else if ((lead & 0xF0) == 0xE0) {
+    length = 3;
+    codepoint = lead & 0x0F;
+  } else if ((lead & 0xF8) == 0xF0) {
+    length = 4;
+    codepoint = lead & 0x07;
+  } else {
+    index++;
+    return replacement;
+  }
+
+  if (index + length > text.size()) {
+    index++;
+    return replacement;
+  }
+  for (uint32_t i = 1; i < length; i++) {
+    uint8_t continuation = byte(index + i);
+    if ((continuation & 0xC0) != 0x80) {
+      index++;
+      return replacement;
+    }
+    codepoint = (codepoint << 6) | (continuation & 0x3F);
+  }
+
+  // Overlong encodings, surrogates and values past U+10FFFF
+  const uint32_t minimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+  if (codepoint < minimum[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+    index++;
+    return replacement;
+  }
+  index += length;
+  return codepoint;
+}
+
+GlyphCache::GlyphCache() {}
+
+GlyphCache::~GlyphCache() {}
+
+bool GlyphCache::init(const std::string &fontPath, float pixelHeight, int padding, uint32_t atlasWidth,
+                      uint32_t atlasHeight) {
+  std::ifstream file(fontPath, std::ios::binary);
+  mFontData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  mFontInfo = std::make_unique<stbtt_fontinfo>();
+  if (mFontData.empty() || !stbtt_InitFont(mFontInfo.get(), mFontData.data(), stbtt_GetFontOffsetForIndex(mFontData.data(), 0))) {
+    std::cout << "GlyphCache: failed to load " << fontPath << "\n";
+    mFontData.clear();
+    return false;
+  }
+
+  mScale = stbtt_ScaleForPixelHeight(mFontInfo.get(), pixelHeight);
+  mPadding = padding;
+  mAtlasWidth = atlasWidth;
+  mAtlasHeight = atlasHeight;
+  mShelves.clear();
+  mShelvesEnd = 0;
+  mEntries.clear();
+  mLru.clear();
+  mReferenced.clear();
+  mUploads.clear();
+  mUploadData.clear();
+  return true;
+}
+
+void GlyphCache::beginFrame() {
+  mFrame++;
+}
+
+const GlyphCache::Glyph *GlyphCache::get(uint32_t codepoint) {
+  auto found = mEntries.find(codepoint);
+  if (found != mEntries.end()) {
+    Entry &entry = found->second;
+    entry.lastUsed = mFrame;
+    if (entry.inAtlas && entry.refs == 0) {
+      mLru.splice(mLru.begin(), mLru, entry.lru);
+    }
+    return &entry.glyph;
+  }
+  if (mFontData.empty()) {
+    return nullptr;
+  }
+
+  // Codepoints the font doesn't have get its missing glyph box (glyph 0)
+  int glyphIndex = stbtt_FindGlyphIndex(mFontInfo.get(), static_cast<int>(codepoint));
+  int advance, leftSideBearing;
+  stbtt_GetGlyphHMetrics(mFontInfo.get(), glyphIndex, &advance, &leftSideBearing);
+
+  Entry entry{};
+  entry.glyph.xadvance = advance * mScale;
+  entry.lastUsed = mFrame;
+
+  // 128 is the outline, the field drops by 128 / padding per pixel away from it
+  int width, height, xoff, yoff;
+  unsigned char *sdf = stbtt_GetGlyphSDF(mFontInfo.get(), mScale, glyphIndex, mPadding, 128, 128.0f / mPadding,
+                                         &width, &height, &xoff, &yoff);
+  if (sdf == nullptr) {
+    // Nothing to draw, only the advance matters
+    return &mEntries.emplace(codepoint, entry).first->second.glyph;
+  }
+
+  uint32_t slotWidth = width + kGlyphGap;
+  uint32_t shelf, x;
+  while (!allocate(slotWidth, height + kGlyphGap, shelf, x)) {
+    if (!evictOne()) {
+      stbtt_FreeSDF(sdf, nullptr);
+      return nullptr;
+    }
+  }
+
+  // The whole slot down to the bottom of the shelf is uploaded so nothing
+  // left over from an evicted glyph is next to this one
+  uint32_t uploadHeight = mShelves[shelf].height;
+  Upload upload{x, mShelves[shelf].y, slotWidth, uploadHeight, mUploadData.size()};
+  mUploadData.resize(mUploadData.size() + ((slotWidth * uploadHeight + 3) & ~3u), 0);
+  for (int row = 0; row < height; row++) {
+    memcpy(&mUploadData[upload.offset + row * slotWidth], sdf + row * width, width);
+  }
+  mUploads.push_back(upload);
+  stbtt_FreeSDF(sdf, nullptr);
+
+  entry.glyph.x0 = static_cast<uint16_t>(x);
+  entry.glyph.y0 = static_cast<uint16_t>(upload.y);
+  entry.glyph.x1 = static_cast<uint16_t>(x + width);
+  entry.glyph.y1 = static_cast<uint16_t>(upload.y + height);
+  entry.glyph.xoff = static_cast<float>(xoff);
+  entry.glyph.yoff = static_cast<float>(yoff);
+  entry.shelf = shelf;
+  entry.slotWidth = slotWidth;
+  entry.inAtlas = true;
+  mLru.push_front(codepoint);
+  entry.lru = mLru.begin();
+  return &mEntries.emplace(codepoint, entry).first->second.glyph;
+}
+
+void GlyphCache::addRef(uint32_t codepoint) {
+  auto found = mEntries.find(codepoint);
+  if (found == mEntries.end()) {
+    return;
+  }
+  Entry &entry = found->second;
+  if (entry.refs++ == 0 && entry.inAtlas) {
+    mReferenced.splice(mReferenced.begin(), mLru, entry.lru);
+  }
+}
+
+void GlyphCache::removeRef(uint32_t codepoint) {
+  auto found = mEntries.find(codepoint);
+  if (found == mEntries.end() || found->second.refs == 0) {
+    return;
+  }
+  Entry &entry = found->second;
+  if (--entry.refs == 0 && entry.inAtlas) {
+    entry.lastUsed = mFrame;
+    mLru.splice(mLru.begin(), mReferenced, entry.lru);
+  }
+}
+
+float GlyphCache::kerning(uint32_t left, uint32_t right) const {
+  if (mFontData.empty()) {
+    return 0.0f;
+  }
+  return stbtt_GetCodepointKernAdvance(mFontInfo.get(), static_cast<int>(left), static_cast<int>(right)) * mScale;
+}
+
+bool GlyphCache::layout(std::string_view text, TextRun &run) {
+  mCodepoints.clear();
+  for (size_t i = 0; i < text.length();) {
+    uint32_t codepoint = decodeUtf8(text, i);
+    if (codepoint >= 0x20) {
+      mCodepoints.push_back(codepoint);
+    }
+  }
+
+  // Everything before the first changed char stays where it is, kerning
+  // only reaches back one char
+  size_t keep = 0;
+  while (keep < run.chars.size() && keep < mCodepoints.size() && run.chars[keep].codepoint == mCodepoints[keep] &&
+         run.chars[keep].referenced) {
+    keep++;
+  }
+  if (keep == run.chars.size() && keep == mCodepoints.size()) {
+    return false;
+  }
+
+  for (size_t i = keep; i < run.chars.size(); i++) {
+    if (run.chars[i].referenced) {
+      removeRef(run.chars[i].codepoint);
+    }
+  }
+  run.chars.resize(keep);
+  run.quads.resize(keep > 0 ? run.chars[keep - 1].quadEnd : 0);
+
+  float pen = keep > 0 ? run.chars[keep - 1].penAfter : 0.0f;
+  // Everything kept is referenced
+  run.missing = 0;
+  for (size_t i = keep; i < mCodepoints.size(); i++) {
+    uint32_t codepoint = mCodepoints[i];
+    if (i > 0) {
+      pen += kerning(mCodepoints[i - 1], codepoint);
+    }
+    const Glyph *glyph = get(codepoint);
+    if (glyph == nullptr) {
+      run.chars.push_back({codepoint, pen, static_cast<uint32_t>(run.quads.size()), false});
+      run.missing++;
+      continue;
+    }
+    if (glyph->x1 > glyph->x0) {
+      float x0 = pen + glyph->xoff;
+      run.quads.push_back({x0, glyph->yoff, x0 + (glyph->x1 - glyph->x0), glyph->yoff + (glyph->y1 - glyph->y0),
+                           glyph->x0, glyph->y0, glyph->x1, glyph->y1});
+    }
+    pen += glyph->xadvance;
+    addRef(codepoint);
+    run.chars.push_back({codepoint, pen, static_cast<uint32_t>(run.quads.size()), true});
+  }
+
+  run.width = pen;
+  run.ascent = 0.0f;
+  for (const TextRun::Quad &quad : run.quads) {
+    run.ascent = std::max(run.ascent, -quad.y0);
+  }
+  return true;
+}
+
+void GlyphCache::releaseRun(TextRun &run) {
+  for (const TextRun::Char &c : run.chars) {
+    if (c.referenced) {
+      removeRef(c.codepoint);
+    }
+  }
+  run.chars.clear();
+  run.quads.clear();
+  run.missing = 0;
+  run.width = 0.0f;
+  run.ascent = 0.0f;
+}
+
+bool GlyphCache::reserveSolid(uint32_t size, uint32_t &x, uint32_t &y) {
+  uint32_t shelf;
+  uint32_t slotSize = size + kGlyphGap;
+  if (!allocate(slotSize, slotSize, shelf, x)) {
+    return false;
+  }
+  y = mShelves[shelf].y;
+  // Not an entry, so nothing ever frees it
+  Upload upload{x, y, slotSize, mShelves[shelf].height, mUploadData.size()};
+  mUploadData.resize(mUploadData.size() + ((slotSize * upload.height + 3) & ~3u), 0);
+  for (uint32_t row = 0; row < size; row++) {
+    memset(&mUploadData[upload.offset + row * slotSize], 255, size);
+  }
+  mUploads.push_back(upload);
+  return true;
+}
+
+void GlyphCache::clearUploads(size_t count) {
+  if (count >= mUploads.size()) {
+    mUploads.clear();
+    mUploadData.clear();
+    return;
+  }
+  size_t dataStart = mUploads[count].offset;
+  mUploads.erase(mUploads.begin(), mUploads.begin() + count);
+  for (Upload &upload : mUploads) {
+    upload.offset -= dataStart;
+  }
+  mUploadData.erase(mUploadData.begin(), mUploadData.begin() + dataStart);
+}
+
+bool GlyphCache::allocate(uint32_t width, uint32_t height, uint32_t &shelf, uint32_t &x) {
+  // The shelf wasting the least height that still has room
+  uint32_t best = UINT32_MAX;
+  for (uint32_t i = 0; i < mShelves.size(); i++) {
+    const Shelf &candidate = mShelves[i];
+    if (candidate.height < height || candidate.height > height + height / 4 + kShelfGranularity) {
+      continue;
+    }
+    bool fits = candidate.end + width <= mAtlasWidth;
+    for (const Slot &slot : candidate.freeSlots) {
+      fits |= slot.width >= width;
+    }
+    if (fits && (best == UINT32_MAX || candidate.height < mShelves[best].height)) {
+      best = i;
+    }
+  }
+
+  if (best == UINT32_MAX) {
+    uint32_t shelfHeight = (height + kShelfGranularity - 1) / kShelfGranularity * kShelfGranularity;
+    if (mShelvesEnd + shelfHeight > mAtlasHeight || width > mAtlasWidth) {
+      return false;
+    }
+    mShelves.push_back({mShelvesEnd, shelfHeight, 0, {}});
+    mShelvesEnd += shelfHeight;
+    best = static_cast<uint32_t>(mShelves.size() - 1);
+  }
+
+  Shelf &target = mShelves[best];
+  shelf = best;
+  for (auto slot = target.freeSlots.begin(); slot != target.freeSlots.end(); ++slot) {
+    if (slot->width >= width) {
+      x = slot->x;
+      slot->x += width;
+      slot->width -= width;
+      if (slot->width == 0) {
+        target.freeSlots.erase(slot);
+      }
+      return true;
+    }
+  }
+  x = target.end;
+  target.end += width;
+  return true;
+}
+
+void GlyphCache::freeSlot(uint32_t shelf, uint32_t x, uint32_t width) {
+  // Kept sorted so neighbours can be merged into one slot
+  std::vector<Slot> &slots = mShelves[shelf].freeSlots;
+  auto next = std::lower_bound(slots.begin(), slots.end(), x, [](const Slot &slot, uint32_t value) { return slot.x < value; });
+  next = slots.insert(next, {x, width});
+  if (next + 1 != slots.end() && next->x + next->width == (next + 1)->x) {
+    next->width += (next + 1)->width;
+    slots.erase(next + 1);
+  }
+  if (next != slots.begin() && (next - 1)->x + (next - 1)->width == next->x) {
+    (next - 1)->width += next->width;
+    slots.erase(next);
+  }
+}
+
+bool GlyphCache::evictOne() {
+  if (mLru.empty()) {
+    return false;
+  }
+  uint32_t codepoint = mLru.back();
+  Entry &entry = mEntries.at(codepoint);
+  if (entry.lastUsed == mFrame) {
+    return false;
+  }
+  freeSlot(entry.shelf, entry.glyph.x0, entry.slotWidth);
+  mLru.pop_back();
+  mEntries.erase(codepoint);
+  mEvictions++;
+  return true;
+}
+} // namespace VulkanEngine
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct stbtt_fontinfo;
+
+namespace VulkanEngine {
+
+// Returns the codepoint starting at text[index] and moves index past it.
+// Malformed UTF-8 gives U+FFFD and skips a single byte
+uint32_t decodeUtf8(std::string_view text, size_t &index);
+
+// A string laid out from a pen at (0, 0) on the baseline, in pixels at the
+// size the glyph fields were rendered at, so one run serves every text size.
+// Keeps a reference on its glyphs so they stay in the atlas while it exists,
+// filled by GlyphCache::layout() and given back with GlyphCache::releaseRun()
+struct TextRun {
+  struct Quad {
+    float x0, y0, x1, y1;
+    // Rect in the atlas in pixels
+    uint16_t u0, v0, u1, v1;
+  };
+  struct Char {
+    uint32_t codepoint;
+    // Pen position after this char and number of quads up to and including it
+    float penAfter;
+    uint32_t quadEnd;
+    // False if the atlas had no room for it, retried on the next layout
+    bool referenced;
+  };
+
+  std::vector<Char> chars;
+  std::vector<Quad> quads;
+  // Chars that aren't referenced, the run should be laid out again while
+  // there are any
+  uint32_t missing = 0;
+  float width = 0.0f;
+  // Largest distance of a glyph top above the baseline
+  float ascent = 0.0f;
+};
+
+// Signed distance field glyphs of one font, rasterized the first time they
+// are asked for and packed into an atlas of shelves (rows of glyphs of about
+// the same height). When the atlas is full the least recently used glyphs
+// are evicted, never ones used since the last beginFrame().
+// Only CPU side, the changed atlas regions are collected in pendingUploads()
+// for the owner to copy into its image.
+class GlyphCache {
+public:
+  struct Glyph {
+    // Rect in the atlas in pixels, empty for glyphs with nothing to draw (e.g. space)
+    uint16_t x0, y0, x1, y1;
+    // Offset of the rect from the pen position and the pen advance, in pixels
+    // at the size the field was rendered at
+    float xoff, yoff;
+    float xadvance;
+  };
+
+  // A changed rect of the atlas, its pixels are at offset in pendingData()
+  struct Upload {
+    uint32_t x, y, width, height;
+    size_t offset;
+  };
+
+  GlyphCache();
+  ~GlyphCache();
+
+  // pixelHeight is the size the fields are rendered at, padding how many
+  // pixels they extend past the glyph outline
+  bool init(const std::string &fontPath, float pixelHeight, int padding, uint32_t atlasWidth, uint32_t atlasHeight);
+
+  // Glyphs looked up after this can't be evicted until the next call
+  void beginFrame();
+  // nullptr if the glyph doesn't fit even after evicting everything unused
+  const Glyph *get(uint32_t codepoint);
+  // Referenced glyphs are never evicted
+  void addRef(uint32_t codepoint);
+  void removeRef(uint32_t codepoint);
+  // Pen adjustment between two codepoints, in pixels
+  float kerning(uint32_t left, uint32_t right) const;
+
+  // Lays text out into run, keeping whatever run already holds for the part
+  // of text that didn't change. Control characters are skipped.
+  // Returns false if the run was already up to date
+  bool layout(std::string_view text, TextRun &run);
+  void releaseRun(TextRun &run);
+
+  // A size x size block at the full field value that is never evicted, so
+  // sampling its center draws solid shapes with the glyph pipeline. Returns
+  // false if the atlas has no room
+  bool reserveSolid(uint32_t size, uint32_t &x, uint32_t &y);
+
+  const std::vector<Upload> &pendingUploads() const { return mUploads; }
+  const std::vector<uint8_t> &pendingData() const { return mUploadData; }
+  // Drops the first count uploads once they have been copied
+  void clearUploads(size_t count);
+
+  uint32_t atlasWidth() const { return mAtlasWidth; }
+  uint32_t atlasHeight() const { return mAtlasHeight; }
+  size_t size() const { return mEntries.size(); }
+  uint64_t evictions() const { return mEvictions; }
+
+private:
+  struct Slot {
+    uint32_t x;
+    uint32_t width;
+  };
+
+  struct Shelf {
+    uint32_t y;
+    uint32_t height;
+    // Never used space starts here
+    uint32_t end;
+    // Space given back by evicted glyphs
+    std::vector<Slot> freeSlots;
+  };
+
+  struct Entry {
+    Glyph glyph;
+    // Only for glyphs in the atlas
+    uint32_t shelf;
+    uint32_t slotWidth;
+    uint64_t lastUsed;
+    // Referenced glyphs are moved from mLru to mReferenced
+    uint32_t refs;
+    std::list<uint32_t>::iterator lru;
+    bool inAtlas;
+  };
+
+  std::vector<uint8_t> mFontData;
+  std::unique_ptr<stbtt_fontinfo> mFontInfo;
+  float mScale = 1.0f;
+  int mPadding = 0;
+  uint32_t mAtlasWidth = 0;
+  uint32_t mAtlasHeight = 0;
+
+  std::vector<Shelf> mShelves;
+  // Top of the space no shelf has taken yet
+  uint32_t mShelvesEnd = 0;
+
+  std::unordered_map<uint32_t, Entry> mEntries;
+  // Codepoints of the unreferenced glyphs in the atlas, most recently used first
+  std::list<uint32_t> mLru;
+  // The others, nodes are spliced between the two lists instead of reallocated
+  std::list<uint32_t> mReferenced;
+  uint64_t mFrame = 0;
+  uint64_t mEvictions = 0;
+
+  std::vector<Upload> mUploads;
+  std::vector<uint8_t> mUploadData;
+  // Decoded text of the last layout(), kept to reuse its memory
+  std::vector<uint32_t> mCodepoints;
+
+  bool allocate(uint32_t width, uint32_t height, uint32_t &shelf, uint32_t &x);
+  void freeSlot(uint32_t shelf, uint32_t x, uint32_t width);
+  // Evicts the least recently used glyph, false if all of them are in use
+  bool evictOne();
+};
+} // namespace VulkanEngine
@@ -0,0 +1,102 @@
+#include "gpu_timer.hpp"
+
+#include <iostream>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+void GpuTimer::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t imageCount) {
+  mDevice = device;
+  mImageCount = imageCount;
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+  uint32_t validBits = queueFamilyIndex < familyCount ? families[queueFamilyIndex].timestampValidBits : 0;
+  if (validBits == 0) {
+    std::cout << "GpuTimer: no timestamps on the graphics queue\n";
+    return;
+  }
+  mValidMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  mPeriod = properties.limits.timestampPeriod;
+
+  mTimestamps.resize(mMaxScopes * 2);
+  mResults.reserve(mMaxScopes);
+  createQueryPool();
+}
+
+void GpuTimer::destroy() {
+  if (mQueryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(mDevice, mQueryPool, nullptr);
+  }
+  mQueryPool = VK_NULL_HANDLE;
+}
+
+void GpuTimer::resize(uint32_t imageCount) {
+  if (!supported() || imageCount == mImageCount) {
+    return;
+  }
+  mImageCount = imageCount;
+  destroy();
+  createQueryPool();
+}
+
+void GpuTimer::createQueryPool() {
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = mImageCount * mMaxScopes * 2;
+  VK_CHECK(vkCreateQueryPool(mDevice, &poolInfo, nullptr, &mQueryPool), "GpuTimer vkCreateQueryPool");
+  mNames.assign(mImageCount * mMaxScopes, nullptr);
+  // Nothing to read back until an image was recorded once
+  mScopeCounts.assign(mImageCount, 0);
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  if (!supported()) {
+    return;
+  }
+  uint32_t firstQuery = imageIndex * mMaxScopes * 2;
+  uint32_t count = mScopeCounts[imageIndex];
+  if (count > 0) {
+    VkResult result = vkGetQueryPoolResults(mDevice, mQueryPool, firstQuery, count * 2,
+                                            mTimestamps.size() * sizeof(uint64_t), mTimestamps.data(),
+                                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    // Keeps the last results if the queries somehow aren't done
+    if (result == VK_SUCCESS) {
+      mResults.clear();
+      for (uint32_t i = 0; i < count; i++) {
+        uint64_t ticks = (mTimestamps[i * 2 + 1] - mTimestamps[i * 2]) & mValidMask;
+        mResults.push_back({mNames[imageIndex * mMaxScopes + i], ticks * mPeriod / 1000000.0f});
+      }
+    }
+  }
+
+  vkCmdResetQueryPool(commandBuffer, mQueryPool, firstQuery, mMaxScopes * 2);
+  mScopeCounts[imageIndex] = 0;
+  mCurrentImage = imageIndex;
+}
+
+uint32_t GpuTimer::begin(VkCommandBuffer commandBuffer, const char *name) {
+  if (!supported() || mScopeCounts[mCurrentImage] == mMaxScopes) {
+    return UINT32_MAX;
+  }
+  uint32_t scope = mScopeCounts[mCurrentImage]++;
+  mNames[mCurrentImage * mMaxScopes + scope] = name;
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool,
+                      (mCurrentImage * mMaxScopes + scope) * 2);
+  return scope;
+}
+
+void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t scope) {
+  if (scope == UINT32_MAX) {
+    return;
+  }
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool,
+                      (mCurrentImage * mMaxScopes + scope) * 2 + 1);
+}
+} // namespace VulkanEngine
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace VulkanEngine {
+
+// GPU durations of named scopes of the frame from timestamp queries. Every
+// swapchain image has its own queries, they are read back when the image's
+// command buffer is recorded again, after its fence was waited on, so reading
+// never stalls. Does nothing if the graphics queue has no timestamps
+class GpuTimer {
+public:
+  struct Scope {
+    // Not copied, has to outlive the timer (e.g. a string literal)
+    const char *name;
+    float milliseconds;
+  };
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex, uint32_t imageCount);
+  void destroy();
+  // Nothing may be in flight
+  void resize(uint32_t imageCount);
+
+  // Reads back what the last submission of imageIndex measured and resets
+  // its queries, outside of rendering
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  // Scopes past mMaxScopes are ignored
+  uint32_t begin(VkCommandBuffer commandBuffer, const char *name);
+  void end(VkCommandBuffer commandBuffer, uint32_t scope);
+
+  // Scopes of the latest frame the GPU finished, in the order they were begun
+  const std::vector<Scope> &results() const { return mResults; }
+  bool supported() const { return mQueryPool != VK_NULL_HANDLE; }
+
+  static constexpr uint32_t mMaxScopes = 16;
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkQueryPool mQueryPool = VK_NULL_HANDLE;
+  // Nanoseconds per tick and the bits a timestamp has
+  float mPeriod = 1.0f;
+  uint64_t mValidMask = ~0ull;
+  uint32_t mImageCount = 0;
+
+  // Per image, the names of the scopes begun in its last recording
+  std::vector<const char *> mNames;
+  std::vector<uint32_t> mScopeCounts;
+  uint32_t mCurrentImage = 0;
+  std::vector<uint64_t> mTimestamps;
+  std::vector<Scope> mResults;
+
+  void createQueryPool();
+};
+} // namespace VulkanEngine
@@ -0,0 +1,308 @@
+#include "ktx2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace KTX2 {
+
+namespace {
+
+const uint8_t kIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Identifier + header + index, the level index follows right after
+const size_t kHeaderSize = 80;
+const size_t kLevelIndexEntrySize = 24;
+
+// Data format descriptor values used by the formats we write, see the
+// Khronos Data Format Specification
+const uint32_t kColorModelBC1A = 128;
+const uint32_t kColorModelBC3 = 130;
+const uint32_t kColorModelBC5 = 132;
+const uint32_t kColorModelBC7 = 134;
+const uint32_t kPrimariesBT709 = 1;
+const uint32_t kTransferLinear = 1;
+const uint32_t kTransferSRGB = 2;
+const uint32_t kChannelColor = 0;
+const uint32_t kChannelGreen = 1;
+const uint32_t kChannelAlpha = 15;
+const uint32_t kChannelQualifierLinear = 0x80;
+
+template <typename T>
+void append(std::vector<uint8_t> &out, T value) {
+  size_t offset = out.size();
+  out.resize(offset + sizeof(T));
+  memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+T readAt(const uint8_t *data, size_t offset) {
+  T value;
+  memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+void padTo(std::vector<uint8_t> &out, size_t alignment) {
+  out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+struct Sample {
+  uint32_t channel;
+  uint32_t bitOffset;
+  uint32_t bitLength;
+};
+
+std::vector<uint8_t> buildDataFormatDescriptor(TextureCompression::Format compression, bool srgb) {
+  uint32_t colorModel = kColorModelBC7;
+  Sample samples[2] = {};
+  uint32_t sampleCount = 1;
+  switch (compression) {
+  case TextureCompression::Format::BC1:
+    colorModel = kColorModelBC1A;
+    samples[0] = {kChannelColor, 0, 64};
+    samples[1] = {kChannelAlpha, 0, 64};
+    sampleCount = 2;
+    break;
+  case TextureCompression::Format::BC3:
+    colorModel = kColorModelBC3;
+    samples[0] = {kChannelAlpha, 0, 64};
+    samples[1] = {kChannelColor, 64, 64};
+    sampleCount = 2;
+    break;
+  case TextureCompression::Format::BC5:
+    colorModel = kColorModelBC5;
+    samples[0] = {kChannelColor, 0, 64};
+    samples[1] = {kChannelGreen, 64, 64};
+    sampleCount = 2;
+    break;
+  case TextureCompression::Format::BC7:
+    colorModel = kColorModelBC7;
+    samples[0] = {kChannelColor, 0, 128};
+    break;
+  }
+
+  uint32_t blockSize = 24 + 16 * sampleCount;
+
+  std::vector<uint8_t> dfd;
+  append<uint32_t>(dfd, 4 + blockSize);
+  // Khronos vendor, basic descriptor type
+  append<uint32_t>(dfd, 0);
+  // Version 2 of the descriptor block
+  append<uint32_t>(dfd, 2 | (blockSize << 16));
+  append<uint32_t>(dfd, colorModel | (kPrimariesBT709 << 8) | ((srgb ? kTransferSRGB : kTransferLinear) << 16));
+  // 4x4 texel blocks, stored as dimension - 1
+  append<uint32_t>(dfd, 3 | (3 << 8));
+  append<uint32_t>(dfd, TextureCompression::blockBytes(compression));
+  append<uint32_t>(dfd, 0);
+
+  for (uint32_t i = 0; i < sampleCount; i++) {
+    const Sample &sample = samples[i];
+    uint32_t channelType = sample.channel;
+    // Alpha is never sRGB encoded
+    if (srgb && sample.channel == kChannelAlpha) {
+      channelType |= kChannelQualifierLinear;
+    }
+    append<uint32_t>(dfd, sample.bitOffset | ((sample.bitLength - 1) << 16) | (channelType << 24));
+    append<uint32_t>(dfd, 0);
+    append<uint32_t>(dfd, 0);
+    append<uint32_t>(dfd, 0xFFFFFFFF);
+  }
+  return dfd;
+}
+
+} // namespace
+
+bool write(const std::string &path, VkFormat format, uint32_t width, uint32_t height,
+           const std::vector<std::vector<uint8_t>> &levels) {
+  TextureCompression::Format compression;
+  if (levels.empty() || !toCompressionFormat(format, compression)) {
+    return false;
+  }
+  size_t alignment = TextureCompression::blockBytes(compression);
+  uint32_t levelCount = static_cast<uint32_t>(levels.size());
+
+  std::vector<uint8_t> dfd = buildDataFormatDescriptor(compression, isSRGB(format));
+
+  std::vector<uint8_t> kvd;
+  const char writerKey[] = "KTXwriter";
+  const char writerValue[] = "VKDynamicRendering texture_cooker";
+  append<uint32_t>(kvd, sizeof(writerKey) + sizeof(writerValue));
+  kvd.insert(kvd.end(), writerKey, writerKey + sizeof(writerKey));
+  kvd.insert(kvd.end(), writerValue, writerValue + sizeof(writerValue));
+  padTo(kvd, 4);
+
+  size_t dfdOffset = kHeaderSize + kLevelIndexEntrySize * levelCount;
+  size_t kvdOffset = dfdOffset + dfd.size();
+
+  // The level data goes after the metadata, smallest level first
+  std::vector<uint64_t> levelOffsets(levelCount);
+  size_t dataOffset = kvdOffset + kvd.size();
+  for (uint32_t i = levelCount; i-- > 0;) {
+    dataOffset = (dataOffset + alignment - 1) / alignment * alignment;
+    levelOffsets[i] = dataOffset;
+    dataOffset += levels[i].size();
+  }
+
+  std::vector<uint8_t> file(kIdentifier, kIdentifier + sizeof(kIdentifier));
+  append<uint32_t>(file, static_cast<uint32_t>(format));
+  // typeSize is 1 for block compressed formats
+  append<uint32_t>(file, 1);
+  append<uint32_t>(file, width);
+  append<uint32_t>(file, height);
+  // pixelDepth, layerCount, faceCount
+  append<uint32_t>(file, 0);
+  append<uint32_t>(file, 0);
+  append<uint32_t>(file, 1);
+  append<uint32_t>(file, levelCount);
+  // No supercompression
+  append<uint32_t>(file, 0);
+
+  append<uint32_t>(file, static_cast<uint32_t>(dfdOffset));
+  append<uint32_t>(file, static_cast<uint32_t>(dfd.size()));
+  append<uint32_t>(file, static_cast<uint32_t>(kvdOffset));
+  append<uint32_t>(file, static_cast<uint32_t>(kvd.size()));
+  // No supercompression global data
+  append<uint64_t>(file, 0);
+  append<uint64_t>(file, 0);
+
+  for (uint32_t i = 0; i < levelCount; i++) {
+    append<uint64_t>(file, levelOffsets[i]);
+    append<uint64_t>(file, levels[i].size());
+    append<uint64_t>(file, levels[i].size());
+  }
+
+  file.insert(file.end(), dfd.begin(), dfd.end());
+  file.insert(file.end(), kvd.begin(), kvd.end());
+  for (uint32_t i = levelCount; i-- > 0;) {
+    file.resize(levelOffsets[i], 0);
+    file.insert(file.end(), levels[i].begin(), levels[i].end());
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()));
+  return static_cast<bool>(out);
+}
+
+bool parse(const uint8_t *data, size_t size, Texture &texture, std::string &error) {
+  if (size < kHeaderSize || memcmp(data, kIdentifier, sizeof(kIdentifier)) != 0) {
+    error = "not a KTX2 file";
+    return false;
+  }
+
+  uint32_t format = readAt<uint32_t>(data, 12);
+  uint32_t width = readAt<uint32_t>(data, 20);
+  uint32_t height = readAt<uint32_t>(data, 24);
+  uint32_t depth = readAt<uint32_t>(data, 28);
+  uint32_t layerCount = readAt<uint32_t>(data, 32);
+  uint32_t faceCount = readAt<uint32_t>(data, 36);
+  uint32_t levelCount = readAt<uint32_t>(data, 40);
+  uint32_t supercompression = readAt<uint32_t>(data, 44);
+
+  if (format == VK_FORMAT_UNDEFINED) {
+    error = "Basis Universal textures are not supported";
+    return false;
+  }
+  // Only the formats we can decode when the device can't sample them
+  TextureCompression::Format compression;
+  if (!toCompressionFormat(static_cast<VkFormat>(format), compression)) {
+    error = "unsupported format " + std::to_string(format);
+    return false;
+  }
+  if (width == 0 || height == 0 || depth != 0 || layerCount > 1 || faceCount != 1) {
+    error = "only single layer 2D textures are supported";
+    return false;
+  }
+  if (supercompression != 0) {
+    error = "supercompressed textures are not supported";
+    return false;
+  }
+
+  // 0 asks the loader to generate the mips, we only use the base level then
+  levelCount = std::max(1u, levelCount);
+  if (size < kHeaderSize + kLevelIndexEntrySize * levelCount) {
+    error = "truncated level index";
+    return false;
+  }
+
+  texture.format = static_cast<VkFormat>(format);
+  texture.width = width;
+  texture.height = height;
+  texture.levels.resize(levelCount);
+  for (uint32_t i = 0; i < levelCount; i++) {
+    size_t entry = kHeaderSize + kLevelIndexEntrySize * i;
+    Level &level = texture.levels[i];
+    level.offset = readAt<uint64_t>(data, entry);
+    level.size = readAt<uint64_t>(data, entry + 8);
+    level.width = std::max(1u, width >> i);
+    level.height = std::max(1u, height >> i);
+
+    if (level.offset > size || level.size > size - level.offset) {
+      error = "level " + std::to_string(i) + " is outside of the file";
+      return false;
+    }
+    // The upload and the CPU decoder read whole blocks for the level size
+    if (level.size < TextureCompression::compressedSize(compression, level.width, level.height)) {
+      error = "level " + std::to_string(i) + " is too small for " + std::to_string(level.width) + "x" +
+              std::to_string(level.height);
+      return false;
+    }
+  }
+  return true;
+}
+
+VkFormat toVkFormat(TextureCompression::Format format, bool srgb) {
+  switch (format) {
+  case TextureCompression::Format::BC1:
+    return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+  case TextureCompression::Format::BC3:
+    return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+  case TextureCompression::Format::BC5:
+    // Two channel data is never colour
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case TextureCompression::Format::BC7:
+    return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+bool toCompressionFormat(VkFormat format, TextureCompression::Format &compression) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    compression = TextureCompression::Format::BC1;
+    return true;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    compression = TextureCompression::Format::BC3;
+    return true;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    compression = TextureCompression::Format::BC5;
+    return true;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    compression = TextureCompression::Format::BC7;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool isSRGB(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace KTX2
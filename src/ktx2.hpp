@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include <texture_compression.hpp>
+
+// Minimal KTX2 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html)
+// support for 2D, single layer, non supercompressed textures. That is all the
+// texture cooker writes and all the renderer loads.
+namespace KTX2 {
+
+struct Level {
+  // Byte range of the level inside the file
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct Texture {
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  // Level 0 is the full resolution image
+  std::vector<Level> levels;
+};
+
+// levels[0] is the full resolution image, each following level half the
+// size of the previous one
+bool write(const std::string &path, VkFormat format, uint32_t width, uint32_t height,
+           const std::vector<std::vector<uint8_t>> &levels);
+
+// Reads the header and level index of a file that is already in memory,
+// usually through MappedFile. Fills error and returns false if the file is
+// not something we can upload: a format toCompressionFormat doesn't know or
+// a level smaller than its blocks.
+bool parse(const uint8_t *data, size_t size, Texture &texture, std::string &error);
+
+// Mapping between the Vulkan formats and the CPU encoders/decoders
+VkFormat toVkFormat(TextureCompression::Format format, bool srgb);
+bool toCompressionFormat(VkFormat format, TextureCompression::Format &compression);
+bool isSRGB(VkFormat format);
+
+} // namespace KTX2
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read only memory mapping of a whole file, so large assets can be copied
+// straight into staging memory without going through a read buffer.
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Returns false if the file can't be opened or is empty
+  bool open(const std::string &path);
+  void close();
+
+  const uint8_t *data() const { return mData; }
+  size_t size() const { return mSize; }
+
+private:
+  const uint8_t *mData = nullptr;
+  size_t mSize = 0;
+
+#ifdef _WIN32
+  void *mFileHandle = nullptr;
+  void *mMappingHandle = nullptr;
+#endif
+};
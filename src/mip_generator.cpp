@@ -0,0 +1,127 @@
+#include "mip_generator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define MIP_GENERATOR_NEON
+#include <arm_neon.h>
+#endif
+
+namespace MipGenerator {
+
+// Rounded average, matches what _mm_avg_epu8 and vrhaddq_u8 do per byte
+static inline uint8_t average(uint32_t a, uint32_t b) {
+  return static_cast<uint8_t>((a + b + 1) >> 1);
+}
+
+// Output pixels from x on of one row, clamped for the 1 pixel wide case
+static void downsampleRowScalar(const uint8_t *row0, const uint8_t *row1, uint32_t width, uint32_t x,
+                                uint32_t dstWidth, uint8_t *out) {
+  for (; x < dstWidth; x++) {
+    uint32_t x0 = 2 * x;
+    uint32_t x1 = std::min(2 * x + 1, width - 1);
+    for (uint32_t c = 0; c < 4; c++) {
+      uint8_t even = average(row0[x0 * 4 + c], row1[x0 * 4 + c]);
+      uint8_t odd = average(row0[x1 * 4 + c], row1[x1 * 4 + c]);
+      out[x * 4 + c] = average(even, odd);
+    }
+  }
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  uint32_t size = std::max(width, height);
+  while (size > 1) {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+void downsampleBox(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst) {
+  uint32_t dstWidth = std::max(1u, width / 2);
+  uint32_t dstHeight = std::max(1u, height / 2);
+
+  for (uint32_t y = 0; y < dstHeight; y++) {
+    // Clamp for the 1 pixel high case
+    const uint8_t *row0 = src + static_cast<size_t>(2 * y) * width * 4;
+    const uint8_t *row1 = src + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4;
+    uint8_t *out = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+    uint32_t x = 0;
+    // 4 output pixels at a time, the rows are averaged first and then the
+    // even and odd pixels of the result, the scalar tail below does the same
+    // so both paths give identical output
+#if defined(MIP_GENERATOR_SSE2)
+    for (; x + 4 <= dstWidth; x += 4) {
+      __m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8));
+      __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 8 + 16));
+      __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8));
+      __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 8 + 16));
+
+      __m128 vertical0 = _mm_castsi128_ps(_mm_avg_epu8(top0, bottom0));
+      __m128 vertical1 = _mm_castsi128_ps(_mm_avg_epu8(top1, bottom1));
+
+      // Split the pixels into even and odd columns
+      __m128i even = _mm_castps_si128(_mm_shuffle_ps(vertical0, vertical1, _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i odd = _mm_castps_si128(_mm_shuffle_ps(vertical0, vertical1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x * 4), _mm_avg_epu8(even, odd));
+    }
+#elif defined(MIP_GENERATOR_NEON)
+    for (; x + 4 <= dstWidth; x += 4) {
+      // vld2 splits the pixels into even and odd columns while loading
+      uint32x4x2_t top = vld2q_u32(reinterpret_cast<const uint32_t *>(row0 + x * 8));
+      uint32x4x2_t bottom = vld2q_u32(reinterpret_cast<const uint32_t *>(row1 + x * 8));
+
+      uint8x16_t even = vrhaddq_u8(vreinterpretq_u8_u32(top.val[0]), vreinterpretq_u8_u32(bottom.val[0]));
+      uint8x16_t odd = vrhaddq_u8(vreinterpretq_u8_u32(top.val[1]), vreinterpretq_u8_u32(bottom.val[1]));
+
+      vst1q_u8(out + x * 4, vrhaddq_u8(even, odd));
+    }
+#endif
+    downsampleRowScalar(row0, row1, width, x, dstWidth, out);
+  }
+}
+
+void downsampleBoxScalar(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst) {
+  uint32_t dstWidth = std::max(1u, width / 2);
+  uint32_t dstHeight = std::max(1u, height / 2);
+  for (uint32_t y = 0; y < dstHeight; y++) {
+    const uint8_t *row0 = src + static_cast<size_t>(2 * y) * width * 4;
+    const uint8_t *row1 = src + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4;
+    downsampleRowScalar(row0, row1, width, 0, dstWidth, dst + static_cast<size_t>(y) * dstWidth * 4);
+  }
+}
+
+std::vector<MipLevel> generateMipChain(const uint8_t *pixels, uint32_t width, uint32_t height,
+                                       std::vector<uint8_t> &chain) {
+  std::vector<MipLevel> levels(mipLevelCount(width, height));
+
+  size_t offset = 0;
+  for (size_t i = 0; i < levels.size(); i++) {
+    levels[i].width = std::max(1u, width >> i);
+    levels[i].height = std::max(1u, height >> i);
+    levels[i].offset = offset;
+    levels[i].size = static_cast<size_t>(levels[i].width) * levels[i].height * 4;
+    offset += levels[i].size;
+  }
+
+  chain.resize(offset);
+  memcpy(chain.data(), pixels, levels[0].size);
+
+  for (size_t i = 1; i < levels.size(); i++) {
+    downsampleBox(chain.data() + levels[i - 1].offset,
+                  levels[i - 1].width,
+                  levels[i - 1].height,
+                  chain.data() + levels[i].offset);
+  }
+
+  return levels;
+}
+
+} // namespace MipGenerator
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU side mip chain generation for RGBA8 images.
+// Used when the device can't blit/linear filter the texture format, it has no
+// Vulkan dependencies so it can be built and timed on its own.
+namespace MipGenerator {
+
+struct MipLevel {
+  uint32_t width;
+  uint32_t height;
+  // Byte offset of the level inside the chain buffer
+  size_t offset;
+  size_t size;
+};
+
+// Number of levels in a full chain, down to 1x1
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// Downsample one RGBA8 level with a 2x2 box filter.
+// dst has to hold max(1, width / 2) * max(1, height / 2) pixels
+void downsampleBox(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst);
+// Same output without SSE2/NEON, the reference the SIMD paths are tested against
+void downsampleBoxScalar(const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst);
+
+// Fills chain with every level of the image, level 0 being a copy of pixels,
+// and returns where each level lives inside chain.
+// The filtering is done on the stored values, so for sRGB data this is a bit
+// darker than the linear space filtering vkCmdBlitImage does.
+std::vector<MipLevel> generateMipChain(const uint8_t *pixels, uint32_t width, uint32_t height,
+                                       std::vector<uint8_t> &chain);
+
+} // namespace MipGenerator
@@ -0,0 +1,167 @@
+#include "perf_hud.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace VulkanEngine {
+
+namespace {
+// Layout in pixels, below the FPS and camera lines
+const float kTop = 60.0f;
+const float kLineHeight = 22.0f;
+const float kTextScale = 0.7f;
+// A bar per frame, kGraphHeight is kGraphMaxMs
+const float kBarWidth = 2.0f;
+const float kBarStride = 3.0f;
+const float kGraphHeight = 60.0f;
+const float kGraphMaxMs = 33.3f;
+const float kTargetMs = 1000.0f / 60.0f;
+} // namespace
+
+void PerfHud::init(TextOverlay *overlay, VkPhysicalDevice physicalDevice, bool memoryBudget) {
+  mOverlay = overlay;
+  mPhysicalDevice = physicalDevice;
+  mMemoryBudget = memoryBudget;
+}
+
+void PerfHud::setVisible(bool visible) {
+  if (visible == mVisible) {
+    return;
+  }
+  mVisible = visible;
+  if (!visible) {
+    for (TextOverlay::TextHandle line : mLines) {
+      mOverlay->destroyText(line);
+    }
+    mLines.clear();
+    return;
+  }
+
+  uint32_t lineCount = 4 + (mMemoryBudget ? mMaxHeapLines : 1);
+  for (uint32_t i = 0; i < lineCount; i++) {
+    mLines.push_back(mOverlay->createText(0.0f, kTop + i * kLineHeight, TextOverlay::alignLeft, kTextScale));
+  }
+  // Starts over so the first numbers aren't averaged with old ones
+  mSinceRefresh = 0.0f;
+  mFrames = 0;
+  refresh();
+}
+
+void PerfHud::update(float frameMs, const Utils::FrameStats &stats, const std::vector<GpuTimer::Scope> &gpuScopes) {
+  if (!mVisible) {
+    return;
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+
+  mFrameTimes[mNextSample] = frameMs;
+  mNextSample = (mNextSample + 1) % mGraphSamples;
+
+  mFrameMin = mFrames == 0 ? frameMs : std::min(mFrameMin, frameMs);
+  mFrameMax = mFrames == 0 ? frameMs : std::max(mFrameMax, frameMs);
+  mSums.waitMs += stats.waitMs;
+  mSums.updateMs += stats.updateMs;
+  mSums.recordMs += stats.recordMs;
+  mSums.submitMs += stats.submitMs;
+  mSums.draws += stats.draws;
+  mSums.triangles += stats.triangles;
+  mSums.descriptorBinds += stats.descriptorBinds;
+  mSums.pipelineBinds += stats.pipelineBinds;
+  // The scopes only change when the recording does, then the sums start over
+  bool sameScopes = gpuScopes.size() == mGpuScopes;
+  for (uint32_t i = 0; sameScopes && i < mGpuScopes; i++) {
+    sameScopes = gpuScopes[i].name == mGpuNames[i];
+  }
+  if (!sameScopes) {
+    mGpuScopes = static_cast<uint32_t>(std::min<size_t>(gpuScopes.size(), GpuTimer::mMaxScopes));
+    for (uint32_t i = 0; i < mGpuScopes; i++) {
+      mGpuNames[i] = gpuScopes[i].name;
+      mGpuSums[i] = 0.0f;
+    }
+  }
+  for (uint32_t i = 0; i < mGpuScopes; i++) {
+    mGpuSums[i] += gpuScopes[i].milliseconds;
+  }
+  mFrames++;
+  mSinceRefresh += frameMs;
+  if (mSinceRefresh >= mRefreshMs) {
+    refresh();
+  }
+
+  drawGraph(kTop + mLines.size() * kLineHeight + 4.0f);
+
+  // Shown with the next refresh
+  auto end = std::chrono::high_resolution_clock::now();
+  mHudMs += (float)std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void PerfHud::refresh() {
+  float frames = static_cast<float>(std::max(mFrames, 1u));
+
+  mLine.clear().append("CPU frame ").append(mSinceRefresh / frames).append(" ms (")
+       .append(frames * 1000.0f / std::max(mSinceRefresh, 0.001f), 1).append(" fps) min ")
+       .append(mFrameMin).append(" max ").append(mFrameMax);
+  mOverlay->setText(mLines[0], mLine.view());
+
+  mLine.clear().append("CPU wait ").append(mSums.waitMs / frames).append(" update ").append(mSums.updateMs / frames)
+       .append(" record ").append(mSums.recordMs / frames).append(" submit ").append(mSums.submitMs / frames)
+       .append(" hud ").append(mHudMs / frames, 3);
+  mOverlay->setText(mLines[1], mLine.view());
+
+  mLine.clear().append("GPU");
+  if (mGpuScopes == 0) {
+    mLine.append(" timestamps unavailable");
+  }
+  for (uint32_t i = 0; i < mGpuScopes; i++) {
+    mLine.append(" ").append(mGpuNames[i]).append(" ").append(mGpuSums[i] / frames, 3);
+    mGpuSums[i] = 0.0f;
+  }
+  mOverlay->setText(mLines[2], mLine.view());
+
+  mLine.clear().append("Draws ").append(static_cast<int64_t>(mSums.draws / frames))
+       .append(" tris ").append(static_cast<int64_t>(mSums.triangles / frames))
+       .append(" descriptor binds ").append(static_cast<int64_t>(mSums.descriptorBinds / frames))
+       .append(" pipeline binds ").append(static_cast<int64_t>(mSums.pipelineBinds / frames));
+  mOverlay->setText(mLines[3], mLine.view());
+
+  if (!mMemoryBudget) {
+    mOverlay->setText(mLines[4], "Memory budget unavailable");
+  } else {
+    // Changes with what the whole system allocates, so it's asked every refresh
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(mPhysicalDevice, &properties);
+    const VkPhysicalDeviceMemoryProperties &memory = properties.memoryProperties;
+    for (uint32_t i = 0; i < mMaxHeapLines; i++) {
+      mLine.clear();
+      if (i < memory.memoryHeapCount) {
+        bool deviceLocal = memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        mLine.append("Heap ").append(static_cast<int64_t>(i)).append(deviceLocal ? " device " : " host ")
+             .append(static_cast<int64_t>(budget.heapUsage[i] >> 20)).append(" / ")
+             .append(static_cast<int64_t>(budget.heapBudget[i] >> 20)).append(" MB");
+      }
+      mOverlay->setText(mLines[4 + i], mLine.view());
+    }
+  }
+
+  mSinceRefresh = 0.0f;
+  mFrames = 0;
+  mSums = Utils::FrameStats{};
+  mHudMs = 0.0f;
+}
+
+void PerfHud::drawGraph(float top) {
+  float bottom = top + kGraphHeight;
+  for (uint32_t i = 0; i < mGraphSamples; i++) {
+    float ms = mFrameTimes[(mNextSample + i) % mGraphSamples];
+    float height = std::min(ms / kGraphMaxMs, 1.0f) * kGraphHeight;
+    float x = i * kBarStride;
+    mOverlay->addRect(x, bottom - height, x + kBarWidth, bottom);
+  }
+  // 60 fps mark
+  float target = bottom - kTargetMs / kGraphMaxMs * kGraphHeight;
+  mOverlay->addRect(0.0f, target, mGraphSamples * kBarStride, target + 1.0f);
+}
+} // namespace VulkanEngine
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <gpu_timer.hpp>
+#include <text_overlay.hpp>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// Frame time graph and frame stats drawn with the text overlay: CPU phases,
+// GPU scopes, draw counts and the memory heap budgets. The numbers are
+// averaged and laid out again a few times per second so they stay readable
+// and cheap, the graph is a batch of rects in the text's draw every frame
+class PerfHud {
+public:
+  // memoryBudget if VK_EXT_memory_budget is enabled
+  void init(TextOverlay *overlay, VkPhysicalDevice physicalDevice, bool memoryBudget);
+  void setVisible(bool visible);
+  bool visible() const { return mVisible; }
+
+  // After the overlay's beginTextUpdate() and before the renderer's
+  // prepareFrame(), frameMs is the CPU time since the last frame
+  void update(float frameMs, const Utils::FrameStats &stats, const std::vector<GpuTimer::Scope> &gpuScopes);
+
+  static constexpr uint32_t mGraphSamples = 120;
+  static constexpr uint32_t mMaxHeapLines = 3;
+
+private:
+  TextOverlay *mOverlay = nullptr;
+  VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+  bool mMemoryBudget = false;
+  bool mVisible = false;
+
+  // Frame times in ms, mNextSample is the oldest
+  float mFrameTimes[mGraphSamples] = {};
+  uint32_t mNextSample = 0;
+
+  // Summed up since the last refresh
+  const float mRefreshMs = 250.0f;
+  float mSinceRefresh = 0.0f;
+  uint32_t mFrames = 0;
+  float mFrameMin = 0.0f;
+  float mFrameMax = 0.0f;
+  Utils::FrameStats mSums;
+  float mHudMs = 0.0f;
+  const char *mGpuNames[GpuTimer::mMaxScopes] = {};
+  float mGpuSums[GpuTimer::mMaxScopes] = {};
+  uint32_t mGpuScopes = 0;
+
+  // Frame, CPU phases, GPU scopes, counters and a line per memory heap
+  std::vector<TextOverlay::TextHandle> mLines;
+  TextBuffer<128> mLine;
+
+  void refresh();
+  void drawGraph(float top);
+};
+} // namespace VulkanEngine
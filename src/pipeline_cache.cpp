@@ -0,0 +1,86 @@
+#include "pipeline_cache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace VulkanEngine {
+
+bool PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path) {
+  mDevice = device;
+  mPath = path;
+  vkGetPhysicalDeviceProperties(physicalDevice, &mProperties);
+
+  std::vector<char> data;
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (file.is_open()) {
+    data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file) {
+      data.clear();
+    }
+  }
+
+  mWarm = !data.empty() && isValid(data);
+  if (!data.empty() && !mWarm) {
+    std::cout << "Pipeline cache " << path << " is from another device or driver, starting empty\n";
+  }
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  if (mWarm) {
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.data();
+  }
+  VK_CHECK(vkCreatePipelineCache(device, &createInfo, nullptr, &mCache), "vkCreatePipelineCache");
+  return mWarm;
+}
+
+bool PipelineCache::isValid(const std::vector<char> &data) const {
+  if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+    return false;
+  }
+  VkPipelineCacheHeaderVersionOne header;
+  memcpy(&header, data.data(), sizeof(header));
+
+  return header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == mProperties.vendorID &&
+         header.deviceID == mProperties.deviceID &&
+         memcmp(header.pipelineCacheUUID, mProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() {
+  if (mCache == VK_NULL_HANDLE) {
+    return;
+  }
+  size_t size = 0;
+  VK_CHECK(vkGetPipelineCacheData(mDevice, mCache, &size, nullptr), "vkGetPipelineCacheData");
+  std::vector<char> data(size);
+  VK_CHECK(vkGetPipelineCacheData(mDevice, mCache, &size, data.data()), "vkGetPipelineCacheData");
+
+  // Written next to the real file first so a crash never leaves half a cache
+  std::string tempPath = mPath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    if (!file) {
+      std::cout << "Failed to write pipeline cache " << tempPath << "\n";
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, mPath, error);
+  if (error) {
+    std::cout << "Failed to save pipeline cache " << mPath << ": " << error.message() << "\n";
+  }
+}
+
+void PipelineCache::destroy() {
+  if (mCache != VK_NULL_HANDLE) {
+    vkDestroyPipelineCache(mDevice, mCache, nullptr);
+  }
+  mCache = VK_NULL_HANDLE;
+}
+} // namespace VulkanEngine
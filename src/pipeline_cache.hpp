@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// One VkPipelineCache shared by every pipeline, kept on disk between runs.
+// The file is only used if its header matches the device we run on (vendor,
+// device and pipelineCacheUUID, which changes with the driver), otherwise the
+// cache starts out empty and the file is overwritten on save().
+class PipelineCache {
+public:
+  // Returns true if the cache was filled from the file (a warm start)
+  bool init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path);
+  // Writes the cache back to the file
+  void save();
+  void destroy();
+
+  VkPipelineCache getCache() const { return mCache; }
+  bool isWarm() const { return mWarm; }
+
+private:
+  VkPhysicalDeviceProperties mProperties{};
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkPipelineCache mCache = VK_NULL_HANDLE;
+  std::string mPath;
+  bool mWarm = false;
+
+  bool isValid(const std::vector<char> &data) const;
+};
+} // namespace VulkanEngine
@@ -0,0 +1,312 @@
+#include "pipeline_manager.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include <trace.hpp>
+#include <vulkan_helper.hpp>
+
+namespace VulkanEngine {
+
+//===================================================
+// RenderStateKey
+
+bool RenderStateKey::operator==(const RenderStateKey &other) const {
+  return memcmp(this, &other, sizeof(RenderStateKey)) == 0;
+}
+
+size_t RenderStateKeyHash::operator()(const RenderStateKey &key) const {
+  // FNV-1a over the raw bytes, the key has no padding
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&key);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(RenderStateKey); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return static_cast<size_t>(hash);
+}
+
+//===================================================
+// PipelineManager
+
+PipelineManager::PipelineManager() {}
+
+PipelineManager::~PipelineManager() {
+  destroy();
+}
+
+void PipelineManager::init(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+                           VkPipelineCreateFlags flags, uint32_t workerCount) {
+  mDevice = device;
+  mPipelineCache = pipelineCache;
+  mLayout = layout;
+  mFlags = flags;
+
+  mRunning = true;
+  for (uint32_t i = 0; i < std::max(workerCount, 1u); i++) {
+    mWorkers.emplace_back(&PipelineManager::workerLoop, this);
+  }
+}
+
+void PipelineManager::destroy() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mRunning) {
+      return;
+    }
+    mRunning = false;
+    mQueue.clear();
+  }
+  mCondition.notify_all();
+  for (std::thread &worker : mWorkers) {
+    worker.join();
+  }
+  mWorkers.clear();
+
+  for (auto &pipeline : mPipelines) {
+    vkDestroyPipeline(mDevice, pipeline.second.pipeline, nullptr);
+  }
+  mPipelines.clear();
+  for (const ShaderProgram &program : mShaderPrograms) {
+    vkDestroyShaderModule(mDevice, program.vertModule, nullptr);
+    vkDestroyShaderModule(mDevice, program.fragModule, nullptr);
+  }
+  mShaderPrograms.clear();
+  mVertexLayouts.clear();
+}
+
+uint32_t PipelineManager::addShaderProgram(const std::vector<char> &vertCode, const std::vector<char> &fragCode) {
+  ShaderProgram program;
+  program.vertModule = VulkanHelper::createShaderModule(mDevice, vertCode);
+  program.fragModule = VulkanHelper::createShaderModule(mDevice, fragCode);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mShaderPrograms.push_back(program);
+  return static_cast<uint32_t>(mShaderPrograms.size() - 1);
+}
+
+void PipelineManager::reloadShaderProgram(uint32_t program, const std::vector<char> &vertCode,
+                                          const std::vector<char> &fragCode) {
+  ShaderProgram newProgram;
+  newProgram.vertModule = VulkanHelper::createShaderModule(mDevice, vertCode);
+  newProgram.fragModule = VulkanHelper::createShaderModule(mDevice, fragCode);
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(),
+                              [&](const RenderStateKey &key) { return key.shaderProgram == program; }),
+               mQueue.end());
+  // A worker could be building from the old modules right now
+  mCondition.wait(lock, [this] { return mCompiling == 0; });
+
+  for (auto it = mPipelines.begin(); it != mPipelines.end();) {
+    if (it->first.shaderProgram == program) {
+      vkDestroyPipeline(mDevice, it->second.pipeline, nullptr);
+      it = mPipelines.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  vkDestroyShaderModule(mDevice, mShaderPrograms[program].vertModule, nullptr);
+  vkDestroyShaderModule(mDevice, mShaderPrograms[program].fragModule, nullptr);
+  mShaderPrograms[program] = newProgram;
+}
+
+uint32_t PipelineManager::addVertexLayout(const VkVertexInputBindingDescription &binding,
+                                          const std::vector<VkVertexInputAttributeDescription> &attributes) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mVertexLayouts.push_back({binding, attributes});
+  return static_cast<uint32_t>(mVertexLayouts.size() - 1);
+}
+
+VkPipeline PipelineManager::getPipelineNow(const RenderStateKey &key) {
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mPipelines.find(key);
+    if (it != mPipelines.end()) {
+      auto queued = std::find(mQueue.begin(), mQueue.end(), key);
+      if (queued == mQueue.end()) {
+        // Ready, or a worker is on it already
+        mCondition.wait(lock, [&] { return mPipelines[key].ready; });
+        return mPipelines[key].pipeline;
+      }
+      // Not started yet, take it off the queue and build it here
+      mQueue.erase(queued);
+    } else {
+      mPipelines[key] = Entry{};
+    }
+  }
+
+  VkPipeline pipeline = compile(key);
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPipelines[key] = {pipeline, true};
+  }
+  mCondition.notify_all();
+  return pipeline;
+}
+
+VkPipeline PipelineManager::getPipeline(const RenderStateKey &key, VkPipeline fallback) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mPipelines.find(key);
+    if (it != mPipelines.end()) {
+      return it->second.ready ? it->second.pipeline : fallback;
+    }
+    mPipelines[key] = Entry{};
+    mQueue.push_back(key);
+  }
+  mCondition.notify_all();
+  return fallback;
+}
+
+size_t PipelineManager::pipelineCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPipelines.size();
+}
+
+size_t PipelineManager::pendingCount() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t pending = 0;
+  for (const auto &pipeline : mPipelines) {
+    if (!pipeline.second.ready) {
+      pending++;
+    }
+  }
+  return pending;
+}
+
+void PipelineManager::workerLoop() {
+  Trace::setThreadName("PipelineManager worker");
+  while (true) {
+    RenderStateKey key;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this] { return !mRunning || !mQueue.empty(); });
+      if (!mRunning) {
+        return;
+      }
+      key = mQueue.front();
+      mQueue.pop_front();
+      mCompiling++;
+    }
+
+    TRACE_ZONE("PipelineManager::compile");
+    auto start = std::chrono::high_resolution_clock::now();
+    VkPipeline pipeline = compile(key);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "PipelineManager: compiled a new permutation in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mPipelines[key] = {pipeline, true};
+      mCompiling--;
+    }
+    mCondition.notify_all();
+  }
+}
+
+VkPipeline PipelineManager::compile(const RenderStateKey &key) const {
+  ShaderProgram program;
+  VertexLayout vertexLayout;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    program = mShaderPrograms[key.shaderProgram];
+    vertexLayout = mVertexLayouts[key.vertexLayout];
+  }
+
+  VkGraphicsPipelineCreateInfo pipeline_create_info{};
+  pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_create_info.flags = mFlags;
+
+  VkPipelineShaderStageCreateInfo shader_stages[2]{};
+  shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shader_stages[0].module = program.vertModule;
+  shader_stages[0].pName = "main";
+  shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shader_stages[1].module = program.fragModule;
+  shader_stages[1].pName = "main";
+  pipeline_create_info.stageCount = 2;
+  pipeline_create_info.pStages = shader_stages;
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions = &vertexLayout.binding;
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexLayout.attributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = vertexLayout.attributes.data();
+  pipeline_create_info.pVertexInputState = &vertexInputInfo;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
+      VulkanInit::pipeline_input_assembly_state_create_info(key.topology, 0, VK_FALSE);
+  pipeline_create_info.pInputAssemblyState = &inputAssemblyState;
+
+  // Viewport and scissor are dynamic, see dynamicStates
+  VkPipelineViewportStateCreateInfo viewportState = VulkanInit::pipeline_viewport_state_create_Info(1, 1, 0);
+  pipeline_create_info.pViewportState = &viewportState;
+
+  VkPipelineRasterizationStateCreateInfo rasterizationState =
+      VulkanInit::pipeline_rasterization_state_create_info(key.polygonMode, key.cullMode, key.frontFace, 0);
+  pipeline_create_info.pRasterizationState = &rasterizationState;
+
+  // Samples are set with vkCmdSetRasterizationSamplesEXT
+  pipeline_create_info.pMultisampleState = nullptr;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencilState =
+      VulkanInit::pipeline_depthstencil_state_create_info(key.depthTest, key.depthWrite, key.depthCompare);
+  pipeline_create_info.pDepthStencilState = &depthStencilState;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+  colorBlendAttachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = key.alphaBlend;
+  colorBlendAttachment.srcColorBlendFactor = key.alphaBlend ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstColorBlendFactor = key.alphaBlend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+  VkPipelineColorBlendStateCreateInfo colorBlendState =
+      VulkanInit::pipeline_colorblend_state_create_info(1, &colorBlendAttachment);
+  pipeline_create_info.pColorBlendState = &colorBlendState;
+
+  const VkDynamicState dynamicStates[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR,
+      VK_DYNAMIC_STATE_SAMPLE_MASK_EXT,
+      VK_DYNAMIC_STATE_ALPHA_TO_COVERAGE_ENABLE_EXT,
+      VK_DYNAMIC_STATE_ALPHA_TO_ONE_ENABLE_EXT,
+      VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT};
+  VkPipelineDynamicStateCreateInfo dynamic_state_info{};
+  dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+  dynamic_state_info.pDynamicStates = dynamicStates;
+  pipeline_create_info.pDynamicState = &dynamic_state_info;
+
+  pipeline_create_info.layout = mLayout;
+  pipeline_create_info.renderPass = nullptr;
+  pipeline_create_info.subpass = 0;
+  pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_create_info.basePipelineIndex = -1;
+
+  // For dynamic rendering
+  VkPipelineRenderingCreateInfoKHR pipeline_rendering_create_info{};
+  pipeline_rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+  pipeline_rendering_create_info.colorAttachmentCount = 1;
+  pipeline_rendering_create_info.pColorAttachmentFormats = &key.colorFormat;
+  pipeline_rendering_create_info.depthAttachmentFormat = key.depthFormat;
+  pipeline_rendering_create_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+  pipeline_create_info.pNext = &pipeline_rendering_create_info;
+
+  VkPipeline pipeline;
+  VK_CHECK(vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipeline_create_info, nullptr, &pipeline),
+           "vkCreateGraphicsPipelines");
+  return pipeline;
+}
+} // namespace VulkanEngine
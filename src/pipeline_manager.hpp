@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// Everything a graphics pipeline is built from, apart from the layout.
+// Plain 32 bit fields only so it can be hashed and compared as bytes, shaders
+// and vertex layouts are ids handed out by the PipelineManager.
+struct RenderStateKey {
+  uint32_t shaderProgram = 0;
+  uint32_t vertexLayout = 0;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+  VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  VkBool32 depthTest = VK_TRUE;
+  VkBool32 depthWrite = VK_TRUE;
+  VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+  // Standard alpha blending when set
+  VkBool32 alphaBlend = VK_FALSE;
+  VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  // No sample count, it's dynamic state set when recording
+
+  bool operator==(const RenderStateKey &other) const;
+};
+
+struct RenderStateKeyHash {
+  size_t operator()(const RenderStateKey &key) const;
+};
+
+// Owns every graphics pipeline, one per distinct RenderStateKey.
+// getPipeline() never blocks: a permutation seen for the first time is queued
+// for the worker threads and the caller's fallback is used until it's ready,
+// so new materials or state changes never stall a frame on a compile.
+// All pipelines share one layout and the (thread safe) pipeline cache.
+class PipelineManager {
+public:
+  PipelineManager();
+  ~PipelineManager();
+
+  // flags are added to every pipeline, e.g. VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+  void init(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+            VkPipelineCreateFlags flags = 0, uint32_t workerCount = 2);
+  void destroy();
+
+  // SPIR-V of both stages, ids are used in RenderStateKey::shaderProgram
+  uint32_t addShaderProgram(const std::vector<char> &vertCode, const std::vector<char> &fragCode);
+  // Swaps in new code and drops every pipeline built from the program, they
+  // are rebuilt on next use. The GPU must not be using them anymore
+  void reloadShaderProgram(uint32_t program, const std::vector<char> &vertCode,
+                           const std::vector<char> &fragCode);
+  uint32_t addVertexLayout(const VkVertexInputBindingDescription &binding,
+                           const std::vector<VkVertexInputAttributeDescription> &attributes);
+
+  // Compiles on the calling thread if needed, for pipelines that have to exist
+  // before the first frame (e.g. the fallback)
+  VkPipeline getPipelineNow(const RenderStateKey &key);
+  // Returns fallback while the pipeline is still being compiled
+  VkPipeline getPipeline(const RenderStateKey &key, VkPipeline fallback);
+
+  size_t pipelineCount() const;
+  size_t pendingCount() const;
+
+private:
+  struct ShaderProgram {
+    VkShaderModule vertModule;
+    VkShaderModule fragModule;
+  };
+  struct VertexLayout {
+    VkVertexInputBindingDescription binding;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+  };
+  struct Entry {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    bool ready = false;
+  };
+
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+  VkPipelineLayout mLayout = VK_NULL_HANDLE;
+  VkPipelineCreateFlags mFlags = 0;
+
+  // Everything below is guarded by mMutex
+  mutable std::mutex mMutex;
+  std::vector<ShaderProgram> mShaderPrograms;
+  std::vector<VertexLayout> mVertexLayouts;
+  std::condition_variable mCondition;
+  std::unordered_map<RenderStateKey, Entry, RenderStateKeyHash> mPipelines;
+  std::deque<RenderStateKey> mQueue;
+  // Keys taken off the queue by workers and not finished yet
+  uint32_t mCompiling = 0;
+  std::vector<std::thread> mWorkers;
+  bool mRunning = false;
+
+  void workerLoop();
+  VkPipeline compile(const RenderStateKey &key) const;
+};
+} // namespace VulkanEngine
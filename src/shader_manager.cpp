@@ -0,0 +1,175 @@
+#include "shader_manager.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <vulkan_helper.hpp>
+
+#ifdef VKGAME_HAVE_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace VulkanEngine {
+
+ShaderManager::ShaderManager() {}
+
+ShaderManager::~ShaderManager() {
+  destroy();
+}
+
+void ShaderManager::init(const std::string &sourceDir, const std::string &cacheDir) {
+  mSourceDir = sourceDir;
+  mCacheDir = cacheDir;
+  std::error_code error;
+  std::filesystem::create_directories(mCacheDir, error);
+
+#ifdef __linux__
+  // Editors either rewrite the file or move a new one over it
+  mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (mInotify < 0 || inotify_add_watch(mInotify, sourceDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    std::cout << "ShaderManager: can't watch " << sourceDir << ", hot reload disabled\n";
+  }
+#endif
+}
+
+void ShaderManager::destroy() {
+#ifdef __linux__
+  if (mInotify >= 0) {
+    close(mInotify);
+  }
+  mInotify = -1;
+#endif
+  mWatched.clear();
+}
+
+std::vector<char> ShaderManager::getSpirv(const std::string &name) {
+  mWatched.insert(name);
+#ifndef __linux__
+  std::error_code error;
+  mWriteTimes[name] = std::filesystem::last_write_time(mSourceDir / name, error);
+#endif
+
+  std::vector<char> spirv;
+  if (compile(name, spirv)) {
+    return spirv;
+  }
+  std::cout << "ShaderManager: using the prebuilt shaders/" << name << ".spv\n";
+  return VulkanHelper::readFile("shaders/" + name + ".spv");
+}
+
+std::vector<std::string> ShaderManager::pollChanges() {
+  std::set<std::string> changed;
+
+#ifdef __linux__
+  if (mInotify < 0) {
+    return {};
+  }
+  alignas(inotify_event) char buffer[4096];
+  ssize_t length;
+  while ((length = read(mInotify, buffer, sizeof(buffer))) > 0) {
+    for (char *pos = buffer; pos < buffer + length;) {
+      const inotify_event *event = reinterpret_cast<const inotify_event *>(pos);
+      if (event->len > 0 && mWatched.count(event->name)) {
+        changed.insert(event->name);
+      }
+      pos += sizeof(inotify_event) + event->len;
+    }
+  }
+#else
+  uint32_t now = SDL_GetTicks();
+  if (now - mLastPoll < mPollInterval) {
+    return {};
+  }
+  mLastPoll = now;
+  for (const std::string &name : mWatched) {
+    std::error_code error;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(mSourceDir / name, error);
+    if (!error && writeTime != mWriteTimes[name]) {
+      mWriteTimes[name] = writeTime;
+      changed.insert(name);
+    }
+  }
+#endif
+
+  std::vector<std::string> compiled;
+  for (const std::string &name : changed) {
+    std::vector<char> spirv;
+    if (compile(name, spirv)) {
+      std::cout << "ShaderManager: recompiled " << name << "\n";
+      compiled.push_back(name);
+    }
+  }
+  return compiled;
+}
+
+bool ShaderManager::compile(const std::string &name, std::vector<char> &spirv) {
+  std::filesystem::path sourcePath = mSourceDir / name;
+  std::ifstream file(sourcePath, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  std::string source = stream.str();
+
+  // FNV-1a of name and source, the stage comes from the name
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : name + '\0' + source) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  std::stringstream cacheName;
+  cacheName << name << "." << std::hex << hash << ".spv";
+  std::filesystem::path cachePath = mCacheDir / cacheName.str();
+
+  if (std::filesystem::exists(cachePath)) {
+    spirv = VulkanHelper::readFile(cachePath.generic_string());
+    return true;
+  }
+
+#ifdef VKGAME_HAVE_SHADERC
+  shaderc::Compiler compiler;
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+  shaderc_shader_kind kind = sourcePath.extension() == ".vert" ? shaderc_glsl_vertex_shader
+                                                               : shaderc_glsl_fragment_shader;
+  shaderc::SpvCompilationResult result =
+      compiler.CompileGlslToSpv(source, kind, sourcePath.generic_string().c_str(), options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    std::cout << "ShaderManager: " << result.GetErrorMessage();
+    return false;
+  }
+  std::ofstream out(cachePath, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(result.cbegin()),
+            static_cast<std::streamsize>((result.cend() - result.cbegin()) * sizeof(uint32_t)));
+  out.close();
+#else
+#ifdef VKGAME_GLSLC
+  std::string glslc = VKGAME_GLSLC;
+#else
+  std::string glslc = "glslc";
+#endif
+  // glslc prints its own errors
+  std::string command = "\"" + glslc + "\" --target-env=vulkan1.2 \"" + sourcePath.generic_string() +
+                        "\" -o \"" + cachePath.generic_string() + "\"";
+#ifdef _WIN32
+  // cmd.exe drops the outer quotes
+  command = "\"" + command + "\"";
+#endif
+  if (std::system(command.c_str()) != 0) {
+    std::error_code error;
+    std::filesystem::remove(cachePath, error);
+    return false;
+  }
+#endif
+
+  spirv = VulkanHelper::readFile(cachePath.generic_string());
+  return true;
+}
+} // namespace VulkanEngine
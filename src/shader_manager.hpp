@@ -0,0 +1,51 @@
+#pragma once
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace VulkanEngine {
+
+// Compiles GLSL to SPIR-V at runtime and recompiles it when the source changes.
+// Shaders are named by their source file, e.g. "simple_shader.vert". The
+// SPIR-V is cached in cacheDir by a hash of the source, unchanged shaders are
+// never compiled twice. Sources are compiled with shaderc when the build found
+// it (VKGAME_HAVE_SHADERC), otherwise with the glslc executable.
+// When a source can't be compiled the shaders/<name>.spv next to the working
+// directory is used, which the CMake build compiles into the build folder.
+// No SPIR-V is checked in.
+class ShaderManager {
+public:
+  ShaderManager();
+  ~ShaderManager();
+
+  void init(const std::string &sourceDir, const std::string &cacheDir);
+  void destroy();
+
+  // SPIR-V for the shader, it is watched for changes from now on
+  std::vector<char> getSpirv(const std::string &name);
+
+  // Names of the watched shaders that changed on disk and compiled fine since
+  // the last call. Call once a frame, it doesn't block
+  std::vector<std::string> pollChanges();
+
+private:
+  std::filesystem::path mSourceDir;
+  std::filesystem::path mCacheDir;
+  std::set<std::string> mWatched;
+
+#ifdef __linux__
+  int mInotify = -1;
+#else
+  // Without inotify the modification times are compared every mPollInterval
+  std::unordered_map<std::string, std::filesystem::file_time_type> mWriteTimes;
+  uint32_t mLastPoll = 0;
+  static constexpr uint32_t mPollInterval = 500;
+#endif
+
+  // Returns false and leaves spirv alone if the source doesn't compile
+  bool compile(const std::string &name, std::vector<char> &spirv);
+};
+} // namespace VulkanEngine
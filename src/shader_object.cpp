@@ -0,0 +1,125 @@
+#include "shader_object.hpp"
+
+namespace VulkanEngine {
+
+bool ShaderObjectProgram::isSupported(VkPhysicalDevice physicalDevice) {
+  VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{};
+  shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &shaderObjectFeatures;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+  return shaderObjectFeatures.shaderObject;
+}
+
+void ShaderObjectProgram::create(VkDevice device, const std::vector<char> &vertCode,
+                                 const std::vector<char> &fragCode, VkDescriptorSetLayout setLayout,
+                                 const VkPushConstantRange &pushConstantRange,
+                                 const VkVertexInputBindingDescription &vertexBinding,
+                                 const std::vector<VkVertexInputAttributeDescription> &vertexAttributes) {
+  mDevice = device;
+
+  mCreateShaders = PFN_vkCreateShadersEXT(vkGetDeviceProcAddr(device, "vkCreateShadersEXT"));
+  mDestroyShader = PFN_vkDestroyShaderEXT(vkGetDeviceProcAddr(device, "vkDestroyShaderEXT"));
+  mCmdBindShaders = PFN_vkCmdBindShadersEXT(vkGetDeviceProcAddr(device, "vkCmdBindShadersEXT"));
+  mCmdSetVertexInput = PFN_vkCmdSetVertexInputEXT(vkGetDeviceProcAddr(device, "vkCmdSetVertexInputEXT"));
+  mCmdSetPolygonMode = PFN_vkCmdSetPolygonModeEXT(vkGetDeviceProcAddr(device, "vkCmdSetPolygonModeEXT"));
+  mCmdSetRasterizationSamples = PFN_vkCmdSetRasterizationSamplesEXT(vkGetDeviceProcAddr(device, "vkCmdSetRasterizationSamplesEXT"));
+  mCmdSetSampleMask = PFN_vkCmdSetSampleMaskEXT(vkGetDeviceProcAddr(device, "vkCmdSetSampleMaskEXT"));
+  mCmdSetAlphaToCoverageEnable = PFN_vkCmdSetAlphaToCoverageEnableEXT(vkGetDeviceProcAddr(device, "vkCmdSetAlphaToCoverageEnableEXT"));
+  mCmdSetColorBlendEnable = PFN_vkCmdSetColorBlendEnableEXT(vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEnableEXT"));
+  mCmdSetColorWriteMask = PFN_vkCmdSetColorWriteMaskEXT(vkGetDeviceProcAddr(device, "vkCmdSetColorWriteMaskEXT"));
+  if (!mCreateShaders || !mDestroyShader || !mCmdBindShaders || !mCmdSetVertexInput) {
+    throw std::runtime_error("VK_EXT_shader_object entry points missing");
+  }
+
+  // Linked so the driver can optimize across the two stages like a pipeline
+  VkShaderCreateInfoEXT shader_create_infos[2]{};
+  for (VkShaderCreateInfoEXT &shader_create_info : shader_create_infos) {
+    shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+    shader_create_info.flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+    shader_create_info.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+    shader_create_info.pName = "main";
+    shader_create_info.setLayoutCount = 1;
+    shader_create_info.pSetLayouts = &setLayout;
+    shader_create_info.pushConstantRangeCount = pushConstantRange.size > 0 ? 1 : 0;
+    shader_create_info.pPushConstantRanges = &pushConstantRange;
+  }
+  shader_create_infos[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shader_create_infos[0].nextStage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shader_create_infos[0].codeSize = vertCode.size();
+  shader_create_infos[0].pCode = vertCode.data();
+  shader_create_infos[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shader_create_infos[1].nextStage = 0;
+  shader_create_infos[1].codeSize = fragCode.size();
+  shader_create_infos[1].pCode = fragCode.data();
+
+  VK_CHECK(mCreateShaders(device, 2, shader_create_infos, nullptr, mShaders), "vkCreateShadersEXT");
+
+  mVertexBinding = {};
+  mVertexBinding.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+  mVertexBinding.binding = vertexBinding.binding;
+  mVertexBinding.stride = vertexBinding.stride;
+  mVertexBinding.inputRate = vertexBinding.inputRate;
+  mVertexBinding.divisor = 1;
+
+  mVertexAttributes.clear();
+  for (const VkVertexInputAttributeDescription &description : vertexAttributes) {
+    VkVertexInputAttributeDescription2EXT attribute{};
+    attribute.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+    attribute.location = description.location;
+    attribute.binding = description.binding;
+    attribute.format = description.format;
+    attribute.offset = description.offset;
+    mVertexAttributes.push_back(attribute);
+  }
+}
+
+void ShaderObjectProgram::destroy() {
+  for (VkShaderEXT &shader : mShaders) {
+    if (shader != VK_NULL_HANDLE) {
+      mDestroyShader(mDevice, shader, nullptr);
+    }
+    shader = VK_NULL_HANDLE;
+  }
+}
+
+void ShaderObjectProgram::bind(VkCommandBuffer commandBuffer, VkExtent2D extent, VkSampleCountFlagBits samples) const {
+  const VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+  mCmdBindShaders(commandBuffer, 2, stages, mShaders);
+
+  // Same state as the scene pipeline in VulkanRenderer::createGraphicsPipeline
+  mCmdSetVertexInput(commandBuffer, 1, &mVertexBinding, static_cast<uint32_t>(mVertexAttributes.size()),
+                     mVertexAttributes.data());
+  vkCmdSetPrimitiveTopology(commandBuffer, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  vkCmdSetPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+
+  VkViewport viewport{0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f};
+  VkRect2D scissor{{0, 0}, extent};
+  vkCmdSetViewportWithCount(commandBuffer, 1, &viewport);
+  vkCmdSetScissorWithCount(commandBuffer, 1, &scissor);
+
+  vkCmdSetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+  mCmdSetPolygonMode(commandBuffer, VK_POLYGON_MODE_FILL);
+  vkCmdSetCullMode(commandBuffer, VK_CULL_MODE_NONE);
+  vkCmdSetFrontFace(commandBuffer, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+  vkCmdSetDepthBiasEnable(commandBuffer, VK_FALSE);
+
+  VkSampleMask sampleMask = 0xFFFFFFFF;
+  mCmdSetRasterizationSamples(commandBuffer, samples);
+  mCmdSetSampleMask(commandBuffer, samples, &sampleMask);
+  mCmdSetAlphaToCoverageEnable(commandBuffer, VK_FALSE);
+
+  vkCmdSetDepthTestEnable(commandBuffer, VK_TRUE);
+  vkCmdSetDepthWriteEnable(commandBuffer, VK_TRUE);
+  vkCmdSetDepthCompareOp(commandBuffer, VK_COMPARE_OP_LESS);
+  vkCmdSetDepthBoundsTestEnable(commandBuffer, VK_FALSE);
+  vkCmdSetStencilTestEnable(commandBuffer, VK_FALSE);
+
+  VkBool32 blendEnable = VK_FALSE;
+  VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                    VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  mCmdSetColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+  mCmdSetColorWriteMask(commandBuffer, 0, 1, &writeMask);
+}
+} // namespace VulkanEngine
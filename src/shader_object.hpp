@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// A linked vertex + fragment pair of VkShaderEXT objects (VK_EXT_shader_object).
+// There is no VkPipeline, bind() sets every piece of state a pipeline would
+// have baked in, so the same shaders work with any attachment format, sample
+// count or viewport without compiling anything new.
+class ShaderObjectProgram {
+public:
+  // True if the device supports the shaderObject feature
+  static bool isSupported(VkPhysicalDevice physicalDevice);
+
+  // The layout and push constant range have to match the pipeline layout the
+  // descriptors and push constants are bound with. A range of size 0 means
+  // no push constants. The vertex input is set by bind()
+  void create(VkDevice device, const std::vector<char> &vertCode, const std::vector<char> &fragCode,
+              VkDescriptorSetLayout setLayout, const VkPushConstantRange &pushConstantRange,
+              const VkVertexInputBindingDescription &vertexBinding,
+              const std::vector<VkVertexInputAttributeDescription> &vertexAttributes);
+  void destroy();
+
+  bool isCreated() const { return mShaders[0] != VK_NULL_HANDLE; }
+
+  // Binds both shaders and sets all the state the scene draws need
+  void bind(VkCommandBuffer commandBuffer, VkExtent2D extent, VkSampleCountFlagBits samples) const;
+
+private:
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkShaderEXT mShaders[2] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkVertexInputBindingDescription2EXT mVertexBinding{};
+  std::vector<VkVertexInputAttributeDescription2EXT> mVertexAttributes;
+
+  PFN_vkCreateShadersEXT mCreateShaders = nullptr;
+  PFN_vkDestroyShaderEXT mDestroyShader = nullptr;
+  PFN_vkCmdBindShadersEXT mCmdBindShaders = nullptr;
+  PFN_vkCmdSetVertexInputEXT mCmdSetVertexInput = nullptr;
+  PFN_vkCmdSetPolygonModeEXT mCmdSetPolygonMode = nullptr;
+  PFN_vkCmdSetRasterizationSamplesEXT mCmdSetRasterizationSamples = nullptr;
+  PFN_vkCmdSetSampleMaskEXT mCmdSetSampleMask = nullptr;
+  PFN_vkCmdSetAlphaToCoverageEnableEXT mCmdSetAlphaToCoverageEnable = nullptr;
+  PFN_vkCmdSetColorBlendEnableEXT mCmdSetColorBlendEnable = nullptr;
+  PFN_vkCmdSetColorWriteMaskEXT mCmdSetColorWriteMask = nullptr;
+};
+} // namespace VulkanEngine
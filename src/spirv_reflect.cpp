@@ -0,0 +1,429 @@
+#include "spirv_reflect.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace SpirvReflect {
+
+namespace {
+
+const uint32_t kMagic = 0x07230203;
+
+// Opcodes, decorations and storage classes from the SPIR-V spec
+enum Op : uint32_t {
+  OpName = 5,
+  OpEntryPoint = 15,
+  OpTypeBool = 20,
+  OpTypeInt = 21,
+  OpTypeFloat = 22,
+  OpTypeVector = 23,
+  OpTypeMatrix = 24,
+  OpTypeImage = 25,
+  OpTypeSampler = 26,
+  OpTypeSampledImage = 27,
+  OpTypeArray = 28,
+  OpTypeRuntimeArray = 29,
+  OpTypeStruct = 30,
+  OpTypePointer = 32,
+  OpConstant = 43,
+  OpVariable = 59,
+  OpDecorate = 71,
+  OpMemberDecorate = 72,
+};
+
+enum Decoration : uint32_t {
+  DecorationBlock = 2,
+  DecorationBufferBlock = 3,
+  DecorationArrayStride = 6,
+  DecorationMatrixStride = 7,
+  DecorationBuiltIn = 11,
+  DecorationLocation = 30,
+  DecorationBinding = 33,
+  DecorationDescriptorSet = 34,
+  DecorationOffset = 35,
+};
+
+enum StorageClass : uint32_t {
+  StorageUniformConstant = 0,
+  StorageInput = 1,
+  StorageUniform = 2,
+  StoragePushConstant = 9,
+  StorageStorageBuffer = 12,
+};
+
+const uint32_t kUnset = UINT32_MAX;
+
+// Everything we track about one result id
+struct Id {
+  uint32_t opcode = 0;
+  // Operands after the result id
+  std::vector<uint32_t> operands;
+  std::string name;
+  uint32_t set = kUnset;
+  uint32_t binding = kUnset;
+  uint32_t location = kUnset;
+  uint32_t arrayStride = 0;
+  bool builtIn = false;
+  bool block = false;
+  bool bufferBlock = false;
+  // Struct members
+  std::vector<uint32_t> memberOffsets;
+  std::vector<uint32_t> memberMatrixStrides;
+};
+
+struct Parser {
+  std::vector<Id> ids;
+
+  // Strips arrays, fills count (0 for runtime arrays)
+  uint32_t elementType(uint32_t type, uint32_t &count) const {
+    count = 1;
+    while (ids[type].opcode == OpTypeArray || ids[type].opcode == OpTypeRuntimeArray) {
+      if (ids[type].opcode == OpTypeRuntimeArray) {
+        count = 0;
+      } else {
+        count *= constantValue(ids[type].operands[1]);
+      }
+      type = ids[type].operands[0];
+    }
+    return type;
+  }
+
+  uint32_t constantValue(uint32_t id) const {
+    // OpConstant: result type, result id, value
+    return ids[id].opcode == OpConstant ? ids[id].operands[0] : 1;
+  }
+
+  uint32_t typeSize(uint32_t type, uint32_t matrixStride) const {
+    const Id &t = ids[type];
+    switch (t.opcode) {
+    case OpTypeBool:
+      return 4;
+    case OpTypeInt:
+    case OpTypeFloat:
+      return t.operands[0] / 8;
+    case OpTypeVector:
+      return t.operands[1] * typeSize(t.operands[0], 0);
+    case OpTypeMatrix:
+      // Columns are matrixStride apart in buffers
+      return t.operands[1] * (matrixStride ? matrixStride : typeSize(t.operands[0], 0));
+    case OpTypeArray:
+      return constantValue(t.operands[1]) * (t.arrayStride ? t.arrayStride : typeSize(t.operands[0], matrixStride));
+    case OpTypeStruct: {
+      uint32_t size = 0;
+      for (size_t i = 0; i < t.operands.size(); i++) {
+        uint32_t offset = i < t.memberOffsets.size() ? t.memberOffsets[i] : size;
+        uint32_t stride = i < t.memberMatrixStrides.size() ? t.memberMatrixStrides[i] : 0;
+        size = std::max(size, offset + typeSize(t.operands[i], stride));
+      }
+      return size;
+    }
+    default:
+      return 0;
+    }
+  }
+
+  VkFormat inputFormat(uint32_t type) const {
+    const Id &t = ids[type];
+    uint32_t components = 1;
+    const Id *scalar = &t;
+    if (t.opcode == OpTypeVector) {
+      components = t.operands[1];
+      scalar = &ids[t.operands[0]];
+    }
+    if (scalar->operands.empty() || scalar->operands[0] != 32) {
+      return VK_FORMAT_UNDEFINED;
+    }
+    if (scalar->opcode == OpTypeFloat) {
+      const VkFormat formats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT,
+                                  VK_FORMAT_R32G32B32A32_SFLOAT};
+      return formats[components - 1];
+    }
+    if (scalar->opcode == OpTypeInt && scalar->operands[1] == 1) {
+      const VkFormat formats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT,
+                                  VK_FORMAT_R32G32B32A32_SINT};
+      return formats[components - 1];
+    }
+    if (scalar->opcode == OpTypeInt) {
+      const VkFormat formats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT,
+                                  VK_FORMAT_R32G32B32A32_UINT};
+      return formats[components - 1];
+    }
+    return VK_FORMAT_UNDEFINED;
+  }
+
+  // VK_DESCRIPTOR_TYPE_MAX_ENUM if the variable isn't a descriptor
+  VkDescriptorType descriptorType(uint32_t storageClass, uint32_t type) const {
+    const Id &t = ids[type];
+    if (storageClass == StorageStorageBuffer) {
+      return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    if (storageClass == StorageUniform) {
+      return t.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    }
+    if (storageClass != StorageUniformConstant) {
+      return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+    switch (t.opcode) {
+    case OpTypeSampledImage:
+      return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case OpTypeSampler:
+      return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case OpTypeImage: {
+      // OpTypeImage: sampled type, dim, depth, arrayed, ms, sampled, format
+      bool buffer = t.operands[1] == 5;
+      bool storage = t.operands[5] == 2;
+      if (buffer) {
+        return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    default:
+      return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+  }
+};
+
+std::string readString(const uint32_t *words, size_t count) {
+  const char *chars = reinterpret_cast<const char *>(words);
+  return std::string(chars, strnlen(chars, count * 4));
+}
+
+} // namespace
+
+bool reflect(const std::vector<char> &spirv, Module &module, std::string &error) {
+  module = Module{};
+  if (spirv.size() < 20 || spirv.size() % 4 != 0) {
+    error = "not a SPIR-V module";
+    return false;
+  }
+  std::vector<uint32_t> words(spirv.size() / 4);
+  memcpy(words.data(), spirv.data(), spirv.size());
+  if (words[0] != kMagic) {
+    error = "bad SPIR-V magic";
+    return false;
+  }
+
+  Parser parser;
+  parser.ids.resize(words[3]);
+  std::vector<uint32_t> variables;
+  bool hasEntryPoint = false;
+
+  for (size_t i = 5; i < words.size();) {
+    uint32_t opcode = words[i] & 0xFFFF;
+    uint32_t count = words[i] >> 16;
+    if (count == 0 || i + count > words.size()) {
+      error = "truncated instruction";
+      return false;
+    }
+    const uint32_t *operands = &words[i + 1];
+    uint32_t operandCount = count - 1;
+
+    switch (opcode) {
+    case OpName:
+      if (operands[0] < parser.ids.size()) {
+        parser.ids[operands[0]].name = readString(operands + 1, operandCount - 1);
+      }
+      break;
+    case OpEntryPoint:
+      // Execution model: 0 vertex, 4 fragment, 5 compute
+      if (!hasEntryPoint) {
+        hasEntryPoint = true;
+        switch (operands[0]) {
+        case 0: module.stage = VK_SHADER_STAGE_VERTEX_BIT; break;
+        case 4: module.stage = VK_SHADER_STAGE_FRAGMENT_BIT; break;
+        case 5: module.stage = VK_SHADER_STAGE_COMPUTE_BIT; break;
+        default:
+          error = "unsupported execution model";
+          return false;
+        }
+      }
+      break;
+    case OpDecorate: {
+      Id &id = parser.ids[operands[0]];
+      uint32_t value = operandCount > 2 ? operands[2] : 0;
+      switch (operands[1]) {
+      case DecorationBlock: id.block = true; break;
+      case DecorationBufferBlock: id.bufferBlock = true; break;
+      case DecorationBuiltIn: id.builtIn = true; break;
+      case DecorationArrayStride: id.arrayStride = value; break;
+      case DecorationLocation: id.location = value; break;
+      case DecorationBinding: id.binding = value; break;
+      case DecorationDescriptorSet: id.set = value; break;
+      }
+      break;
+    }
+    case OpMemberDecorate: {
+      Id &id = parser.ids[operands[0]];
+      uint32_t member = operands[1];
+      uint32_t value = operandCount > 3 ? operands[3] : 0;
+      if (operands[2] == DecorationOffset) {
+        id.memberOffsets.resize(std::max<size_t>(id.memberOffsets.size(), member + 1), 0);
+        id.memberOffsets[member] = value;
+      } else if (operands[2] == DecorationMatrixStride) {
+        id.memberMatrixStrides.resize(std::max<size_t>(id.memberMatrixStrides.size(), member + 1), 0);
+        id.memberMatrixStrides[member] = value;
+      } else if (operands[2] == DecorationBuiltIn) {
+        id.builtIn = true;
+      }
+      break;
+    }
+    case OpTypeBool:
+    case OpTypeInt:
+    case OpTypeFloat:
+    case OpTypeVector:
+    case OpTypeMatrix:
+    case OpTypeImage:
+    case OpTypeSampler:
+    case OpTypeSampledImage:
+    case OpTypeArray:
+    case OpTypeRuntimeArray:
+    case OpTypeStruct:
+    case OpTypePointer: {
+      Id &id = parser.ids[operands[0]];
+      id.opcode = opcode;
+      id.operands.assign(operands + 1, operands + operandCount);
+      break;
+    }
+    case OpConstant:
+    case OpVariable: {
+      // Result type comes first here, stored as the last operand so
+      // operands[0] is the value/storage class
+      Id &id = parser.ids[operands[1]];
+      id.opcode = opcode;
+      id.operands.assign(operands + 2, operands + operandCount);
+      id.operands.push_back(operands[0]);
+      if (opcode == OpVariable) {
+        variables.push_back(operands[1]);
+      }
+      break;
+    }
+    }
+    i += count;
+  }
+
+  if (!hasEntryPoint) {
+    error = "no entry point";
+    return false;
+  }
+
+  for (uint32_t variable : variables) {
+    const Id &var = parser.ids[variable];
+    uint32_t storageClass = var.operands[0];
+    const Id &pointer = parser.ids[var.operands.back()];
+    if (pointer.opcode != OpTypePointer) {
+      continue;
+    }
+    uint32_t pointee = pointer.operands[1];
+
+    if (storageClass == StoragePushConstant) {
+      module.pushConstantSize = std::max(module.pushConstantSize, parser.typeSize(pointee, 0));
+      continue;
+    }
+
+    if (storageClass == StorageInput) {
+      if (module.stage != VK_SHADER_STAGE_VERTEX_BIT || var.builtIn || parser.ids[pointee].builtIn ||
+          var.location == kUnset) {
+        continue;
+      }
+      VkFormat format = parser.inputFormat(pointee);
+      if (format == VK_FORMAT_UNDEFINED) {
+        error = "unsupported vertex input type for " + var.name;
+        return false;
+      }
+      module.inputs.push_back({var.location, format, var.name});
+      continue;
+    }
+
+    uint32_t arrayCount;
+    uint32_t element = parser.elementType(pointee, arrayCount);
+    VkDescriptorType type = parser.descriptorType(storageClass, element);
+    if (type == VK_DESCRIPTOR_TYPE_MAX_ENUM) {
+      continue;
+    }
+    DescriptorBinding binding;
+    binding.set = var.set == kUnset ? 0 : var.set;
+    binding.binding = var.binding == kUnset ? 0 : var.binding;
+    binding.type = type;
+    binding.count = arrayCount;
+    binding.stages = module.stage;
+    // Buffers are named by their block, the variable name is often empty
+    binding.name = !var.name.empty() ? var.name : parser.ids[element].name;
+    module.bindings.push_back(binding);
+  }
+
+  std::sort(module.inputs.begin(), module.inputs.end(),
+            [](const VertexInput &a, const VertexInput &b) { return a.location < b.location; });
+  return true;
+}
+
+std::vector<DescriptorBinding> mergeBindings(const std::vector<Module> &modules) {
+  std::vector<DescriptorBinding> merged;
+  for (const Module &module : modules) {
+    for (const DescriptorBinding &binding : module.bindings) {
+      auto existing = std::find_if(merged.begin(), merged.end(), [&](const DescriptorBinding &other) {
+        return other.set == binding.set && other.binding == binding.binding;
+      });
+      if (existing != merged.end()) {
+        existing->stages |= binding.stages;
+      } else {
+        merged.push_back(binding);
+      }
+    }
+  }
+  std::sort(merged.begin(), merged.end(), [](const DescriptorBinding &a, const DescriptorBinding &b) {
+    return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+  });
+  return merged;
+}
+
+VkPushConstantRange mergePushConstants(const std::vector<Module> &modules) {
+  VkPushConstantRange range{};
+  for (const Module &module : modules) {
+    if (module.pushConstantSize > 0) {
+      range.stageFlags |= module.stage;
+      range.size = std::max(range.size, module.pushConstantSize);
+    }
+  }
+  return range;
+}
+
+uint32_t vertexAttributes(const Module &vertexModule, uint32_t binding,
+                          std::vector<VkVertexInputAttributeDescription> &attributes) {
+  attributes.clear();
+  uint32_t offset = 0;
+  for (const VertexInput &input : vertexModule.inputs) {
+    VkVertexInputAttributeDescription attribute{};
+    attribute.location = input.location;
+    attribute.binding = binding;
+    attribute.format = input.format;
+    attribute.offset = offset;
+    attributes.push_back(attribute);
+    offset += formatSize(input.format);
+  }
+  return offset;
+}
+
+uint32_t formatSize(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R32_SFLOAT:
+  case VK_FORMAT_R32_SINT:
+  case VK_FORMAT_R32_UINT:
+    return 4;
+  case VK_FORMAT_R32G32_SFLOAT:
+  case VK_FORMAT_R32G32_SINT:
+  case VK_FORMAT_R32G32_UINT:
+    return 8;
+  case VK_FORMAT_R32G32B32_SFLOAT:
+  case VK_FORMAT_R32G32B32_SINT:
+  case VK_FORMAT_R32G32B32_UINT:
+    return 12;
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+  case VK_FORMAT_R32G32B32A32_SINT:
+  case VK_FORMAT_R32G32B32A32_UINT:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+} // namespace SpirvReflect
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Reads the interface of a SPIR-V module (https://registry.khronos.org/SPIR-V/)
+// so descriptor set layouts, push constant ranges and vertex input state can
+// be generated from the shaders instead of being kept in sync by hand.
+// Only what our GLSL shaders use is understood: uniform/storage buffers,
+// samplers and images (optionally in arrays), one push constant block and
+// scalar/vector vertex inputs.
+namespace SpirvReflect {
+
+struct DescriptorBinding {
+  uint32_t set;
+  uint32_t binding;
+  VkDescriptorType type;
+  // 0 for a runtime sized array (e.g. a bindless texture table)
+  uint32_t count;
+  VkShaderStageFlags stages;
+  std::string name;
+};
+
+struct VertexInput {
+  uint32_t location;
+  VkFormat format;
+  std::string name;
+};
+
+struct Module {
+  VkShaderStageFlagBits stage;
+  std::vector<DescriptorBinding> bindings;
+  // Only filled for vertex shaders, sorted by location
+  std::vector<VertexInput> inputs;
+  // 0 if the module has no push constant block
+  uint32_t pushConstantSize = 0;
+};
+
+// Fills error and returns false if the code isn't SPIR-V we understand
+bool reflect(const std::vector<char> &spirv, Module &module, std::string &error);
+
+// Bindings of all stages, the same set/binding in several stages is merged
+// into one entry with the stages combined. Sorted by set, then binding
+std::vector<DescriptorBinding> mergeBindings(const std::vector<Module> &modules);
+
+// One range covering the biggest push constant block, visible to every stage
+// that has one. Size 0 if no stage uses push constants
+VkPushConstantRange mergePushConstants(const std::vector<Module> &modules);
+
+// Attributes for one interleaved vertex buffer, in location order and packed
+// without padding. Returns the stride
+uint32_t vertexAttributes(const Module &vertexModule, uint32_t binding,
+                          std::vector<VkVertexInputAttributeDescription> &attributes);
+
+uint32_t formatSize(VkFormat format);
+
+} // namespace SpirvReflect
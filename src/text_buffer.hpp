@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+// Fixed size buffer for text that is formatted again every frame, e.g. stats,
+// without allocating. Whatever doesn't fit is cut off
+template <size_t Capacity>
+class TextBuffer {
+    public:
+        TextBuffer &clear() {
+            mSize = 0;
+            return *this;
+        }
+
+        TextBuffer &append(std::string_view text) {
+            size_t count = std::min(text.size(), Capacity - mSize);
+            memcpy(mData + mSize, text.data(), count);
+            mSize += count;
+            return *this;
+        }
+
+        TextBuffer &append(float value, int precision = 2) {
+            auto result = std::to_chars(mData + mSize, mData + Capacity, value, std::chars_format::fixed, precision);
+            if (result.ec == std::errc()) {
+                mSize = result.ptr - mData;
+            }
+            return *this;
+        }
+
+        TextBuffer &append(int64_t value) {
+            auto result = std::to_chars(mData + mSize, mData + Capacity, value);
+            if (result.ec == std::errc()) {
+                mSize = result.ptr - mData;
+            }
+            return *this;
+        }
+
+        std::string_view view() const { return std::string_view(mData, mSize); }
+
+    private:
+        char mData[Capacity];
+        size_t mSize = 0;
+};
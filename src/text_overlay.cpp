@@ -3,16 +3,19 @@
 #include <text_overlay.hpp>
 
 
-TextOverlay::TextOverlay(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t graphicsFamilyIndex, std::vector<VkImageView> swapChainImageViews, VkFormat swapChainImageFormat, VkExtent2D swapChainExtent, VkQueue queue) {
+TextOverlay::TextOverlay(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t graphicsFamilyIndex, uint32_t imageCount, VkFormat colorFormat, VkSampleCountFlagBits samples, VkExtent2D swapChainExtent, VkQueue queue, VkPipelineCache pipelineCache,
+                         const std::vector<char> &vertSpirv, const std::vector<char> &fragSpirv) {
     mPhysicalDevice = physicalDevice;
     mLogicalDevice = logicalDevice;
     mGraphicsFamilyIndex = graphicsFamilyIndex;
-    mSwapChainImageViews = swapChainImageViews;
-    mSwapChainImageFormat = swapChainImageFormat;
+    mImageCount = imageCount;
+    mColorFormat = colorFormat;
+    mSamples = samples;
     mSwapChainExtent = swapChainExtent;
     mQueue = queue;
-
-    mCommandBuffers.resize(mSwapChainImageViews.size());
+    mPipelineCache = pipelineCache;
+    mVertSpirv = vertSpirv;
+    mFragSpirv = fragSpirv;
 
     prepareResources();
     preparePipeline();
@@ -28,60 +31,39 @@ TextOverlay::~TextOverlay(){
     vkDestroyDescriptorPool(mLogicalDevice, mDescriptorPool, nullptr);
 
     vkDestroyPipelineLayout(mLogicalDevice, mPipelineLayout, nullptr);
-    vkDestroyPipelineCache(mLogicalDevice, mPipelineCache, nullptr);
     vkDestroyPipeline(mLogicalDevice, mPipeline, nullptr);
 
-    vkDestroyBuffer(mLogicalDevice, mVertexBuffer, nullptr);
-	vkFreeMemory(mLogicalDevice, mVertexBufferMemory, nullptr);
+    destroyGlyphBuffer();
     vkDestroyCommandPool(mLogicalDevice, mCommandPool, nullptr);
 }
 
 void TextOverlay::prepareResources(){
 
-    stbtt_pack_context pc;
-    // unsigned char temp_bitmap[1024*1024];
-    unsigned char temp_bitmap[mBitmapWidth][mBitmapHeight];
-
     // fread(ttf_buffer, 1, 1<<20, fopen("c:/windows/fonts/times.ttf", "rb"));
     std::filesystem::path p = std::filesystem::current_path();
 
-    FILE* file = fopen((p.generic_string() + "/fonts/Afacad-Regular.ttf").c_str(), "rb");
-    fread(mTTF_buffer, 1, static_cast<size_t>(1) << 20, file);
-
-    // int res = stbtt_BakeFontBitmap(mTTF_buffer, 0, mFontSize, temp_bitmap[0], mBitmapWidth, mBitmapHeight, mFirstChar,mNumChar, mCharData);
-    int res = stbtt_PackBegin(&pc, temp_bitmap[0], mBitmapWidth, mBitmapHeight, 0, 1, NULL);
-
-    if(res == 0) {
-        std::cout << "Font loading failed\n";
+    // Glyphs are rasterized into the atlas when addText() first needs them
+    mGlyphCache.init(p.generic_string() + "/fonts/Afacad-Regular.ttf", mSdfGlyphSize, mSdfPadding, mBitmapWidth, mBitmapHeight);
+    // Sampled in the middle, far enough from the edges that filtering only
+    // sees the block
+    uint32_t solidX, solidY;
+    if (mGlyphCache.reserveSolid(4, solidX, solidY)) {
+        mSolidUV = glm::vec2((solidX + 2.0f) / mBitmapWidth, (solidY + 2.0f) / mBitmapHeight);
     }
 
-    //ToDo: Oversampling reference: https://github.com/nothings/stb/blob/master/tests/oversample/main.c
-    stbtt_PackFontRange(&pc, mTTF_buffer, 0, mFontSize, mFirstChar, mNumChar, mCharData);
-    stbtt_PackEnd(&pc);
 
-
-    //Command buffer
+    //Command pool, only for the setup commands, the overlay is recorded
+    //into the renderer's command buffers
     VkCommandPoolCreateInfo poolInfo = VulkanInit::command_pool_create_info();
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     poolInfo.queueFamilyIndex = mGraphicsFamilyIndex;
     VK_CHECK(vkCreateCommandPool(mLogicalDevice, &poolInfo, nullptr, &mCommandPool), "TextOverlay vkCreateCommandPool");
 
-    VkCommandBufferAllocateInfo allocInfo = VulkanInit::command_buffer_allocate_info(mCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, (uint32_t)mCommandBuffers.size());
-    VK_CHECK(vkAllocateCommandBuffers(mLogicalDevice, &allocInfo, mCommandBuffers.data()), "TextOverlay vkAllocateCommandBuffers");
-
-    //Vertex buffer
-    VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
-    VkBufferCreateInfo bufferInfo = VulkanInit::buffer_create_info(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
-    VK_CHECK(vkCreateBuffer(mLogicalDevice, &bufferInfo, nullptr, &mVertexBuffer), "TextOverlay vkCreateBuffer");
+    mGlyphs.resize(TEXTOVERLAY_MAX_CHAR_COUNT);
+    createGlyphBuffer();
 
     VkMemoryRequirements memReqs;
     VkMemoryAllocateInfo memAllocInfo = VulkanInit::memory_allocate_info();
-    vkGetBufferMemoryRequirements(mLogicalDevice, mVertexBuffer, &memReqs);
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = VulkanHelper::findMemoryType(mPhysicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    VK_CHECK(vkAllocateMemory(mLogicalDevice, &memAllocInfo, nullptr, &mVertexBufferMemory), "vkAllocateMemory");
-    VK_CHECK(vkBindBufferMemory(mLogicalDevice, mVertexBuffer, mVertexBufferMemory, 0), "vkBindBufferMemory");
 
     // Font texture
     VkImageCreateInfo imageInfo = VulkanInit::image_create_info();
@@ -107,37 +89,9 @@ void TextOverlay::prepareResources(){
 	VK_CHECK(vkAllocateMemory(mLogicalDevice, &memAllocInfo, nullptr, &mImageMemory),"vkAllocateMemory");
 	VK_CHECK(vkBindImageMemory(mLogicalDevice, mImage, mImageMemory, 0),"vkBindImageMemory");
 
-    // Staging
-    struct {
-        VkDeviceMemory memory;
-        VkBuffer buffer;
-    } stagingBuffer;
-
-    VkBufferCreateInfo bufferCreateInfo = VulkanInit::buffer_create_info(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, memAllocInfo.allocationSize);
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VK_CHECK(vkCreateBuffer(mLogicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer.buffer), "vkCreateBuffer");
-
-    // Get memory requirements for the staging buffer (alignment, memory type bits)
-    vkGetBufferMemoryRequirements(mLogicalDevice, stagingBuffer.buffer, &memReqs);
-
-    memAllocInfo.allocationSize = memReqs.size;
-    // Get memory type index for a host visible buffer
-    memAllocInfo.memoryTypeIndex = VulkanHelper::findMemoryType(mPhysicalDevice, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    VK_CHECK(vkAllocateMemory(mLogicalDevice, &memAllocInfo, nullptr, &stagingBuffer.memory), "vkAllocateMemory");
-    VK_CHECK(vkBindBufferMemory(mLogicalDevice, stagingBuffer.buffer, stagingBuffer.memory, 0), "vkBindBufferMemory");
-
-    uint8_t *data;
-    VK_CHECK(vkMapMemory(mLogicalDevice, stagingBuffer.memory, 0, memAllocInfo.allocationSize, 0, (void **)&data), "vkMapMemory");
-
-    // Size of the font texture is WIDTH * HEIGHT * 1 byte (only one channel)
-    memcpy(data, &temp_bitmap[0], mBitmapWidth * mBitmapHeight);
-
-    vkUnmapMemory(mLogicalDevice, stagingBuffer.memory);
-
-    // Copy to image
-    VkCommandBuffer copyImageCommand = VulkanHelper::beginSingleTimeCommands(mLogicalDevice, mCommandPool);
+    // Starts out empty, cleared so filtering at the edge of a glyph never
+    // picks up whatever the memory held
+    VkCommandBuffer clearImageCommand = VulkanHelper::beginSingleTimeCommands(mLogicalDevice, mCommandPool);
 
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -146,32 +100,18 @@ void TextOverlay::prepareResources(){
     subresourceRange.layerCount = 1;
 
     VulkanHelper::setImageLayout(
-        copyImageCommand, 
-        mImage, 
-        VK_IMAGE_LAYOUT_UNDEFINED, 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        subresourceRange, 
-        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 
+        clearImageCommand,
+        mImage,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        subresourceRange,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-    VkBufferImageCopy bufferCopyRegion = {};
-    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bufferCopyRegion.imageSubresource.mipLevel = 0;
-    bufferCopyRegion.imageSubresource.layerCount = 1;
-    bufferCopyRegion.imageExtent.width = mBitmapWidth;
-    bufferCopyRegion.imageExtent.height = mBitmapHeight;
-    bufferCopyRegion.imageExtent.depth = 1;
-
-    vkCmdCopyBufferToImage(
-			copyImageCommand,
-			stagingBuffer.buffer,
-			mImage,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&bufferCopyRegion
-			);
+    VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    vkCmdClearColorImage(clearImageCommand, mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &subresourceRange);
     // Prepare for shader read
-	VulkanHelper::setImageLayout(
-        copyImageCommand,
+    VulkanHelper::setImageLayout(
+        clearImageCommand,
         mImage,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
@@ -179,18 +119,16 @@ void TextOverlay::prepareResources(){
         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-	VK_CHECK(vkEndCommandBuffer(copyImageCommand), "vkEndCommandBuffer");
+    VK_CHECK(vkEndCommandBuffer(clearImageCommand), "vkEndCommandBuffer");
 
     VkSubmitInfo submitInfo = VulkanInit::submit_info();
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &copyImageCommand;
+    submitInfo.pCommandBuffers = &clearImageCommand;
 
     VK_CHECK(vkQueueSubmit(mQueue, 1, &submitInfo, VK_NULL_HANDLE), "vkQueueSubmit");
     VK_CHECK(vkQueueWaitIdle(mQueue), "vkQueueWaitIdle");
 
-    vkFreeCommandBuffers(mLogicalDevice, mCommandPool, 1, &copyImageCommand);
-    vkFreeMemory(mLogicalDevice, stagingBuffer.memory, nullptr);
-    vkDestroyBuffer(mLogicalDevice, stagingBuffer.buffer, nullptr);
+    vkFreeCommandBuffers(mLogicalDevice, mCommandPool, 1, &clearImageCommand);
 
     // View
     VkImageViewCreateInfo imageViewInfo = VulkanInit::image_view_create_info();
@@ -206,9 +144,10 @@ void TextOverlay::prepareResources(){
     samplerInfo.magFilter = VK_FILTER_LINEAR;
     samplerInfo.minFilter = VK_FILTER_LINEAR;
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    // Glyphs at the atlas border must not pick up distances from the other side
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
     samplerInfo.minLod = 0.0f;
@@ -265,11 +204,6 @@ void TextOverlay::prepareResources(){
 
     vkUpdateDescriptorSets(mLogicalDevice, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, NULL);
 
-    // Pipeline cache
-    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    VK_CHECK(vkCreatePipelineCache(mLogicalDevice, &pipelineCacheCreateInfo, nullptr, &mPipelineCache), "vkCreatePipelineCache");
-
 
 }
 
@@ -277,13 +211,8 @@ void TextOverlay::preparePipeline() {
 
     //Shader
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
-    std::string vertShaderPath = "shaders/text.vert.spv";
-    std::string fragShaderPath = "shaders/text.frag.spv";
-    auto vertShaderCode = VulkanHelper::readFile(vertShaderPath);
-    auto fragShaderCode = VulkanHelper::readFile(fragShaderPath);
-
-    shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, vertShaderCode, VK_SHADER_STAGE_VERTEX_BIT));
-    shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, fragShaderCode, VK_SHADER_STAGE_FRAGMENT_BIT));
+    shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, mVertSpirv, VK_SHADER_STAGE_VERTEX_BIT));
+    shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, mFragSpirv, VK_SHADER_STAGE_FRAGMENT_BIT));
 
 
     // Enable blending, using alpha from red channel of the font texture (see text.frag)
@@ -297,22 +226,23 @@ void TextOverlay::preparePipeline() {
     blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
+    // Each glyph instance is a 4 vertex strip, see text.vert
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = VulkanInit::pipeline_input_assembly_state_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, 0, VK_FALSE);
     VkPipelineRasterizationStateCreateInfo rasterizationState = VulkanInit::pipeline_rasterization_state_create_info(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
     VkPipelineColorBlendStateCreateInfo    colorBlendState = VulkanInit::pipeline_colorblend_state_create_info(1, &blendAttachmentState);
-    VkPipelineDepthStencilStateCreateInfo  depthStencilState = VulkanInit::pipeline_depthstencil_state_create_info(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+    // Drawn last in the scene's pass, always on top of it
+    VkPipelineDepthStencilStateCreateInfo  depthStencilState = VulkanInit::pipeline_depthstencil_state_create_info(VK_FALSE, VK_FALSE, VK_COMPARE_OP_ALWAYS);
     VkPipelineViewportStateCreateInfo      viewportState = VulkanInit::pipeline_viewport_state_create_Info(1, 1, 0);
-    VkPipelineMultisampleStateCreateInfo   multisampleState = VulkanInit::pipeline_multisample_state_create_info(VK_SAMPLE_COUNT_1_BIT, 0);
+    VkPipelineMultisampleStateCreateInfo   multisampleState = VulkanInit::pipeline_multisample_state_create_info(mSamples, 0);
     std::vector<VkDynamicState>            dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
     VkPipelineDynamicStateCreateInfo       dynamicState = VulkanInit::pipeline_dynamic_state_create_info(dynamicStateEnables);
 
     const std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
-        VulkanInit::vertex_input_binding_description(0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
-        VulkanInit::vertex_input_binding_description(1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
+        VulkanInit::vertex_input_binding_description(0, sizeof(Glyph), VK_VERTEX_INPUT_RATE_INSTANCE),
     };
     const std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-        VulkanInit::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),					// Location 0: Position
-        VulkanInit::vertex_input_attribute_description(1, 1, VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2)),	// Location 1: UV
+        VulkanInit::vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Glyph, rect)),	// Location 0: Quad
+        VulkanInit::vertex_input_attribute_description(0, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Glyph, uv)),	// Location 1: UV rect
     };
 
     VkPipelineVertexInputStateCreateInfo vertexInputState = VulkanInit::pipeline_vertex_input_state_create_info(vertexInputBindings, vertexInputAttributes);
@@ -345,7 +275,7 @@ void TextOverlay::preparePipeline() {
         VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
 
     pipeline_rendering_create_info.colorAttachmentCount = 1;
-    pipeline_rendering_create_info.pColorAttachmentFormats = &mSwapChainImageFormat;
+    pipeline_rendering_create_info.pColorAttachmentFormats = &mColorFormat;
 
     pipeline_rendering_create_info.depthAttachmentFormat =
         VulkanHelper::findSupportedFormat(
@@ -361,24 +291,90 @@ void TextOverlay::preparePipeline() {
 
     VK_CHECK(vkCreateGraphicsPipelines(mLogicalDevice, mPipelineCache, 1, &pipelineCreateInfo, nullptr, &mPipeline), "vkCreateGraphicsPipelines");
 
+    // The pipeline keeps what it needs, it's made again on a reload
+    for (const VkPipelineShaderStageCreateInfo &stage : shaderStages) {
+        vkDestroyShaderModule(mLogicalDevice, stage.module, nullptr);
+    }
 
 }
 
 
-// Map buffer
+void TextOverlay::createGlyphBuffer()
+{
+    // Room to restage the whole atlas, usually only a few glyphs are
+    mStagingOffset = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(Glyph) + sizeof(VkDrawIndirectCommand);
+    mGlyphSlotSize = mStagingOffset + mBitmapWidth * mBitmapHeight;
+    VkDeviceSize bufferSize = mGlyphSlotSize * mImageCount;
+    VulkanHelper::createBuffer(mPhysicalDevice, mLogicalDevice, bufferSize,
+                               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                               &mGlyphBuffer, &mGlyphBufferMemory);
+
+    void *glyphData;
+    VK_CHECK(vkMapMemory(mLogicalDevice, mGlyphBufferMemory, 0, VK_WHOLE_SIZE, 0, &glyphData), "vkMapMemory");
+    mMappedGlyphBuffer = static_cast<uint8_t *>(glyphData);
+
+    for (size_t slot = 0; slot < mImageCount; slot++) {
+        auto *drawCommand = reinterpret_cast<VkDrawIndirectCommand *>(
+            mMappedGlyphBuffer + slotOffset((uint32_t)slot) + TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(Glyph));
+        // A quad per instance, see text.vert
+        drawCommand->vertexCount = 4;
+        drawCommand->instanceCount = 0;
+        drawCommand->firstVertex = 0;
+        drawCommand->firstInstance = 0;
+    }
+}
+
+void TextOverlay::destroyGlyphBuffer()
+{
+    if (mGlyphBuffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(mLogicalDevice, mGlyphBufferMemory);
+        vkDestroyBuffer(mLogicalDevice, mGlyphBuffer, nullptr);
+        vkFreeMemory(mLogicalDevice, mGlyphBufferMemory, nullptr);
+    }
+    mGlyphBuffer = VK_NULL_HANDLE;
+    mGlyphBufferMemory = VK_NULL_HANDLE;
+    mMappedGlyphBuffer = nullptr;
+}
+
+// Starts the text over, nothing the GPU reads is touched until prepareFrame()
 void TextOverlay::beginTextUpdate()
 {
-    VK_CHECK(vkMapMemory(mLogicalDevice, mVertexBufferMemory, 0, VK_WHOLE_SIZE, 0, (void **)&mMappedVertexBufferMemory), "vkMapMemory");
     mNumLetters = 0;
+    // Glyphs of the last text can be evicted again if they aren't used
+    mGlyphCache.beginFrame();
+
+    for (auto cached = mRunCache.begin(); cached != mRunCache.end();) {
+        if (cached->second.lastUsed < mTextFrame) {
+            mGlyphCache.releaseRun(cached->second.run);
+            cached = mRunCache.erase(cached);
+        } else {
+            ++cached;
+        }
+    }
+    mTextFrame++;
 }
 
-// Add text to the current buffer
-void TextOverlay::addText(std::string text, float x, float y, TextAlign align)
+// Add text to the current buffer, laid out again only if the string wasn't
+// drawn last frame or some of its chars didn't fit in the atlas yet
+void TextOverlay::addText(std::string_view text, float x, float y, TextAlign align, float scale)
 {
-    assert(mMappedVertexBufferMemory != nullptr);
+    CachedRun &cached = mRunCache[std::hash<std::string_view>()(text)];
+    // Chars the atlas had no room for are tried again until they fit
+    if (cached.lastUsed == 0 || cached.text != text || cached.run.missing > 0) {
+        cached.text.assign(text);
+        mGlyphCache.layout(text, cached.run);
+    }
+    cached.lastUsed = mTextFrame;
+    emitRun(cached.run, x, y, align, scale);
+}
 
-    const float charW = 1.5f * mScale / mSwapChainExtent.width;
-    const float charH = 1.5f * mScale / mSwapChainExtent.height;
+void TextOverlay::emitRun(const VulkanEngine::TextRun &run, float x, float y, uint32_t align, float scale)
+{
+    // The run is in pixels at mSdfGlyphSize
+    const float glyphScale = mScale * scale * mFontSize / mSdfGlyphSize;
+    const float charW = 1.5f * glyphScale / mSwapChainExtent.width;
+    const float charH = 1.5f * glyphScale / mSwapChainExtent.height;
 
     float fbW = (float)mSwapChainExtent.width;
     float fbH = (float)mSwapChainExtent.height;
@@ -387,201 +383,204 @@ void TextOverlay::addText(std::string text, float x, float y, TextAlign align)
     x = (x / fbW * 2.0f) - 1.0f;
     y = (y / fbH * 2.0f) - 1.0f;
 
-    // Calculate text width
-    float textWidth = 0;
-    float maxYoff = 0;
-    for (auto letter : text)
-    {
-        // stbtt_bakedchar *charData = &mCharData[(uint32_t)letter - mFirstChar];
-        stbtt_packedchar  *charData = &mCharData[(uint32_t)letter - mFirstChar];
-        textWidth += charData->xadvance * charW;
-
-        float yOff = std::abs(charData->yoff * charH);
-        if(yOff > maxYoff) {
-            maxYoff = yOff;
-        }
-    }
-
-    y += maxYoff;
+    // y is the top of the text
+    y += run.ascent * charH;
 
     switch (align)
     {
         case alignRight:
-            x -= textWidth;
+            x -= run.width * charW;
             break;
         case alignCenter:
-            x -= textWidth / 2.0f;
+            x -= run.width * charW / 2.0f;
             break;
         case alignLeft:
             break;
     }
 
-    // Generate a uv mapped quad per char in the new text
-    int i = 0;
-    for (int i = 0; i < text.length(); i++)
+    const float atlasU = 1.0f / mGlyphCache.atlasWidth();
+    const float atlasV = 1.0f / mGlyphCache.atlasHeight();
+    for (const VulkanEngine::TextRun::Quad &quad : run.quads)
     {
-        char letter = text[i];
-        // stbtt_bakedchar *charData = &mCharData[(uint32_t)letter - mFirstChar];
-        stbtt_packedchar  *charData = &mCharData[(uint32_t)letter - mFirstChar];
-
-        // std::cout << "=======================================Letter:" << letter << ":" << (uint32_t)letter << "===========\n";
-        // std::cout << "xoff: " << charData->xoff << " yoff:" << charData->yoff << "\n";
-
-        // XY coordinates for character
-        // Top left, Top right
-        float x0 = x + (charData->xoff * charW);
-        float x1 = x + (charData->x1 - charData->x0 + charData->xoff) * charW;
-        // std::cout << "x0: " << x0 << " x1:" << x1 << "\n";
-
-        float y0 = y + (charData->yoff * charH);
-        float y1 = y + (charData->y1 - charData->y0 + charData->yoff) * charH;
-        //  std::cout << "y0: " << y0 << " y1:" << y1 << "\n";
-
-        // UV coordinates for character
-        float z0 = VulkanHelper::convertCoordinate(0,mBitmapWidth,0,1, charData->x0);
-        float z1 = VulkanHelper::convertCoordinate(0,mBitmapWidth,0,1, charData->x1);
-
-        float w0 = VulkanHelper::convertCoordinate(0,mBitmapHeight,0,1, charData->y0);
-        float w1 = VulkanHelper::convertCoordinate(0,mBitmapHeight,0,1, charData->y1);
-
-        // // render full font bitmap atlas
-        // float x0 = -1.0f;
-        // float x1 = 1.0f;
-
-        // float y0 = -1.0f;
-        // float y1 = 1.0f;
-
-        // float z0 = 0.0f;
-        // float z1 = 1.0f;
-
-        // float w0 = 0.0;
-        // float w1 = 1.0f;
-
-        // 4 vertices per quad, able to do this to draw two triangles due to 
-        // VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP mode in VkPipelineInputAssemblyStateCreateInfo
-        // the second and third vertex of every triangle are used as first two vertices of the next triangle
-        // Z pattern of drawing due to the way primitives are assembled via:
-        //pi = {vi, v(i+(1+i%2)), v(i+(2-i%2))}
-        //p0 = {v0, v(0 + (1 + 0 % 2), v(0 + (2 - 0 % 2))}
-        //p0 = {v0, v1, v2}
-
-        //p1 = {v1, v(1 + (1 + 1 % 2)), v(1 + (2 - 1 % 2))}
-        //p1 = {v1, v3, v2}
-
-        //   0 ------ 1
-        //   |        |
-        //   3 ------ 2
-        //so z pattern achieved via {0, 1, 3, 2};
-        //v0 = 0
-        //v1 = 1
-        //v2 = 3
-        //v3 = 2
-
-        //p0 = {v0, v1, v2} == {0, 1, 3}
-        //p1 = {v1, v3, v2} == {1, 2, 3}
-
-        //Two Clockwise triangles
-
-        //Top left
-        mMappedVertexBufferMemory->x = x0;
-        mMappedVertexBufferMemory->y = y0;
-        mMappedVertexBufferMemory->z = z0;
-        mMappedVertexBufferMemory->w = w0;
-        mMappedVertexBufferMemory++; 
-
-        //Top right
-        mMappedVertexBufferMemory->x = x1;
-        mMappedVertexBufferMemory->y = y0;
-        mMappedVertexBufferMemory->z = z1;
-        mMappedVertexBufferMemory->w = w0;
-        mMappedVertexBufferMemory++; 
-
-        //Bottom left
-        mMappedVertexBufferMemory->x = x0;
-        mMappedVertexBufferMemory->y = y1;
-        mMappedVertexBufferMemory->z = z0;
-        mMappedVertexBufferMemory->w = w1;
-        mMappedVertexBufferMemory++; 
-
-        //Bottom right
-        mMappedVertexBufferMemory->x = x1;
-        mMappedVertexBufferMemory->y = y1;
-        mMappedVertexBufferMemory->z = z1;
-        mMappedVertexBufferMemory->w = w1;
-        mMappedVertexBufferMemory++; 
-
-        // Advance the x val
-        x += charData->xadvance * charW;
-
+        if (mNumLetters == TEXTOVERLAY_MAX_CHAR_COUNT) {
+            break;
+        }
+        Glyph &glyph = mGlyphs[mNumLetters];
+        glyph.rect = glm::vec4(x + quad.x0 * charW, y + quad.y0 * charH, x + quad.x1 * charW, y + quad.y1 * charH);
+        glyph.uv = glm::vec4(quad.u0 * atlasU, quad.v0 * atlasV, quad.u1 * atlasU, quad.v1 * atlasV);
         mNumLetters++;
+    }
+}
 
-        // return;
+TextOverlay::TextHandle TextOverlay::createText(float x, float y, TextAlign align, float scale)
+{
+    TextHandle handle;
+    if (!mFreeTexts.empty()) {
+        handle = mFreeTexts.back();
+        mFreeTexts.pop_back();
+    } else {
+        handle = (TextHandle)mTexts.size();
+        mTexts.emplace_back();
     }
+    Text &text = mTexts[handle];
+    text.x = x;
+    text.y = y;
+    text.align = align;
+    text.scale = scale;
+    text.alive = true;
+    return handle;
+}
+
+void TextOverlay::setText(TextHandle handle, std::string_view text)
+{
+    mGlyphCache.layout(text, mTexts[handle].run);
 }
 
-// Unmap buffer and update command buffers
-void TextOverlay::endTextUpdate()
+void TextOverlay::destroyText(TextHandle handle)
 {
-    vkUnmapMemory(mLogicalDevice, mVertexBufferMemory);
-    mMappedVertexBufferMemory = nullptr;
-    updateCommandBuffers();
+    mGlyphCache.releaseRun(mTexts[handle].run);
+    mTexts[handle].alive = false;
+    mFreeTexts.push_back(handle);
 }
 
-// Needs to be called by the application
-void TextOverlay::updateCommandBuffers()
+void TextOverlay::addRect(float x0, float y0, float x1, float y1)
 {
-    VkCommandBufferBeginInfo beginInfo = VulkanInit::command_buffer_begin_info();
+    if (mNumLetters == TEXTOVERLAY_MAX_CHAR_COUNT) {
+        return;
+    }
+    float fbW = (float)mSwapChainExtent.width;
+    float fbH = (float)mSwapChainExtent.height;
+    Glyph &glyph = mGlyphs[mNumLetters];
+    glyph.rect = glm::vec4(x0 / fbW * 2.0f - 1.0f, y0 / fbH * 2.0f - 1.0f, x1 / fbW * 2.0f - 1.0f, y1 / fbH * 2.0f - 1.0f);
+    // Every corner samples the same texel
+    glyph.uv = glm::vec4(mSolidUV, mSolidUV);
+    mNumLetters++;
+}
 
-    for (int32_t i = 0; i < mCommandBuffers.size(); ++i)
-    {
+void TextOverlay::prepareFrame(uint32_t imageIndex, VkCommandBuffer commandBuffer)
+{
+    TRACE_ZONE("TextOverlay::prepareFrame");
+    // The persistent text goes after this frame's addText() glyphs and is
+    // taken off again, it's emitted anew every frame
+    uint32_t addedLetters = mNumLetters;
+    for (const Text &text : mTexts) {
+        if (text.alive) {
+            emitRun(text.run, text.x, text.y, text.align, text.scale);
+        }
+    }
+
+    uint8_t *slot = mMappedGlyphBuffer + slotOffset(imageIndex);
+    memcpy(slot, mGlyphs.data(), mNumLetters * sizeof(Glyph));
+    auto *drawCommand = reinterpret_cast<VkDrawIndirectCommand *>(slot + TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(Glyph));
+    drawCommand->instanceCount = mNumLetters;
+    mNumLetters = addedLetters;
+
+    recordAtlasUpload(commandBuffer, imageIndex);
+}
 
-        vkBeginCommandBuffer(mCommandBuffers[i], &beginInfo);
-
-        VkRenderingAttachmentInfoKHR renderingColorAttachmentInfo{};
-        renderingColorAttachmentInfo.sType =
-            VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-        renderingColorAttachmentInfo.imageView =
-            mSwapChainImageViews[i];
-        renderingColorAttachmentInfo.imageLayout =
-            VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
-        renderingColorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        renderingColorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderingColorAttachmentInfo.clearValue = clearColor;
-
-        VkRenderingInfoKHR renderingInfo{};
-        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
-        renderingInfo.renderArea.offset = {0, 0};
-        renderingInfo.renderArea.extent = mSwapChainExtent;
-        renderingInfo.layerCount = 1;
-        renderingInfo.colorAttachmentCount = 1;
-        renderingInfo.pColorAttachments = &renderingColorAttachmentInfo;
-        // dynamic rendering end
-        //===============================================================
-
-        vkCmdBeginRendering(mCommandBuffers[i], &renderingInfo);
-
-        VkViewport viewport = VulkanInit::viewport((float)mSwapChainExtent.width, (float)mSwapChainExtent.height, 0.0f, 1.0f);
-        vkCmdSetViewport(mCommandBuffers[i], 0, 1, &viewport);
-
-        VkRect2D scissor = VulkanInit::rect2D(mSwapChainExtent.width, mSwapChainExtent.height, 0, 0);
-        vkCmdSetScissor(mCommandBuffers[i], 0, 1, &scissor);
-
-        vkCmdBindPipeline(mCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mPipeline);
-        vkCmdBindDescriptorSets(mCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet, 0, NULL);
-
-        VkDeviceSize offsets = 0;
-        //First two is pos, second two is uv, so it renders 4
-        vkCmdBindVertexBuffers(mCommandBuffers[i], 0, 1, &mVertexBuffer, &offsets);
-        vkCmdBindVertexBuffers(mCommandBuffers[i], 1, 1, &mVertexBuffer, &offsets);
-        for (uint32_t j = 0; j < mNumLetters; j++)
-        {
-            vkCmdDraw(mCommandBuffers[i], 4, 1, j * 4, 0);
+void TextOverlay::recordAtlasUpload(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    const std::vector<VulkanEngine::GlyphCache::Upload> &uploads = mGlyphCache.pendingUploads();
+
+    // Whatever doesn't fit waits for the next frame
+    const std::vector<uint8_t> &data = mGlyphCache.pendingData();
+    VkDeviceSize stagingSize = mGlyphSlotSize - mStagingOffset;
+    VkDeviceSize stagingStart = slotOffset(imageIndex) + mStagingOffset;
+    std::vector<VkBufferImageCopy> regions;
+    for (const VulkanEngine::GlyphCache::Upload &upload : uploads) {
+        if (upload.offset + upload.width * upload.height > stagingSize) {
+            break;
         }
+        VkBufferImageCopy region = {};
+        region.bufferOffset = stagingStart + upload.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {(int32_t)upload.x, (int32_t)upload.y, 0};
+        region.imageExtent = {upload.width, upload.height, 1};
+        regions.push_back(region);
+    }
+    if (regions.empty()) {
+        return;
+    }
+    size_t dataSize = regions.size() < uploads.size() ? uploads[regions.size()].offset : data.size();
+    memcpy(mMappedGlyphBuffer + stagingStart, data.data(), dataSize);
+    mGlyphCache.clearUploads(regions.size());
 
-        vkCmdEndRendering(mCommandBuffers[i]);
+    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    // Frames submitted earlier may still be sampling the regions being replaced
+    VulkanHelper::setImageLayout(
+        commandBuffer,
+        mImage,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        subresourceRange,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT);
+    vkCmdCopyBufferToImage(commandBuffer, mGlyphBuffer, mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           (uint32_t)regions.size(), regions.data());
+    VulkanHelper::setImageLayout(
+        commandBuffer,
+        mImage,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        subresourceRange,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+void TextOverlay::resize(uint32_t imageCount, VkFormat colorFormat, VkExtent2D swapChainExtent)
+{
+    if (colorFormat != mColorFormat) {
+        mColorFormat = colorFormat;
+        vkDestroyPipeline(mLogicalDevice, mPipeline, nullptr);
+        preparePipeline();
+    }
+    // The text keeps its pixel position, it's placed again every frame
+    mSwapChainExtent = swapChainExtent;
 
-        VK_CHECK(vkEndCommandBuffer(mCommandBuffers[i]), "vkEndCommandBuffer");
+    if (imageCount != mImageCount) {
+        mImageCount = imageCount;
+        // Nothing is in flight while the swapchain is recreated
+        destroyGlyphBuffer();
+        createGlyphBuffer();
     }
 }
+
+void TextOverlay::reloadShaders(const std::vector<char> &vertSpirv, const std::vector<char> &fragSpirv)
+{
+    mVertSpirv = vertSpirv;
+    mFragSpirv = fragSpirv;
+    vkDestroyPipeline(mLogicalDevice, mPipeline, nullptr);
+    preparePipeline();
+}
+
+void TextOverlay::draw(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    VkViewport viewport = VulkanInit::viewport((float)mSwapChainExtent.width, (float)mSwapChainExtent.height, 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor = VulkanInit::rect2D(mSwapChainExtent.width, mSwapChainExtent.height, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet, 0, NULL);
+
+    // Every glyph in one instanced draw, the instance count is read from
+    // the buffer when the GPU gets here
+    VkDeviceSize offsets = slotOffset(imageIndex);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mGlyphBuffer, &offsets);
+    vkCmdDrawIndirect(commandBuffer, mGlyphBuffer, offsets + TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(Glyph), 1, sizeof(VkDrawIndirectCommand));
+}
+
+const VkDrawIndirectCommand &TextOverlay::slotDrawCommand(uint32_t imageIndex) const
+{
+    const uint8_t *slot = mMappedGlyphBuffer + slotOffset(imageIndex);
+    return *reinterpret_cast<const VkDrawIndirectCommand *>(slot + TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(Glyph));
+}
+
+glm::vec4 TextOverlay::slotGlyphRect(uint32_t imageIndex, uint32_t glyph) const
+{
+    const uint8_t *slot = mMappedGlyphBuffer + slotOffset(imageIndex);
+    return reinterpret_cast<const Glyph *>(slot)[glyph].rect;
+}
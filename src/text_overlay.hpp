@@ -4,28 +4,42 @@
 
 #include <vulkan_helper.hpp>
 #include <vulkan_initializers.hpp>
+#include <glyph_cache.hpp>
+#include <trace.hpp>
+#include <text_buffer.hpp>
 #include <filesystem>
-
-#define STB_TRUETYPE_IMPLEMENTATION
-#define STBTT_STATIC
-#include "stb_truetype.h"
+#include <string_view>
 
 #define TEXTOVERLAY_MAX_CHAR_COUNT 2048
+
 class TextOverlay {
     private:
         //Required to pass in
         VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
         VkDevice mLogicalDevice;
         uint32_t mGraphicsFamilyIndex;
-        std::vector<VkImageView> mSwapChainImageViews;
-        VkFormat mSwapChainImageFormat;
+        uint32_t mImageCount;
+        // The overlay is drawn into the renderer's multisampled color target,
+        // which has its own format, not the swapchain's
+        VkFormat mColorFormat;
+        VkSampleCountFlagBits mSamples;
         VkExtent2D mSwapChainExtent;
         VkQueue mQueue;
 
         //Created by object
         VkCommandPool mCommandPool;
-        VkBuffer mVertexBuffer;
-        VkDeviceMemory mVertexBufferMemory;
+        // A slot per swapchain image, each TEXTOVERLAY_MAX_CHAR_COUNT glyph
+        // instances followed by the VkDrawIndirectCommand that draws them, so
+        // the draw doesn't depend on the text. A slot is only written once the
+        // GPU is done with the last frame that used it
+        VkBuffer mGlyphBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory mGlyphBufferMemory = VK_NULL_HANDLE;
+        VkDeviceSize mGlyphSlotSize = 0;
+        // Persistently mapped
+        uint8_t *mMappedGlyphBuffer = nullptr;
+        // Each slot ends with staging space for the atlas regions that
+        // changed, copied into mImage at the start of the frame
+        VkDeviceSize mStagingOffset = 0;
 
         //Vulkan Image
 	      VkImage mImage;
@@ -38,44 +52,120 @@ class TextOverlay {
 	      VkDescriptorSet mDescriptorSet;
 
         VkPipelineLayout mPipelineLayout;
+	      // Shared with the renderer, not owned
 	      VkPipelineCache mPipelineCache;
 	      VkPipeline mPipeline;
-
-        // Pointer to mapped vertex buffer
-        // Pointer to mapped vertex buffer
-	      glm::vec4 *mMappedVertexBufferMemory = nullptr;
-        uint32_t mNumLetters;
+        // text.vert and text.frag, kept for rebuilding the pipeline
+        std::vector<char> mVertSpirv;
+        std::vector<char> mFragSpirv;
+
+        struct Glyph {
+            // x0, y0, x1, y1 in normalized device coordinates
+            glm::vec4 rect;
+            // u0, v0, u1, v1 in the font atlas
+            glm::vec4 uv;
+        };
+        // The text being built, copied into a slot by prepareFrame()
+        std::vector<Glyph> mGlyphs;
+        uint32_t mNumLetters = 0;
         float mScale = 1.0f;
-
-        static const int mBitmapHeight = 720;
-        static const int mBitmapWidth = 1280;
-
+        // Center of the solid block reserved in the atlas for addRect()
+        glm::vec2 mSolidUV = glm::vec2(0.0f);
+
+        // Signed distance field atlas, the glyphs are rendered at mSdfGlyphSize
+        // and scaled to any size in text.frag without blurring. Filled by
+        // mGlyphCache as new characters show up
+        static const int mBitmapHeight = 512;
+        static const int mBitmapWidth = 512;
+        const float mSdfGlyphSize = 32.0f;
+        // Distance in atlas pixels from the edge to where the field saturates
+        const int mSdfPadding = 4;
+
+        // Text size at scale 1
         const float mFontSize = 64.0f;
-        const int mFirstChar = 32;
-        const int mNumChar = 96;
-
-        unsigned char mTTF_buffer[1<<20];
 
-        // For using with stbtt_BakeFontBitmap
-        // stbtt_bakedchar mCharData[96]; // ASCII 32..126 is 95 glyphs
-
-        // For using with stbtt_PackFontRange
-        stbtt_packedchar mCharData[96];
+        // Atlas rect and metrics of each glyph, in pixels at mSdfGlyphSize
+        VulkanEngine::GlyphCache mGlyphCache;
+
+        // Layouts of the strings passed to addText(), dropped when a frame
+        // goes by without them. Keyed by the hash of the string so looking
+        // one up doesn't copy it, text tells collisions apart
+        struct CachedRun {
+            std::string text;
+            VulkanEngine::TextRun run;
+            uint64_t lastUsed;
+        };
+        std::unordered_map<size_t, CachedRun> mRunCache;
+        uint64_t mTextFrame = 1;
+
+        // Text made with createText(), drawn every frame until destroyed
+        struct Text {
+            VulkanEngine::TextRun run;
+            float x, y;
+            uint32_t align;
+            float scale;
+            bool alive;
+        };
+        std::vector<Text> mTexts;
+        std::vector<uint32_t> mFreeTexts;
+
+        // Appends the glyph instances of run at pixel position x, y
+        void emitRun(const VulkanEngine::TextRun &run, float x, float y, uint32_t align, float scale);
+
+        // Records the copy of as many pending atlas regions as fit into the
+        // staging space of imageIndex
+        void recordAtlasUpload(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
     public:
         enum TextAlign { alignLeft, alignCenter, alignRight };
-        std::vector<VkCommandBuffer> mCommandBuffers;
+        typedef uint32_t TextHandle;
 
 
-        TextOverlay(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t graphicsFamilyIndex, std::vector<VkImageView> swapChainImageViews, VkFormat swapChainImageFormat, VkExtent2D swapChainExtent, VkQueue queue);
+        // vertSpirv and fragSpirv are text.vert and text.frag, from the
+        // renderer's ShaderManager
+        TextOverlay(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t graphicsFamilyIndex, uint32_t imageCount, VkFormat colorFormat, VkSampleCountFlagBits samples, VkExtent2D swapChainExtent, VkQueue queue, VkPipelineCache pipelineCache,
+                    const std::vector<char> &vertSpirv, const std::vector<char> &fragSpirv);
         ~TextOverlay();
 
         void prepareResources();
         void preparePipeline();
+        void createGlyphBuffer();
+        void destroyGlyphBuffer();
 
+        // Starts the frame's text over. What's added after it is handed to the
+        // GPU in prepareFrame(), there's nothing to end the update with
         void beginTextUpdate();
-        void addText(std::string text, float x, float y, TextAlign align);
-        void endTextUpdate();
-
-        void updateCommandBuffers();
+        // text is UTF-8, characters the font doesn't have show as its missing
+        // glyph box. scale multiplies mFontSize, the same atlas serves every size
+        void addText(std::string_view text, float x, float y, TextAlign align, float scale = 1.0f);
+        // Solid rect in pixels, drawn with the text in the same draw
+        void addRect(float x0, float y0, float x1, float y1);
+
+        // Persistent text, only laid out again from the first char that
+        // changed when setText() gets a different string
+        TextHandle createText(float x, float y, TextAlign align, float scale = 1.0f);
+        void setText(TextHandle handle, std::string_view text);
+        void destroyText(TextHandle handle);
+
+        // Copies the current text into the glyph slot of imageIndex and records
+        // the upload of newly rasterized glyphs into commandBuffer, which must
+        // be outside of rendering. The last submission of that image has to be
+        // finished
+        void prepareFrame(uint32_t imageIndex, VkCommandBuffer commandBuffer);
+        // Draws the text of prepareFrame() inside the renderer's rendering
+        // scope, so the overlay costs no extra pass over the swapchain image
+        void draw(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+        // The slot of imageIndex as prepareFrame() left it, what the next
+        // draw() of that image reads
+        VkDeviceSize slotOffset(uint32_t imageIndex) const { return imageIndex * mGlyphSlotSize; }
+        const VkDrawIndirectCommand &slotDrawCommand(uint32_t imageIndex) const;
+        // x0, y0, x1, y1 in normalized device coordinates
+        glm::vec4 slotGlyphRect(uint32_t imageIndex, uint32_t glyph) const;
+
+        // Call after the swapchain was recreated, the font and pipeline are kept
+        // unless the format changed
+        void resize(uint32_t imageCount, VkFormat colorFormat, VkExtent2D swapChainExtent);
+        // Hot reload, nothing drawn with the old pipeline may be in flight
+        void reloadShaders(const std::vector<char> &vertSpirv, const std::vector<char> &fragSpirv);
 };
@@ -0,0 +1,477 @@
+#include "texture_compression.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace TextureCompression {
+
+namespace {
+
+struct Texel {
+  int c[4];
+};
+
+// Gathers a 4x4 block, clamping at the image edges
+void fetchBlock(const uint8_t *rgba, uint32_t width, uint32_t height,
+                uint32_t blockX, uint32_t blockY, Texel block[16]) {
+  for (uint32_t y = 0; y < 4; y++) {
+    uint32_t py = std::min(blockY * 4 + y, height - 1);
+    for (uint32_t x = 0; x < 4; x++) {
+      uint32_t px = std::min(blockX * 4 + x, width - 1);
+      const uint8_t *texel = rgba + (static_cast<size_t>(py) * width + px) * 4;
+      for (int c = 0; c < 4; c++) {
+        block[y * 4 + x].c[c] = texel[c];
+      }
+    }
+  }
+}
+
+// Writes a decoded 4x4 block, dropping texels outside of the image
+void storeBlock(uint8_t *rgba, uint32_t width, uint32_t height,
+                uint32_t blockX, uint32_t blockY, const uint8_t block[16][4]) {
+  for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+    for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+      uint8_t *texel = rgba + (static_cast<size_t>(blockY * 4 + y) * width + blockX * 4 + x) * 4;
+      memcpy(texel, block[y * 4 + x], 4);
+    }
+  }
+}
+
+int distanceSquared(const int *a, const int *b, int channels) {
+  int sum = 0;
+  for (int c = 0; c < channels; c++) {
+    int d = a[c] - b[c];
+    sum += d * d;
+  }
+  return sum;
+}
+
+// Bounding box endpoints of the first `channels` channels. The box diagonal
+// is flipped per channel so it follows the direction the colours vary in,
+// which is a cheap approximation of the principal axis.
+void boundingBoxEndpoints(const Texel block[16], int channels, int e0[4], int e1[4]) {
+  int mean[4] = {0, 0, 0, 0};
+  int minValue[4] = {255, 255, 255, 255};
+  int maxValue[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < channels; c++) {
+      mean[c] += block[i].c[c];
+      minValue[c] = std::min(minValue[c], block[i].c[c]);
+      maxValue[c] = std::max(maxValue[c], block[i].c[c]);
+    }
+  }
+
+  // Covariance of each channel against the first one
+  int covariance[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    int d0 = block[i].c[0] * 16 - mean[0];
+    for (int c = 1; c < channels; c++) {
+      covariance[c] += d0 * (block[i].c[c] * 16 - mean[c]);
+    }
+  }
+
+  for (int c = 0; c < channels; c++) {
+    // Inset the box a bit, the extremes are rarely hit exactly
+    int inset = (maxValue[c] - minValue[c]) / 16;
+    e0[c] = maxValue[c] - inset;
+    e1[c] = minValue[c] + inset;
+    if (covariance[c] < 0) {
+      std::swap(e0[c], e1[c]);
+    }
+  }
+}
+
+//===================================================
+// BC1 colour block, also used by BC3
+
+uint16_t packRGB565(const int *color) {
+  int r = (color[0] * 31 + 127) / 255;
+  int g = (color[1] * 63 + 127) / 255;
+  int b = (color[2] * 31 + 127) / 255;
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int *color) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+  color[3] = 255;
+}
+
+// fourColor is always used for BC3, which ignores the endpoint order
+void colorPalette(uint16_t c0, uint16_t c1, bool fourColor, int palette[4][4]) {
+  unpackRGB565(c0, palette[0]);
+  unpackRGB565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    if (fourColor) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = fourColor ? 255 : 0;
+}
+
+void encodeColorBlock(const Texel block[16], bool allowTransparent, uint8_t *out) {
+  bool transparent = false;
+  if (allowTransparent) {
+    for (int i = 0; i < 16; i++) {
+      transparent |= block[i].c[3] < 128;
+    }
+  }
+
+  int e0[4], e1[4];
+  boundingBoxEndpoints(block, 3, e0, e1);
+  uint16_t c0 = packRGB565(e0);
+  uint16_t c1 = packRGB565(e1);
+
+  // The endpoint order selects the mode, c0 > c1 is four colours and
+  // c0 <= c1 is three colours plus transparent black
+  if ((c0 < c1) != transparent) {
+    std::swap(c0, c1);
+  }
+  bool fourColor = !transparent && c0 != c1;
+
+  int palette[4][4];
+  colorPalette(c0, c1, fourColor || !allowTransparent, palette);
+
+  uint32_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    uint32_t best = 0;
+    if (transparent && block[i].c[3] < 128) {
+      best = 3;
+    } else {
+      int bestError = distanceSquared(block[i].c, palette[0], 3);
+      uint32_t candidates = fourColor ? 4 : 3;
+      for (uint32_t p = 1; p < candidates; p++) {
+        int error = distanceSquared(block[i].c, palette[p], 3);
+        if (error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+    }
+    indices |= best << (i * 2);
+  }
+
+  out[0] = c0 & 0xFF;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xFF;
+  out[3] = c1 >> 8;
+  for (int i = 0; i < 4; i++) {
+    out[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+void decodeColorBlock(const uint8_t *in, bool alwaysFourColor, uint8_t block[16][4]) {
+  uint16_t c0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+  uint16_t c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+  int palette[4][4];
+  colorPalette(c0, c1, alwaysFourColor || c0 > c1, palette);
+
+  uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+  for (int i = 0; i < 16; i++) {
+    const int *color = palette[(indices >> (i * 2)) & 3];
+    for (int c = 0; c < 4; c++) {
+      block[i][c] = static_cast<uint8_t>(color[c]);
+    }
+  }
+}
+
+//===================================================
+// Single channel block (BC4), used for the BC3 alpha and both BC5 channels
+
+void singleChannelPalette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 2; i < 8; i++) {
+      palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+  } else {
+    for (int i = 2; i < 6; i++) {
+      palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encodeSingleChannelBlock(const Texel block[16], int channel, uint8_t *out) {
+  int minValue = 255;
+  int maxValue = 0;
+  for (int i = 0; i < 16; i++) {
+    minValue = std::min(minValue, block[i].c[channel]);
+    maxValue = std::max(maxValue, block[i].c[channel]);
+  }
+
+  // a0 > a1 gives the 8 value mode, with a flat block every index is 0 anyway
+  int palette[8];
+  singleChannelPalette(maxValue, minValue, palette);
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    uint64_t best = 0;
+    int bestError = 256;
+    for (int p = 0; p < 8; p++) {
+      int error = std::abs(block[i].c[channel] - palette[p]);
+      if (error < bestError) {
+        bestError = error;
+        best = p;
+      }
+    }
+    indices |= best << (i * 3);
+  }
+
+  out[0] = static_cast<uint8_t>(maxValue);
+  out[1] = static_cast<uint8_t>(minValue);
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+void decodeSingleChannelBlock(const uint8_t *in, int channel, uint8_t block[16][4]) {
+  int palette[8];
+  singleChannelPalette(in[0], in[1], palette);
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; i++) {
+    indices |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+  }
+  for (int i = 0; i < 16; i++) {
+    block[i][channel] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+  }
+}
+
+//===================================================
+// BC7 mode 6: one subset, 7 bit RGBA endpoints with a p-bit each, 4 bit
+// indices
+
+const int kBC7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct BitWriter {
+  uint8_t *data;
+  uint32_t position = 0;
+
+  void write(uint32_t value, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, position++) {
+      if ((value >> i) & 1) {
+        data[position / 8] |= static_cast<uint8_t>(1 << (position % 8));
+      }
+    }
+  }
+};
+
+struct BitReader {
+  const uint8_t *data;
+  uint32_t position = 0;
+
+  uint32_t read(uint32_t count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; i++, position++) {
+      value |= ((data[position / 8] >> (position % 8)) & 1u) << i;
+    }
+    return value;
+  }
+};
+
+int bc7Interpolate(int e0, int e1, int index) {
+  return ((64 - kBC7Weights4[index]) * e0 + kBC7Weights4[index] * e1 + 32) >> 6;
+}
+
+// Quantizes an endpoint to 7 bits + shared p-bit, picking the p-bit that
+// lands closest to the original colour
+void quantizeBC7Endpoint(const int *color, int quantized[4], int &pBit, int decoded[4]) {
+  int bestError = -1;
+  for (int p = 0; p < 2; p++) {
+    int candidate[4];
+    int candidateDecoded[4];
+    for (int c = 0; c < 4; c++) {
+      candidate[c] = std::min(127, std::max(0, (color[c] - p + 1) >> 1));
+      candidateDecoded[c] = (candidate[c] << 1) | p;
+    }
+    int error = distanceSquared(color, candidateDecoded, 4);
+    if (bestError < 0 || error < bestError) {
+      bestError = error;
+      pBit = p;
+      memcpy(quantized, candidate, sizeof(candidate));
+      memcpy(decoded, candidateDecoded, sizeof(candidateDecoded));
+    }
+  }
+}
+
+void encodeBC7Block(const Texel block[16], uint8_t *out) {
+  int e[2][4];
+  boundingBoxEndpoints(block, 4, e[0], e[1]);
+
+  int quantized[2][4];
+  int decoded[2][4];
+  int pBits[2];
+  quantizeBC7Endpoint(e[0], quantized[0], pBits[0], decoded[0]);
+  quantizeBC7Endpoint(e[1], quantized[1], pBits[1], decoded[1]);
+
+  int palette[16][4];
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 4; c++) {
+      palette[i][c] = bc7Interpolate(decoded[0][c], decoded[1][c], i);
+    }
+  }
+
+  int indices[16];
+  for (int i = 0; i < 16; i++) {
+    int bestError = distanceSquared(block[i].c, palette[0], 4);
+    indices[i] = 0;
+    for (int p = 1; p < 16; p++) {
+      int error = distanceSquared(block[i].c, palette[p], 4);
+      if (error < bestError) {
+        bestError = error;
+        indices[i] = p;
+      }
+    }
+  }
+
+  // The top bit of the first index is implicitly 0, swap the endpoints if
+  // it would be set
+  if (indices[0] & 8) {
+    std::swap(quantized[0], quantized[1]);
+    std::swap(pBits[0], pBits[1]);
+    for (int i = 0; i < 16; i++) {
+      indices[i] = 15 - indices[i];
+    }
+  }
+
+  memset(out, 0, 16);
+  BitWriter writer{out};
+  writer.write(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    writer.write(quantized[0][c], 7);
+    writer.write(quantized[1][c], 7);
+  }
+  writer.write(pBits[0], 1);
+  writer.write(pBits[1], 1);
+  writer.write(indices[0], 3);
+  for (int i = 1; i < 16; i++) {
+    writer.write(indices[i], 4);
+  }
+}
+
+bool decodeBC7Block(const uint8_t *in, uint8_t block[16][4]) {
+  // Mode 6 is six 0 bits followed by a 1
+  if ((in[0] & 0x7F) != (1 << 6)) {
+    for (int i = 0; i < 16; i++) {
+      block[i][0] = 255;
+      block[i][1] = 0;
+      block[i][2] = 255;
+      block[i][3] = 255;
+    }
+    return false;
+  }
+
+  BitReader reader{in};
+  reader.read(7);
+  int endpoints[2][4];
+  for (int c = 0; c < 4; c++) {
+    endpoints[0][c] = reader.read(7) << 1;
+    endpoints[1][c] = reader.read(7) << 1;
+  }
+  for (int e = 0; e < 2; e++) {
+    int pBit = reader.read(1);
+    for (int c = 0; c < 4; c++) {
+      endpoints[e][c] |= pBit;
+    }
+  }
+
+  for (int i = 0; i < 16; i++) {
+    int index = reader.read(i == 0 ? 3 : 4);
+    for (int c = 0; c < 4; c++) {
+      block[i][c] = static_cast<uint8_t>(bc7Interpolate(endpoints[0][c], endpoints[1][c], index));
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+uint32_t blockBytes(Format format) {
+  return format == Format::BC1 ? 8 : 16;
+}
+
+size_t compressedSize(Format format, uint32_t width, uint32_t height) {
+  size_t blocksX = (width + 3) / 4;
+  size_t blocksY = (height + 3) / 4;
+  return blocksX * blocksY * blockBytes(format);
+}
+
+void compressImage(const uint8_t *rgba, uint32_t width, uint32_t height, Format format, uint8_t *out) {
+  uint32_t blocksX = (width + 3) / 4;
+  uint32_t blocksY = (height + 3) / 4;
+
+  Texel block[16];
+  for (uint32_t by = 0; by < blocksY; by++) {
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      fetchBlock(rgba, width, height, bx, by, block);
+
+      switch (format) {
+      case Format::BC1:
+        encodeColorBlock(block, true, out);
+        break;
+      case Format::BC3:
+        encodeSingleChannelBlock(block, 3, out);
+        encodeColorBlock(block, false, out + 8);
+        break;
+      case Format::BC5:
+        encodeSingleChannelBlock(block, 0, out);
+        encodeSingleChannelBlock(block, 1, out + 8);
+        break;
+      case Format::BC7:
+        encodeBC7Block(block, out);
+        break;
+      }
+      out += blockBytes(format);
+    }
+  }
+}
+
+bool decompressImage(const uint8_t *blocks, uint32_t width, uint32_t height, Format format, uint8_t *rgba) {
+  uint32_t blocksX = (width + 3) / 4;
+  uint32_t blocksY = (height + 3) / 4;
+  bool decoded = true;
+
+  uint8_t block[16][4];
+  for (uint32_t by = 0; by < blocksY; by++) {
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      switch (format) {
+      case Format::BC1:
+        decodeColorBlock(blocks, false, block);
+        break;
+      case Format::BC3:
+        decodeColorBlock(blocks + 8, true, block);
+        decodeSingleChannelBlock(blocks, 3, block);
+        break;
+      case Format::BC5:
+        for (int i = 0; i < 16; i++) {
+          block[i][2] = 0;
+          block[i][3] = 255;
+        }
+        decodeSingleChannelBlock(blocks, 0, block);
+        decodeSingleChannelBlock(blocks + 8, 1, block);
+        break;
+      case Format::BC7:
+        decoded &= decodeBC7Block(blocks, block);
+        break;
+      }
+      storeBlock(rgba, width, height, bx, by, block);
+      blocks += blockBytes(format);
+    }
+  }
+  return decoded;
+}
+
+} // namespace TextureCompression
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CPU encoders/decoders for the block compressed formats we cook textures to.
+// Every format works on 4x4 texel blocks, images that aren't a multiple of 4
+// repeat their edge texels to fill the last row/column of blocks.
+// The encoders favour speed over quality, they are meant for offline cooking
+// and the decoders are the fallback for devices without BC support.
+namespace TextureCompression {
+
+enum class Format {
+  BC1, // RGB + 1 bit alpha, 8 bytes per block
+  BC3, // RGBA, 16 bytes per block
+  BC5, // Two channels (normal maps), 16 bytes per block
+  BC7  // RGBA, 16 bytes per block. Only mode 6 is encoded/decoded
+};
+
+uint32_t blockBytes(Format format);
+
+// Bytes needed for a width x height image
+size_t compressedSize(Format format, uint32_t width, uint32_t height);
+
+// rgba is width * height RGBA8 texels, out has to hold compressedSize() bytes
+void compressImage(const uint8_t *rgba, uint32_t width, uint32_t height, Format format, uint8_t *out);
+
+// rgba has to hold width * height RGBA8 texels.
+// Returns false if a block used a BC7 mode we can't decode, those blocks are
+// filled with magenta
+bool decompressImage(const uint8_t *blocks, uint32_t width, uint32_t height, Format format, uint8_t *rgba);
+
+} // namespace TextureCompression
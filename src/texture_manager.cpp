@@ -0,0 +1,505 @@
+#include "texture_manager.hpp"
+
+#include <cmath>
+
+#include <mapped_file.hpp>
+#include <trace.hpp>
+#include <vulkan_helper.hpp>
+
+namespace VulkanEngine {
+
+static bool sameSamplerInfo(const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) {
+  return a.flags == b.flags &&
+         a.magFilter == b.magFilter &&
+         a.minFilter == b.minFilter &&
+         a.mipmapMode == b.mipmapMode &&
+         a.addressModeU == b.addressModeU &&
+         a.addressModeV == b.addressModeV &&
+         a.addressModeW == b.addressModeW &&
+         a.mipLodBias == b.mipLodBias &&
+         a.anisotropyEnable == b.anisotropyEnable &&
+         a.maxAnisotropy == b.maxAnisotropy &&
+         a.compareEnable == b.compareEnable &&
+         a.compareOp == b.compareOp &&
+         a.minLod == b.minLod &&
+         a.maxLod == b.maxLod &&
+         a.borderColor == b.borderColor &&
+         a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+//===================================================
+// SamplerCache
+
+VkSampler SamplerCache::getSampler(VkDevice device, const VkSamplerCreateInfo &createInfo) {
+  for (const Entry &entry : mSamplers) {
+    if (sameSamplerInfo(entry.createInfo, createInfo)) {
+      return entry.sampler;
+    }
+  }
+
+  Entry entry{createInfo, VK_NULL_HANDLE};
+  entry.createInfo.pNext = nullptr;
+  VK_CHECK(vkCreateSampler(device, &entry.createInfo, nullptr, &entry.sampler), "vkCreateSampler");
+  mSamplers.push_back(entry);
+  return entry.sampler;
+}
+
+void SamplerCache::destroy(VkDevice device) {
+  for (const Entry &entry : mSamplers) {
+    vkDestroySampler(device, entry.sampler, nullptr);
+  }
+  mSamplers.clear();
+}
+
+//===================================================
+// TextureManager
+
+void TextureManager::init(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool commandPool,
+                          VkQueue queue, float maxAnisotropy) {
+  mPhysicalDevice = physicalDevice;
+  mDevice = device;
+  mCommandPool = commandPool;
+  mQueue = queue;
+  mMaxAnisotropy = maxAnisotropy;
+
+  createFallbackTexture();
+  if (mStreamTextures) {
+    mStagingRing.create(mPhysicalDevice, mDevice, mStagingSize);
+    mStreamer.start();
+  }
+}
+
+void TextureManager::destroy() {
+  mStreamer.stop();
+  mWaitingUploads.clear();
+  // Waits for the uploads still in flight
+  mStagingRing.destroy(mDevice);
+
+  for (Entry &entry : mEntries) {
+    unload(entry);
+  }
+  destroyRetired(UINT64_MAX);
+  mEntries.clear();
+  mLookup.clear();
+
+  vkDestroyImageView(mDevice, mFallbackTexture.view, nullptr);
+  vkDestroyImage(mDevice, mFallbackTexture.image, nullptr);
+  vkFreeMemory(mDevice, mFallbackTexture.device_memory, nullptr);
+  mFallbackTexture = Utils::Texture{};
+  mSamplerCache.destroy(mDevice);
+}
+
+void TextureManager::beginFrame(uint64_t frame, uint64_t completedFrame) {
+  mRecordingFrame = frame;
+  destroyRetired(completedFrame);
+}
+
+TextureHandle TextureManager::acquire(const std::string &path, VkFormat format) {
+  std::string key = path + "|" + std::to_string(static_cast<int>(format));
+
+  TextureHandle handle;
+  auto found = mLookup.find(key);
+  if (found != mLookup.end()) {
+    handle = found->second;
+  } else {
+    handle = static_cast<TextureHandle>(mEntries.size());
+    mEntries.emplace_back();
+    mEntries[handle].path = path;
+    mEntries[handle].format = format;
+    mLookup[key] = handle;
+  }
+
+  Entry &entry = mEntries[handle];
+  entry.refCount++;
+  if (!entry.loaded) {
+    load(entry);
+    evictUnused();
+  }
+  return handle;
+}
+
+void TextureManager::release(TextureHandle handle) {
+  Entry &entry = mEntries[handle];
+  if (entry.refCount == 0) {
+    std::cout << "TextureManager: released " << entry.path << " more often than it was acquired\n";
+    return;
+  }
+
+  entry.refCount--;
+  if (entry.refCount == 0) {
+    entry.lastReleased = ++mReleaseCounter;
+    evictUnused();
+  }
+}
+
+size_t TextureManager::loadedCount() const {
+  size_t count = 0;
+  for (const Entry &entry : mEntries) {
+    count += entry.loaded ? 1 : 0;
+  }
+  return count;
+}
+
+void TextureManager::createFallbackTexture() {
+  const uint8_t white[4] = {255, 255, 255, 255};
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+  VulkanHelper::createBuffer(mPhysicalDevice, mDevice, sizeof(white), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &stagingBuffer, &stagingBufferMemory);
+  void *data;
+  VK_CHECK(vkMapMemory(mDevice, stagingBufferMemory, 0, sizeof(white), 0, &data), "vkMapMemory");
+  memcpy(data, white, sizeof(white));
+  vkUnmapMemory(mDevice, stagingBufferMemory);
+
+  MipGenerator::MipLevel level{1, 1, 0, sizeof(white)};
+  mFallbackTexture.texPath = "fallback";
+  mFallbackTexture.width = 1;
+  mFallbackTexture.height = 1;
+  mFallbackTexture.mip_levels = 1;
+  VulkanHelper::createTextureImage(mFallbackTexture, VK_FORMAT_R8G8B8A8_UNORM, mPhysicalDevice, mDevice,
+                                   mCommandPool, mQueue, stagingBuffer, VulkanHelper::mipCopyRegions({level}),
+                                   false);
+  vkFreeMemory(mDevice, stagingBufferMemory, nullptr);
+  vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
+
+  VulkanHelper::createTextureImageView(mFallbackTexture, VK_FORMAT_R8G8B8A8_UNORM, mDevice);
+  mFallbackTexture.sampler = mSamplerCache.getSampler(
+      mDevice, VulkanHelper::textureSamplerCreateInfo(mPhysicalDevice, mMaxAnisotropy));
+}
+
+void TextureManager::load(Entry &entry) {
+  TRACE_ZONE("TextureManager::load");
+  bool ktx2 = entry.path.size() >= 5 && entry.path.compare(entry.path.size() - 5, 5, ".ktx2") == 0;
+  if (ktx2 && mStreamTextures && prepareStreaming(entry)) {
+    // Start with the tail, the image is copied from when finer levels come in
+    entry.texture = VulkanHelper::loadTextureKTX2(entry.path.c_str(), mPhysicalDevice, mDevice,
+                                                  mCommandPool, mQueue, entry.tailBase,
+                                                  VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    entry.residentBase = entry.tailBase;
+  } else if (ktx2) {
+    entry.texture = VulkanHelper::loadTextureKTX2(entry.path.c_str(), mPhysicalDevice, mDevice,
+                                                  mCommandPool, mQueue);
+  } else {
+    entry.texture = VulkanHelper::loadTexture(entry.path.c_str(), entry.format, mPhysicalDevice, mDevice,
+                                              mCommandPool, mQueue);
+  }
+
+  entry.texture.sampler = mSamplerCache.getSampler(
+      mDevice, VulkanHelper::textureSamplerCreateInfo(mPhysicalDevice, mMaxAnisotropy));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(mDevice, entry.texture.image, &memoryRequirements);
+  entry.bytes = memoryRequirements.size;
+  entry.loaded = true;
+  mLoadedBytes += entry.bytes;
+  // Reloads replace the fallback
+  mViewsChanged = true;
+
+  std::cout << "TextureManager: loaded " << entry.path << " (" << entry.bytes / 1024 << " KB, "
+            << mLoadedBytes / 1024 << " KB total)\n";
+}
+
+void TextureManager::unload(Entry &entry) {
+  if (!entry.loaded) {
+    return;
+  }
+  // Descriptors written from now on get the fallback, the ones in flight
+  // still point at this image
+  retire(entry.texture);
+  entry.texture = Utils::Texture{};
+  mViewsChanged = true;
+
+  mLoadedBytes -= entry.bytes;
+  entry.bytes = 0;
+  entry.loaded = false;
+
+  entry.streamed = false;
+  entry.requestPending = false;
+  entry.generation++;
+}
+
+void TextureManager::evictUnused() {
+  while (mLoadedBytes > mMemoryBudget) {
+    Entry *oldest = nullptr;
+    for (Entry &entry : mEntries) {
+      if (entry.loaded && entry.refCount == 0 &&
+          (oldest == nullptr || entry.lastReleased < oldest->lastReleased)) {
+        oldest = &entry;
+      }
+    }
+    // Everything left is in use
+    if (oldest == nullptr) {
+      return;
+    }
+    std::cout << "TextureManager: evicting " << oldest->path << "\n";
+    unload(*oldest);
+  }
+}
+
+//===================================================
+// Streaming
+
+bool TextureManager::prepareStreaming(Entry &entry) {
+  MappedFile file;
+  if (!file.open(entry.path.c_str())) {
+    return false;
+  }
+  KTX2::Texture ktx;
+  std::string error;
+  if (!KTX2::parse(file.data(), file.size(), ktx, error)) {
+    return false;
+  }
+  // Formats that get decoded on the CPU are loaded whole
+  if (!VulkanHelper::canSampleFormat(mPhysicalDevice, ktx.format)) {
+    return false;
+  }
+
+  uint32_t tailBase = 0;
+  while (tailBase + 1 < ktx.levels.size() &&
+         std::max(ktx.levels[tailBase].width, ktx.levels[tailBase].height) > mStreamTailSize) {
+    tailBase++;
+  }
+  // Small enough to load in one go
+  if (tailBase == 0) {
+    return false;
+  }
+
+  entry.streamed = true;
+  entry.imageFormat = ktx.format;
+  entry.levels = ktx.levels;
+  entry.tailBase = tailBase;
+  entry.requestPending = false;
+  return true;
+}
+
+uint32_t TextureManager::wantedBaseLevel(const Entry &entry, float footprint) const {
+  // The smallest level that still has at least one texel per pixel
+  uint32_t level = entry.tailBase;
+  while (level > 0 && std::max(entry.levels[level].width, entry.levels[level].height) < footprint) {
+    level--;
+  }
+  return level;
+}
+
+bool TextureManager::takeViewsChanged() {
+  bool changed = mViewsChanged;
+  mViewsChanged = false;
+  return changed;
+}
+
+void TextureManager::updateStreaming(const std::vector<float> &footprints) {
+  TRACE_ZONE("TextureManager::updateStreaming");
+  if (!mStreamTextures) {
+    return;
+  }
+  mFrame++;
+
+  // Ask for the levels the visible textures are missing, the biggest on screen first
+  for (TextureHandle handle = 0; handle < mEntries.size(); handle++) {
+    Entry &entry = mEntries[handle];
+    float footprint = handle < footprints.size() ? footprints[handle] : 0.0f;
+    if (!entry.loaded || !entry.streamed || footprint <= 0.0f) {
+      continue;
+    }
+    entry.lastVisible = mFrame;
+
+    uint32_t wanted = wantedBaseLevel(entry, footprint);
+    if (wanted >= entry.residentBase || entry.requestPending || mLoadedBytes > mMemoryBudget) {
+      continue;
+    }
+    TextureStreamer::Request request;
+    request.texture = handle;
+    request.generation = entry.generation;
+    request.path = entry.path;
+    request.baseLevel = wanted;
+    request.levels.assign(entry.levels.begin() + wanted, entry.levels.begin() + entry.residentBase);
+    request.priority = footprint;
+    mStreamer.request(std::move(request));
+    entry.requestPending = true;
+  }
+
+  std::vector<TextureStreamer::Result> results = mStreamer.takeResults();
+  for (TextureStreamer::Result &result : results) {
+    mWaitingUploads.push_back(std::move(result));
+  }
+
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  std::vector<TextureStreamer::Result> stillWaiting;
+  for (TextureStreamer::Result &result : mWaitingUploads) {
+    Entry &entry = mEntries[result.texture];
+    // Evicted and maybe reloaded since the request
+    if (!entry.loaded || entry.generation != result.generation) {
+      continue;
+    }
+    if (result.failed) {
+      entry.streamed = false;
+      continue;
+    }
+    if (result.data.size() > mStagingRing.capacity()) {
+      std::cout << "TextureManager: levels of " << entry.path << " don't fit the staging ring, not streaming it\n";
+      entry.streamed = false;
+      continue;
+    }
+
+    VkDeviceSize offset;
+    if (!mStagingRing.allocate(mDevice, result.data.size(), 16, offset)) {
+      stillWaiting.push_back(std::move(result));
+      continue;
+    }
+    memcpy(mStagingRing.mMapped + offset, result.data.data(), result.data.size());
+
+    if (commandBuffer == VK_NULL_HANDLE) {
+      commandBuffer = VulkanHelper::beginSingleTimeCommands(mDevice, mCommandPool);
+    }
+    changeResidency(commandBuffer, entry, result.baseLevel, offset);
+    entry.requestPending = false;
+  }
+  mWaitingUploads.swap(stillWaiting);
+
+  // Over budget, drop unused textures first, then the finest level of the
+  // textures that have been off screen the longest
+  evictUnused();
+  while (mLoadedBytes > mMemoryBudget) {
+    Entry *oldest = nullptr;
+    for (Entry &entry : mEntries) {
+      if (entry.loaded && entry.streamed && !entry.requestPending && entry.residentBase < entry.tailBase &&
+          entry.lastVisible != mFrame && (oldest == nullptr || entry.lastVisible < oldest->lastVisible)) {
+        oldest = &entry;
+      }
+    }
+    if (oldest == nullptr) {
+      break;
+    }
+    if (commandBuffer == VK_NULL_HANDLE) {
+      commandBuffer = VulkanHelper::beginSingleTimeCommands(mDevice, mCommandPool);
+    }
+    changeResidency(commandBuffer, *oldest, oldest->residentBase + 1, 0);
+  }
+
+  if (commandBuffer == VK_NULL_HANDLE) {
+    return;
+  }
+
+  VK_CHECK(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer");
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  VK_CHECK(vkQueueSubmit(mQueue, 1, &submitInfo, mStagingRing.submit(mDevice)), "vkQueueSubmit");
+  Retired retired;
+  retired.commandBuffer = commandBuffer;
+  retired.frame = mRecordingFrame;
+  mRetired.push_back(retired);
+}
+
+void TextureManager::changeResidency(VkCommandBuffer commandBuffer, Entry &entry, uint32_t newBase,
+                                     VkDeviceSize stagingOffset) {
+  uint32_t oldBase = entry.residentBase;
+  uint32_t levelCount = static_cast<uint32_t>(entry.levels.size());
+
+  Utils::Texture texture{};
+  texture.texPath = entry.texture.texPath;
+  texture.sampler = entry.texture.sampler;
+  texture.width = entry.levels[newBase].width;
+  texture.height = entry.levels[newBase].height;
+  texture.mip_levels = levelCount - newBase;
+  VulkanHelper::allocateTextureImage(texture, entry.imageFormat,
+                                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                     VK_IMAGE_USAGE_SAMPLED_BIT,
+                                     mPhysicalDevice, mDevice);
+
+  VkImageMemoryBarrier barriers[2] = {VulkanInit::image_memory_barrier(), VulkanInit::image_memory_barrier()};
+  barriers[0].image = texture.image;
+  barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mip_levels, 0, 1};
+  barriers[0].srcAccessMask = 0;
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].image = entry.texture.image;
+  barriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, entry.texture.mip_levels, 0, 1};
+  barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0, 0, nullptr, 0, nullptr, 2, barriers);
+
+  // Levels both images have are copied on the GPU
+  std::vector<VkImageCopy> imageCopies;
+  for (uint32_t level = std::max(newBase, oldBase); level < levelCount; level++) {
+    VkImageCopy copy{};
+    copy.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - oldBase, 0, 1};
+    copy.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - newBase, 0, 1};
+    copy.extent = {entry.levels[level].width, entry.levels[level].height, 1};
+    imageCopies.push_back(copy);
+  }
+  vkCmdCopyImage(commandBuffer, entry.texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 static_cast<uint32_t>(imageCopies.size()), imageCopies.data());
+
+  // The new ones come from the staging ring
+  if (newBase < oldBase) {
+    std::vector<VkBufferImageCopy> bufferCopies;
+    VkDeviceSize offset = stagingOffset;
+    for (uint32_t level = newBase; level < oldBase; level++) {
+      VkBufferImageCopy copy{};
+      copy.bufferOffset = offset;
+      copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - newBase, 0, 1};
+      copy.imageExtent = {entry.levels[level].width, entry.levels[level].height, 1};
+      bufferCopies.push_back(copy);
+      offset += entry.levels[level].size;
+    }
+    vkCmdCopyBufferToImage(commandBuffer, mStagingRing.mBuffer, texture.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(bufferCopies.size()), bufferCopies.data());
+  }
+
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 0, nullptr, 0, nullptr, 1, barriers);
+  texture.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  VulkanHelper::createTextureImageView(texture, entry.imageFormat, mDevice);
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(mDevice, texture.image, &memoryRequirements);
+  mLoadedBytes -= entry.bytes;
+  entry.bytes = memoryRequirements.size;
+  mLoadedBytes += entry.bytes;
+
+  // Frames in flight still sample the old image
+  retire(entry.texture);
+  entry.texture = texture;
+  mViewsChanged = true;
+  entry.residentBase = newBase;
+}
+
+void TextureManager::retire(const Utils::Texture &texture) {
+  Retired retired;
+  retired.texture = texture;
+  retired.frame = mRecordingFrame;
+  mRetired.push_back(retired);
+}
+
+void TextureManager::destroyRetired(uint64_t completedFrame) {
+  size_t kept = 0;
+  for (const Retired &retired : mRetired) {
+    if (retired.frame > completedFrame) {
+      mRetired[kept++] = retired;
+      continue;
+    }
+    if (retired.commandBuffer != VK_NULL_HANDLE) {
+      vkFreeCommandBuffers(mDevice, mCommandPool, 1, &retired.commandBuffer);
+    } else {
+      vkDestroyImageView(mDevice, retired.texture.view, nullptr);
+      vkDestroyImage(mDevice, retired.texture.image, nullptr);
+      vkFreeMemory(mDevice, retired.texture.device_memory, nullptr);
+    }
+  }
+  mRetired.resize(kept);
+}
+} // namespace VulkanEngine
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <utils.hpp>
+#include <ktx2.hpp>
+#include <texture_streamer.hpp>
+
+namespace VulkanEngine {
+
+typedef uint32_t TextureHandle;
+
+// Hands out one VkSampler per distinct create info.
+// Only the fields of VkSamplerCreateInfo itself are compared, pNext chains
+// are not supported.
+class SamplerCache {
+public:
+  VkSampler getSampler(VkDevice device, const VkSamplerCreateInfo &createInfo);
+  void destroy(VkDevice device);
+
+  size_t size() const { return mSamplers.size(); }
+
+private:
+  struct Entry {
+    VkSamplerCreateInfo createInfo;
+    VkSampler sampler;
+  };
+  // There are only ever a handful of samplers, a linear search is fine
+  std::vector<Entry> mSamplers;
+};
+
+// Owns every texture the renderer loads.
+// Textures are keyed by path + format so the same file is only loaded once,
+// acquire()/release() count the users of each texture. Textures nobody uses
+// stay loaded so they can be picked up again cheaply, until the memory of
+// all loaded textures goes over mMemoryBudget. Then the least recently
+// released ones are destroyed first.
+// Handles stay valid after eviction, acquiring an evicted texture reloads it.
+// Until then getTexture() returns a 1x1 white fallback for them, and the
+// evicted image is destroyed once the frames in flight are done with it.
+//
+// .ktx2 textures the device can sample directly are streamed: only the small
+// levels (up to mStreamTailSize) are loaded by acquire(), updateStreaming()
+// reads the finer levels on a background thread once a texture is big enough
+// on screen. Over the budget, the textures that haven't been visible for the
+// longest lose their finest level again.
+class TextureManager {
+public:
+  // Textures above this many bytes of device memory start evicting unused ones
+  VkDeviceSize mMemoryBudget = 256ull * 1024 * 1024;
+  bool mStreamTextures = true;
+  // Levels no bigger than this are always resident
+  uint32_t mStreamTailSize = 64;
+  // Size of the staging ring streamed levels are uploaded through
+  VkDeviceSize mStagingSize = 32ull * 1024 * 1024;
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool commandPool,
+            VkQueue queue, float maxAnisotropy);
+  // The device has to be idle
+  void destroy();
+
+  // frame is the number of the frame being recorded, images replaced from
+  // now on are kept until it has completed. Destroys the images retired by
+  // frames up to completedFrame.
+  // Frames have to be submitted to the queue the manager uploads on, in
+  // order, so a completed frame also means the uploads before it are done
+  void beginFrame(uint64_t frame, uint64_t completedFrame);
+
+  // Loads the texture if it isn't loaded yet and adds a reference to it.
+  // .ktx2 files bring their own format and ignore the format argument.
+  TextureHandle acquire(const std::string &path, VkFormat format);
+  void release(TextureHandle handle);
+
+  const Utils::Texture &getTexture(TextureHandle handle) const {
+    return mEntries[handle].loaded ? mEntries[handle].texture : mFallbackTexture;
+  }
+
+  size_t loadedCount() const;
+  VkDeviceSize loadedBytes() const { return mLoadedBytes; }
+
+  size_t handleCount() const { return mEntries.size(); }
+
+  // footprints[handle] is how many pixels across the texture covers on screen
+  // this frame, 0 if nothing using it is visible.
+  void updateStreaming(const std::vector<float> &footprints);
+
+  // True once after the view getTexture() returns changed for any handle,
+  // because streaming swapped the image or the texture was evicted.
+  // Descriptors have to be rewritten before a frame using them is recorded,
+  // the old views stay valid for the frames already in flight.
+  bool takeViewsChanged();
+
+private:
+  struct Entry {
+    Utils::Texture texture{};
+    std::string path;
+    VkFormat format;
+    uint32_t refCount = 0;
+    VkDeviceSize bytes = 0;
+    // Value of mReleaseCounter when the last reference was dropped
+    uint64_t lastReleased = 0;
+    bool loaded = false;
+
+    // Streaming state, levels holds every level of the file
+    bool streamed = false;
+    VkFormat imageFormat;
+    std::vector<KTX2::Level> levels;
+    // Finest level in the image, levels from tailBase on are always resident
+    uint32_t residentBase = 0;
+    uint32_t tailBase = 0;
+    bool requestPending = false;
+    // Bumped on unload so results for an old image are dropped
+    uint32_t generation = 0;
+    uint64_t lastVisible = 0;
+  };
+
+  VkPhysicalDevice mPhysicalDevice = VK_NULL_HANDLE;
+  VkDevice mDevice = VK_NULL_HANDLE;
+  VkCommandPool mCommandPool = VK_NULL_HANDLE;
+  VkQueue mQueue = VK_NULL_HANDLE;
+  float mMaxAnisotropy = 1.0f;
+
+  SamplerCache mSamplerCache;
+  Utils::Texture mFallbackTexture{};
+  bool mViewsChanged = false;
+
+  std::vector<Entry> mEntries;
+  std::unordered_map<std::string, TextureHandle> mLookup;
+  VkDeviceSize mLoadedBytes = 0;
+  uint64_t mReleaseCounter = 0;
+
+  TextureStreamer mStreamer;
+  StagingRing mStagingRing;
+  // Read but not uploaded yet, the staging ring was full
+  std::vector<TextureStreamer::Result> mWaitingUploads;
+  // Replaced by streaming or evicted, or the upload that replaced them.
+  // Destroyed once frame has completed
+  struct Retired {
+    Utils::Texture texture{};
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    uint64_t frame = 0;
+  };
+  std::vector<Retired> mRetired;
+  // Set by beginFrame()
+  uint64_t mRecordingFrame = 0;
+  uint64_t mFrame = 0;
+
+  void createFallbackTexture();
+  void load(Entry &entry);
+  // The image goes to the retire list
+  void unload(Entry &entry);
+  void retire(const Utils::Texture &texture);
+  void evictUnused();
+
+  bool prepareStreaming(Entry &entry);
+  uint32_t wantedBaseLevel(const Entry &entry, float footprint) const;
+  // Moves the texture into a new image holding levels newBase and below.
+  // Levels the old image doesn't have are copied from the staging ring at
+  // stagingOffset, back to back
+  void changeResidency(VkCommandBuffer commandBuffer, Entry &entry, uint32_t newBase,
+                       VkDeviceSize stagingOffset);
+  void destroyRetired(uint64_t completedFrame);
+};
+} // namespace VulkanEngine
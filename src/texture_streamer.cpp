@@ -0,0 +1,198 @@
+#include "texture_streamer.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include <trace.hpp>
+#include <vulkan_helper.hpp>
+
+namespace VulkanEngine {
+
+//===================================================
+// TextureStreamer
+
+TextureStreamer::TextureStreamer() {}
+
+TextureStreamer::~TextureStreamer() {
+  stop();
+}
+
+void TextureStreamer::start() {
+  if (mRunning) {
+    return;
+  }
+  mRunning = true;
+  mThread = std::thread(&TextureStreamer::run, this);
+}
+
+void TextureStreamer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mRunning) {
+      return;
+    }
+    mRunning = false;
+  }
+  mCondition.notify_one();
+  mThread.join();
+
+  mRequests.clear();
+  mResults.clear();
+}
+
+void TextureStreamer::request(Request request) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequests.push_back(std::move(request));
+  }
+  mCondition.notify_one();
+}
+
+std::vector<TextureStreamer::Result> TextureStreamer::takeResults() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  std::vector<Result> results;
+  results.swap(mResults);
+  return results;
+}
+
+void TextureStreamer::run() {
+  Trace::setThreadName("TextureStreamer");
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCondition.wait(lock, [this] { return !mRunning || !mRequests.empty(); });
+      if (!mRunning) {
+        return;
+      }
+
+      auto next = std::max_element(mRequests.begin(), mRequests.end(),
+                                   [](const Request &a, const Request &b) { return a.priority < b.priority; });
+      request = std::move(*next);
+      mRequests.erase(next);
+    }
+
+    TRACE_ZONE("TextureStreamer::read");
+    Result result;
+    result.texture = request.texture;
+    result.generation = request.generation;
+    result.baseLevel = request.baseLevel;
+    result.levels = request.levels;
+    result.failed = false;
+
+    size_t totalSize = 0;
+    for (const KTX2::Level &level : request.levels) {
+      totalSize += static_cast<size_t>(level.size);
+    }
+    result.data.resize(totalSize);
+
+    // Each level is a contiguous range of the file
+    std::ifstream file(request.path, std::ios::binary);
+    size_t offset = 0;
+    for (const KTX2::Level &level : request.levels) {
+      file.seekg(static_cast<std::streamoff>(level.offset));
+      file.read(reinterpret_cast<char *>(result.data.data() + offset), static_cast<std::streamsize>(level.size));
+      offset += static_cast<size_t>(level.size);
+    }
+    if (!file) {
+      std::cout << "TextureStreamer: failed to read " << request.path << "\n";
+      result.failed = true;
+      result.data.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResults.push_back(std::move(result));
+  }
+}
+
+//===================================================
+// StagingRing
+
+void StagingRing::create(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size) {
+  mSize = size;
+  VulkanHelper::createBuffer(physicalDevice, device, size,
+                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &mBuffer, &mMemory);
+  void *data;
+  VK_CHECK(vkMapMemory(device, mMemory, 0, size, 0, &data), "vkMapMemory");
+  mMapped = static_cast<uint8_t *>(data);
+}
+
+void StagingRing::destroy(VkDevice device) {
+  for (const Submission &submission : mInFlight) {
+    vkWaitForFences(device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(device, submission.fence, nullptr);
+  }
+  mInFlight.clear();
+
+  if (mBuffer != VK_NULL_HANDLE) {
+    vkUnmapMemory(device, mMemory);
+    vkDestroyBuffer(device, mBuffer, nullptr);
+    vkFreeMemory(device, mMemory, nullptr);
+  }
+  mBuffer = VK_NULL_HANDLE;
+  mMemory = VK_NULL_HANDLE;
+  mMapped = nullptr;
+}
+
+void StagingRing::reclaim(VkDevice device) {
+  while (!mInFlight.empty() && vkGetFenceStatus(device, mInFlight.front().fence) == VK_SUCCESS) {
+    vkDestroyFence(device, mInFlight.front().fence, nullptr);
+    mInFlight.pop_front();
+  }
+}
+
+bool StagingRing::allocate(VkDevice device, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+  reclaim(device);
+
+  if (mInFlight.empty() && !mPending) {
+    // Nothing is using the ring, start over at the front
+    mHead = 0;
+    mPendingBegin = 0;
+  }
+
+  // Everything from tail up to the head is still in use
+  bool empty = mInFlight.empty() && !mPending;
+  VkDeviceSize tail = !mInFlight.empty() ? mInFlight.front().begin : mPendingBegin;
+  VkDeviceSize aligned = (mHead + alignment - 1) / alignment * alignment;
+
+  if (empty || mHead > tail) {
+    if (aligned + size <= mSize) {
+      offset = aligned;
+    } else if (size <= tail) {
+      // Wrap around to the front
+      offset = 0;
+    } else {
+      return false;
+    }
+  } else {
+    // Already wrapped, the free space ends at the tail
+    if (aligned + size <= tail) {
+      offset = aligned;
+    } else {
+      return false;
+    }
+  }
+
+  if (!mPending) {
+    mPendingBegin = offset;
+    mPending = true;
+  }
+  mHead = offset + size;
+  return true;
+}
+
+VkFence StagingRing::submit(VkDevice device) {
+  VkFenceCreateInfo fence_info{};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence;
+  VK_CHECK(vkCreateFence(device, &fence_info, nullptr, &fence), "vkCreateFence");
+
+  mInFlight.push_back({fence, mPendingBegin, mHead});
+  mPendingBegin = mHead;
+  mPending = false;
+  return fence;
+}
+} // namespace VulkanEngine
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ktx2.hpp>
+#include <utils.hpp>
+
+namespace VulkanEngine {
+
+// Reads mip levels of KTX2 files on a background thread.
+// The most important request (highest priority) is always read next, the
+// results are picked up by the render thread with takeResults().
+class TextureStreamer {
+public:
+  struct Request {
+    // Whatever the caller uses to find the texture again
+    uint32_t texture;
+    uint32_t generation;
+    std::string path;
+    // Finest level requested, levels[0] is that level
+    uint32_t baseLevel;
+    std::vector<KTX2::Level> levels;
+    // e.g. the size on screen in pixels
+    float priority;
+  };
+
+  struct Result {
+    uint32_t texture;
+    uint32_t generation;
+    uint32_t baseLevel;
+    std::vector<KTX2::Level> levels;
+    // The levels back to back, in the same order as levels
+    std::vector<uint8_t> data;
+    bool failed;
+  };
+
+  TextureStreamer();
+  ~TextureStreamer();
+
+  void start();
+  void stop();
+
+  void request(Request request);
+  std::vector<Result> takeResults();
+
+private:
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::vector<Request> mRequests;
+  std::vector<Result> mResults;
+  bool mRunning = false;
+
+  void run();
+};
+
+// Persistently mapped staging buffer that is handed out front to back and
+// wraps around. Space is given back once the fence of the submission that
+// used it has signaled.
+class StagingRing {
+public:
+  VkBuffer mBuffer = VK_NULL_HANDLE;
+  uint8_t *mMapped = nullptr;
+
+  void create(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size);
+  void destroy(VkDevice device);
+
+  // Returns false if there is no room until earlier uploads have finished
+  bool allocate(VkDevice device, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+
+  // Returns the fence to submit the uploads allocated since the last call with
+  VkFence submit(VkDevice device);
+
+  VkDeviceSize capacity() const { return mSize; }
+
+private:
+  struct Submission {
+    VkFence fence;
+    VkDeviceSize begin;
+    VkDeviceSize end;
+  };
+
+  VkDeviceMemory mMemory = VK_NULL_HANDLE;
+  VkDeviceSize mSize = 0;
+  VkDeviceSize mHead = 0;
+  // Start of the allocations that haven't been submitted yet
+  VkDeviceSize mPendingBegin = 0;
+  bool mPending = false;
+  std::deque<Submission> mInFlight;
+
+  void reclaim(VkDevice device);
+};
+} // namespace VulkanEngine
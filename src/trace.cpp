@@ -0,0 +1,171 @@
+#include "trace.hpp"
+
+#if VKGAME_TRACE
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace {
+
+std::atomic<bool> gCapturing{false};
+
+namespace {
+
+struct Event {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Single producer (the owning thread), single consumer (collect())
+struct ThreadRing {
+  static constexpr uint32_t kCapacity = 1 << 14;
+  Event events[kCapacity];
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  uint32_t threadId = 0;
+  const char *name = nullptr;
+};
+
+struct CapturedEvent {
+  Event event;
+  uint32_t threadId;
+};
+
+// Rings are never freed, a thread that ends leaves its events to be collected
+std::mutex gMutex;
+std::vector<std::unique_ptr<ThreadRing>> gRings;
+std::vector<CapturedEvent> gCaptured;
+uint64_t gCaptureStart = 0;
+std::atomic<uint64_t> gDropped{0};
+
+ThreadRing &threadRing() {
+  thread_local ThreadRing *ring = nullptr;
+  if (ring == nullptr) {
+    std::lock_guard<std::mutex> lock(gMutex);
+    gRings.push_back(std::make_unique<ThreadRing>());
+    ring = gRings.back().get();
+    ring->threadId = static_cast<uint32_t>(gRings.size());
+  }
+  return *ring;
+}
+
+void drain(ThreadRing &ring) {
+  uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+  uint32_t head = ring.head.load(std::memory_order_acquire);
+  for (; tail != head; tail++) {
+    gCaptured.push_back({ring.events[tail % ThreadRing::kCapacity], ring.threadId});
+  }
+  ring.tail.store(tail, std::memory_order_release);
+}
+
+void writeEscaped(FILE *file, const char *text) {
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*text, file);
+  }
+}
+} // namespace
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setThreadName(const char *name) {
+  threadRing().name = name;
+}
+
+void record(const char *name, uint64_t start, uint64_t end) {
+  ThreadRing &ring = threadRing();
+  uint32_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) == ThreadRing::kCapacity) {
+    gDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring.events[head % ThreadRing::kCapacity] = {name, start, end};
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void beginCapture() {
+  std::lock_guard<std::mutex> lock(gMutex);
+  // Whatever was recorded before belongs to no capture
+  for (std::unique_ptr<ThreadRing> &ring : gRings) {
+    ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+  gCaptured.clear();
+  gDropped = 0;
+  gCaptureStart = now();
+  gCapturing = true;
+}
+
+void collect() {
+  if (!capturing()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(gMutex);
+  for (std::unique_ptr<ThreadRing> &ring : gRings) {
+    drain(*ring);
+  }
+}
+
+bool endCapture(const std::string &path) {
+  if (!capturing()) {
+    return false;
+  }
+  // Zones still open stop recording, finished ones are in the rings
+  gCapturing = false;
+  std::lock_guard<std::mutex> lock(gMutex);
+  for (std::unique_ptr<ThreadRing> &ring : gRings) {
+    drain(*ring);
+  }
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cout << "Trace: can't write " << path << "\n";
+    return false;
+  }
+  // Timestamps in microseconds, to the nanosecond
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+  bool first = true;
+  for (const std::unique_ptr<ThreadRing> &ring : gRings) {
+    if (ring->name != nullptr) {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+              first ? "" : ",\n", ring->threadId);
+      writeEscaped(file, ring->name);
+      fputs("\"}}", file);
+      first = false;
+    }
+  }
+  for (const CapturedEvent &captured : gCaptured) {
+    uint64_t start = captured.event.start > gCaptureStart ? captured.event.start - gCaptureStart : 0;
+    uint64_t duration = captured.event.end - captured.event.start;
+    fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+    writeEscaped(file, captured.event.name);
+    fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu}", captured.threadId,
+            (unsigned long long)(start / 1000), (unsigned long long)(start % 1000),
+            (unsigned long long)(duration / 1000), (unsigned long long)(duration % 1000));
+    first = false;
+  }
+  fputs("\n]}\n", file);
+  bool written = ferror(file) == 0;
+  fclose(file);
+
+  std::cout << "Trace: wrote " << gCaptured.size() << " zones to " << path;
+  if (gDropped > 0) {
+    std::cout << " (" << gDropped << " dropped, collect() more often)";
+  }
+  std::cout << "\n";
+  gCaptured.clear();
+  gCaptured.shrink_to_fit();
+  return written;
+}
+} // namespace Trace
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Zones are compiled in unless VKGAME_TRACE is 0, they only record while a
+// capture is running
+#ifndef VKGAME_TRACE
+#define VKGAME_TRACE 1
+#endif
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope, name has to be a string literal
+#if VKGAME_TRACE
+#define TRACE_ZONE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+#define TRACE_ZONE(name)
+#endif
+
+// Scoped zones written as Chrome trace JSON, which chrome://tracing and
+// ui.perfetto.dev open. Every thread records into its own ring buffer
+// without locks, collect() moves the rings into the capture and has to be
+// called often enough that they don't fill up (e.g. once per frame)
+namespace Trace {
+
+#if VKGAME_TRACE
+
+// Nanoseconds on a monotonic clock
+uint64_t now();
+// Shown instead of the thread id, has to be a string literal
+void setThreadName(const char *name);
+
+void beginCapture();
+// Drains the rings of every thread into the capture
+void collect();
+// Stops and writes the capture, false if the file can't be written
+bool endCapture(const std::string &path);
+
+extern std::atomic<bool> gCapturing;
+inline bool capturing() { return gCapturing.load(std::memory_order_relaxed); }
+
+// Only for the calling thread's ring
+void record(const char *name, uint64_t start, uint64_t end);
+
+class Zone {
+public:
+  explicit Zone(const char *name) : mName(name), mActive(capturing()) {
+    if (mActive) {
+      mStart = now();
+    }
+  }
+  ~Zone() {
+    if (mActive) {
+      record(mName, mStart, now());
+    }
+  }
+  Zone(const Zone &) = delete;
+  Zone &operator=(const Zone &) = delete;
+
+private:
+  const char *mName;
+  uint64_t mStart = 0;
+  bool mActive;
+};
+
+#else
+
+inline uint64_t now() { return 0; }
+inline void setThreadName(const char *) {}
+inline void beginCapture() {}
+inline void collect() {}
+inline bool endCapture(const std::string &) { return false; }
+inline bool capturing() { return false; }
+
+#endif
+} // namespace Trace
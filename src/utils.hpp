@@ -86,8 +86,18 @@ struct UniformBufferObject {
   glm::vec3 camPos;
 };
 
-struct UniformBufferObjectModel {
+// Per draw data pushed with vkCmdPushConstants, read by simple_shader.vert
+struct ModelPushConstants {
   glm::mat4 modelPos;
+  uint32_t objectIndex;
+};
+
+// One per entity in the bindless object buffer, std430 layout
+struct ObjectData {
+  glm::mat4 modelPos;
+  // Index into the bindless texture array
+  uint32_t textureIndex;
+  uint32_t padding[3];
 };
 
 struct Texture {
@@ -102,26 +112,51 @@ struct Texture {
   uint32_t descriptor_set_index;
 };
 
-struct Model{
-  std::vector<Utils::Vertex> mVertices;
-  std::vector<uint32_t> mIndices;
+// Axis aligned bounding box
+struct AABB {
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+};
 
+// Geometry that lives on the GPU, the CPU copies of the vertices and indices
+// are not kept around once they have been uploaded
+struct Mesh {
   // This is set first as VK_NULL_HANDLE, since we initially want to destroy
   // buffer, and VK_NULL_HANDLE is valid for vkDestroyBuffer when buffer in
   // unitialized
-
   VkBuffer mVertexBuffer = VK_NULL_HANDLE;
   VkDeviceMemory mVertexBufferMemory = VK_NULL_HANDLE;
 
   VkBuffer mIndexBuffer = VK_NULL_HANDLE;
   VkDeviceMemory mIndexBufferMemory = VK_NULL_HANDLE;
 
-  VkBuffer mUniformBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory mUniformBuffersMemory = VK_NULL_HANDLE;
+  uint32_t mIndexCount = 0;
+
+  // Bounds in model space
+  AABB mBounds;
+};
 
-  VkDescriptorSet mDescriptorSet = VK_NULL_HANDLE;
+struct Material {
+  // Handle from VulkanEngine::TextureManager::acquire()
+  uint32_t mTextureIndex = 0;
+  // Render state, each distinct combination gets its own pipeline
+  VkCullModeFlags mCullMode = VK_CULL_MODE_NONE;
+  bool mAlphaBlend = false;
+};
 
-  glm::vec3 mPosition;
+// What the last frame cost, filled in by VulkanRenderer::drawFrame()
+struct FrameStats {
+  // CPU milliseconds waiting for the frame's fence and swapchain image,
+  // updating uniforms and streaming, recording, and submitting and presenting
+  float waitMs = 0.0f;
+  float updateMs = 0.0f;
+  float recordMs = 0.0f;
+  float submitMs = 0.0f;
+  // Scene only, the overlays aren't counted
+  uint32_t draws = 0;
+  uint32_t triangles = 0;
+  uint32_t descriptorBinds = 0;
+  uint32_t pipelineBinds = 0;
 };
 
 inline void showWindowFlags(int flags) {
@@ -9,6 +9,10 @@
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan_initializers.hpp>
+#include <mip_generator.hpp>
+#include <ktx2.hpp>
+#include <mapped_file.hpp>
+#include <texture_compression.hpp>
 #include <cstring>
 
 // for loading stb image function objs
@@ -404,7 +408,8 @@ inline uint32_t findMemoryType(VkPhysicalDevice physicalDevice,
 inline void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
                          VkDeviceSize size, VkBufferUsageFlags usage,
                          VkMemoryPropertyFlags properties, VkBuffer *buffer,
-                         VkDeviceMemory *bufferMemory) {
+                         VkDeviceMemory *bufferMemory,
+                         VkMemoryAllocateFlags allocateFlags = 0) {
 
   VkBufferCreateInfo bufferInfo = VulkanInit::buffer_create_info(usage, size);
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -424,6 +429,14 @@ inline void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
   allocInfo.memoryTypeIndex = findMemoryType(
       physicalDevice, memRequirements.memoryTypeBits, properties);
 
+  // e.g. VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT for buffers used by address
+  VkMemoryAllocateFlagsInfo flagsInfo{};
+  flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+  flagsInfo.flags = allocateFlags;
+  if (allocateFlags != 0) {
+    allocInfo.pNext = &flagsInfo;
+  }
+
   if (vkAllocateMemory(device, &allocInfo, nullptr, bufferMemory) !=
       VK_SUCCESS) {
     throw std::runtime_error("failed to allocate buffer memory!");
@@ -431,6 +444,13 @@ inline void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
   vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
 }
 
+inline VkDeviceAddress getBufferAddress(VkDevice device, VkBuffer buffer) {
+  VkBufferDeviceAddressInfo addressInfo{};
+  addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+  addressInfo.buffer = buffer;
+  return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
 inline VkCommandBuffer beginSingleTimeCommands(VkDevice device,
                                                VkCommandPool commandPool) {
   // First need to allocate a temporary command buffer
@@ -670,61 +690,143 @@ inline void transitionImageLayout(VkDevice device, VkCommandPool commandPool,
 //                            VkPhysicalDevice physicalDevice, VkDevice device,
 //                            VkCommandPool commandPool, VkQueue submitQueue);
 
-inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
-                        VkPhysicalDevice physicalDevice,
-                        VkDevice device, 
-                        VkCommandPool commandPool,
-                        VkQueue submitQueue,
-                        VkSampleCountFlagBits numSample) {
-  Utils::Texture texture{};
+// Records the blits that fill every level below 0 from the level above it.
+// All levels have to be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, they are
+// left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+inline void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image,
+                            int32_t width, int32_t height, uint32_t mipLevels) {
+  VkImageMemoryBarrier barrier = VulkanInit::image_memory_barrier();
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
 
-  texture.texPath = texPath;
+  int32_t mipWidth = width;
+  int32_t mipHeight = height;
 
-  int texWidth, texHeight, texChannels;
-  stbi_uc *pixels = stbi_load(texPath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-  VkDeviceSize imageSize = texWidth * texHeight * 4;
+  for (uint32_t i = 1; i < mipLevels; i++) {
+    // The previous level has been written, make it the blit source
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    int32_t nextWidth = std::max(1, mipWidth / 2);
+    int32_t nextHeight = std::max(1, mipHeight / 2);
+
+    VkImageBlit blit{};
+    blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = i - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = i;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    vkCmdBlitImage(commandBuffer,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &blit, VK_FILTER_LINEAR);
+
+    // Nothing reads the previous level anymore, hand it over to the shaders
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-  if (!pixels) {
-    throw std::runtime_error("failed to load texture image: " + std::string(texPath));
+    mipWidth = nextWidth;
+    mipHeight = nextHeight;
   }
 
-  texture.height = texHeight;
-  texture.width = texWidth;
-  texture.mip_levels = 1;
-
-  // Now copy raw image data to an optimal tiled image
-  // This loads the texture data into a host local buffer that is copied to the optimal tiled image on the device
+  // The last level is only ever written to
+  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
 
-  // Create a host-visible staging buffer that contains the raw image data
-  // This buffer will be the data source for copying texture data to the optimal tiled image on the device
-  VkBuffer stagingBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+// Create info of the trilinear, repeating sampler used for textures.
+// maxLod isn't limited so one sampler works for any mip count.
+// maxAnisotropy is clamped to what the device supports, anything <= 1 turns
+// anisotropic filtering off
+inline VkSamplerCreateInfo textureSamplerCreateInfo(VkPhysicalDevice physicalDevice,
+                                                    float maxAnisotropy) {
+  // In Vulkan textures are accessed by samplers
+  // This separates all the sampling information from the texture data. This means you could have multiple sampler objects for the same texture with different settings
+  VkSamplerCreateInfo sampler = VulkanInit::sampler_create_info();
+  sampler.magFilter           = VK_FILTER_LINEAR;
+  sampler.minFilter           = VK_FILTER_LINEAR;
+  sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler.mipLodBias          = 0.0f;
+  sampler.compareOp           = VK_COMPARE_OP_NEVER;
+  sampler.minLod              = 0.0f;
+  // The image view already limits the levels that can be sampled
+  sampler.maxLod = VK_LOD_CLAMP_NONE;
+  sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+  // Anisotropic filtering is optional, so we must check if it's supported on the device
+  VkPhysicalDeviceFeatures features{};
+  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+  if (features.samplerAnisotropy && maxAnisotropy > 1.0f) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    sampler.maxAnisotropy    = std::min(maxAnisotropy, properties.limits.maxSamplerAnisotropy);
+    sampler.anisotropyEnable = VK_TRUE;
+  } else {
+    sampler.maxAnisotropy    = 1.0f;
+    sampler.anisotropyEnable = VK_FALSE;
+  }
 
-  createBuffer(physicalDevice, device, imageSize,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-               &stagingBuffer, &stagingBufferMemory);
-  void *data;
-  vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-  memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vkUnmapMemory(device, stagingBufferMemory);
+  return sampler;
+}
 
-  stbi_image_free(pixels);
+// True if images of this format can be sampled with linear filtering
+inline bool canSampleFormat(VkPhysicalDevice physicalDevice, VkFormat format) {
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+  const VkFormatFeatureFlags sampleFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                              VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (formatProperties.optimalTilingFeatures & sampleFeatures) == sampleFeatures;
+}
 
+// Creates texture.image (texture.width x texture.height, texture.mip_levels
+// levels) and binds device local memory to it, the contents are undefined
+inline void allocateTextureImage(Utils::Texture &texture, VkFormat format, VkImageUsageFlags usage,
+                                 VkPhysicalDevice physicalDevice, VkDevice device) {
   // Create optimal tiled target image on the device
 	VkImageCreateInfo image_create_info = VulkanInit::image_create_info();
 	image_create_info.imageType         = VK_IMAGE_TYPE_2D;
 	image_create_info.format            = format;
 	image_create_info.mipLevels         = texture.mip_levels;
 	image_create_info.arrayLayers       = 1;
-	image_create_info.samples           = numSample;
+	image_create_info.samples           = VK_SAMPLE_COUNT_1_BIT;
 	image_create_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
 	image_create_info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
 	// Set initial layout of the image to undefined
 	image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	image_create_info.extent        = {texture.width, texture.height, 1};
-	image_create_info.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	image_create_info.usage         = usage;
 	VK_CHECK(vkCreateImage(device, &image_create_info, nullptr, &texture.image), "vkCreateImage");
 
   VkMemoryAllocateInfo memory_allocate_info = VulkanInit::memory_allocate_info();
@@ -736,7 +838,27 @@ inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	VK_CHECK(vkAllocateMemory(device, &memory_allocate_info, nullptr, &texture.device_memory), "vkAllocateMemory");
 	VK_CHECK(vkBindImageMemory(device, texture.image, texture.device_memory, 0), "vkBindImageMemory");
+}
 
+// Creates texture.image (texture.width x texture.height, texture.mip_levels
+// levels) and fills it from the regions of the staging buffer. With blitMips
+// only level 0 needs to be in the staging buffer, the remaining levels are
+// blitted from it. The image is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+inline void createTextureImage(Utils::Texture &texture, VkFormat format,
+                               VkPhysicalDevice physicalDevice,
+                               VkDevice device,
+                               VkCommandPool commandPool,
+                               VkQueue submitQueue,
+                               VkBuffer stagingBuffer,
+                               const std::vector<VkBufferImageCopy> &buffer_copy_regions,
+                               bool blitMips,
+                               VkImageUsageFlags extraUsage = 0) {
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | extraUsage;
+  // The blits read from the image itself
+  if (blitMips) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  allocateTextureImage(texture, format, usage, physicalDevice, device);
 
   VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
 
@@ -776,25 +898,20 @@ inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
 	    0, nullptr,
 	    1, &image_memory_barrier);
 
-  VkBufferImageCopy buffer_copy_region               = {};
-			buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-			buffer_copy_region.imageSubresource.mipLevel       = 0;
-			buffer_copy_region.imageSubresource.baseArrayLayer = 0;
-			buffer_copy_region.imageSubresource.layerCount     = 1;
-			buffer_copy_region.imageExtent.width               = texture.width;
-			buffer_copy_region.imageExtent.height              = texture.height;
-			buffer_copy_region.imageExtent.depth               = 1;
-			buffer_copy_region.bufferOffset                    = 0;
-
   vkCmdCopyBufferToImage(
 		    commandBuffer,
 		    stagingBuffer,
 		    texture.image,
 		    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		    1,
-		    &buffer_copy_region);
+		    static_cast<uint32_t>(buffer_copy_regions.size()),
+		    buffer_copy_regions.data());
 
-  // Once the data has been uploaded we transfer to the texture image to the shader read layout, so it can be sampled from
+  if (blitMips) {
+    // Fills the remaining levels and moves everything to the shader read layout
+    generateMipmaps(commandBuffer, texture.image, static_cast<int32_t>(texture.width),
+                    static_cast<int32_t>(texture.height), texture.mip_levels);
+  } else {
+    // Once the data has been uploaded we transfer to the texture image to the shader read layout, so it can be sampled from
 	image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 	image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	image_memory_barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
@@ -811,54 +928,16 @@ inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
 		    0, nullptr,
 		    0, nullptr,
 		    1, &image_memory_barrier);
+  }
   
   // Store current layout for later reuse
 	texture.image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
   endSingleTimeCommands(device, commandPool, commandBuffer, submitQueue);
+}
 
-  // Clean up staging resources
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-
-  // Create a texture sampler
-	// In Vulkan textures are accessed by samplers
-	// This separates all the sampling information from the texture data. This means you could have multiple sampler objects for the same texture with different settings
-	// Note: Similar to the samplers available with OpenGL 3.3
-	VkSamplerCreateInfo sampler = VulkanInit::sampler_create_info();
-	sampler.magFilter           = VK_FILTER_LINEAR;
-	sampler.minFilter           = VK_FILTER_LINEAR;
-	sampler.mipmapMode          = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	sampler.addressModeU        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler.addressModeV        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler.addressModeW        = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler.mipLodBias          = 0.0f;
-	sampler.compareOp           = VK_COMPARE_OP_NEVER;
-	sampler.minLod              = 0.0f;
-	// Set max level-of-detail to mip level count of the texture
-	sampler.maxLod = static_cast<float>(texture.mip_levels);
-	// Enable anisotropic filtering
-	// This feature is optional, so we must check if it's supported on the device
-
-  VkPhysicalDeviceFeatures features{};
-  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
-	if (features.samplerAnisotropy)
-	{
-    VkPhysicalDeviceProperties properties{};
-    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
-		// Use max. level of anisotropy for this example
-		sampler.maxAnisotropy    = properties.limits.maxSamplerAnisotropy;
-		sampler.anisotropyEnable = VK_TRUE;
-	}
-	else
-	{
-		// The device does not support anisotropic filtering
-		sampler.maxAnisotropy    = 1.0;
-		sampler.anisotropyEnable = VK_FALSE;
-	}
-	sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	VK_CHECK(vkCreateSampler(device, &sampler, nullptr, &texture.sampler), "vkCreateSampler");
-
+// View over every mip level of texture.image
+inline void createTextureImageView(Utils::Texture &texture, VkFormat format, VkDevice device) {
   // Create image view
 	// Textures are not directly accessed by the shaders and
 	// are abstracted by image views containing additional
@@ -879,6 +958,193 @@ inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
 	// The view will be based on the texture's image
 	view.image = texture.image;
 	VK_CHECK(vkCreateImageView(device, &view, nullptr, &texture.view), "vkCreateImageView");
+}
+
+// One copy region per mip level, levels[i] goes to mip level i
+inline std::vector<VkBufferImageCopy> mipCopyRegions(const std::vector<MipGenerator::MipLevel> &levels) {
+  std::vector<VkBufferImageCopy> buffer_copy_regions(levels.size());
+  for (size_t i = 0; i < levels.size(); i++) {
+			VkBufferImageCopy &buffer_copy_region              = buffer_copy_regions[i];
+			buffer_copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			buffer_copy_region.imageSubresource.mipLevel       = static_cast<uint32_t>(i);
+			buffer_copy_region.imageSubresource.baseArrayLayer = 0;
+			buffer_copy_region.imageSubresource.layerCount     = 1;
+			buffer_copy_region.imageExtent.width               = levels[i].width;
+			buffer_copy_region.imageExtent.height              = levels[i].height;
+			buffer_copy_region.imageExtent.depth               = 1;
+			buffer_copy_region.bufferOffset                    = levels[i].offset;
+  }
+  return buffer_copy_regions;
+}
+
+// Loads the image with its full mip chain.
+// The mips are blitted on the GPU when the format supports linear blits,
+// otherwise they are generated on the CPU and uploaded with the base level.
+// texture.sampler is left empty, samplers are shared (see SamplerCache)
+inline Utils::Texture loadTexture(const char *texPath, VkFormat format,
+                        VkPhysicalDevice physicalDevice,
+                        VkDevice device, 
+                        VkCommandPool commandPool,
+                        VkQueue submitQueue) {
+  Utils::Texture texture{};
+
+  texture.texPath = texPath;
+
+  int texWidth, texHeight, texChannels;
+  stbi_uc *pixels = stbi_load(texPath, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+  if (!pixels) {
+    throw std::runtime_error("failed to load texture image: " + std::string(texPath));
+  }
+
+  texture.height = texHeight;
+  texture.width = texWidth;
+  texture.mip_levels = MipGenerator::mipLevelCount(texture.width, texture.height);
+
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+  const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                            VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  bool blitMips = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+  // Levels that get copied from the staging buffer, only the base level when
+  // the GPU generates the rest
+  std::vector<MipGenerator::MipLevel> levels;
+  std::vector<uint8_t> chain;
+  if (blitMips) {
+    levels.push_back({texture.width, texture.height, 0, static_cast<size_t>(texture.width) * texture.height * 4});
+  } else {
+    levels = MipGenerator::generateMipChain(pixels, texture.width, texture.height, chain);
+  }
+  VkDeviceSize imageSize = levels.back().offset + levels.back().size;
+
+  // Now copy raw image data to an optimal tiled image
+  // This loads the texture data into a host local buffer that is copied to the optimal tiled image on the device
+
+  // Create a host-visible staging buffer that contains the raw image data
+  // This buffer will be the data source for copying texture data to the optimal tiled image on the device
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+
+  createBuffer(physicalDevice, device, imageSize,
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               &stagingBuffer, &stagingBufferMemory);
+  void *data;
+  vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+  memcpy(data, blitMips ? pixels : chain.data(), static_cast<size_t>(imageSize));
+  vkUnmapMemory(device, stagingBufferMemory);
+
+  stbi_image_free(pixels);
+
+  createTextureImage(texture, format, physicalDevice, device, commandPool, submitQueue,
+                     stagingBuffer, mipCopyRegions(levels), blitMips);
+
+  // Clean up staging resources
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+
+  createTextureImageView(texture, format, device);
+
+  return texture;
+}
+
+// Loads a block compressed KTX2 file written by tools/texture_cooker.
+// The file is memory mapped and the blocks are copied from the mapping to the
+// staging buffer as they are. If the device can't sample the format (no
+// textureCompressionBC) the blocks are decoded to RGBA8 on the CPU instead.
+// Like loadTexture, texture.sampler is left empty.
+// Levels above baseLevel are skipped, the image then starts at baseLevel.
+inline Utils::Texture loadTextureKTX2(const char *texPath,
+                                      VkPhysicalDevice physicalDevice,
+                                      VkDevice device,
+                                      VkCommandPool commandPool,
+                                      VkQueue submitQueue,
+                                      uint32_t baseLevel = 0,
+                                      VkImageUsageFlags extraUsage = 0) {
+  Utils::Texture texture{};
+
+  texture.texPath = texPath;
+
+  MappedFile file;
+  if (!file.open(texPath)) {
+    throw std::runtime_error("failed to open texture: " + std::string(texPath));
+  }
+
+  KTX2::Texture ktx;
+  std::string error;
+  if (!KTX2::parse(file.data(), file.size(), ktx, error)) {
+    throw std::runtime_error("failed to load texture " + std::string(texPath) + ": " + error);
+  }
+
+  // Drop the levels above baseLevel
+  baseLevel = std::min(baseLevel, static_cast<uint32_t>(ktx.levels.size()) - 1);
+  ktx.levels.erase(ktx.levels.begin(), ktx.levels.begin() + baseLevel);
+
+  texture.width = ktx.levels[0].width;
+  texture.height = ktx.levels[0].height;
+  texture.mip_levels = static_cast<uint32_t>(ktx.levels.size());
+
+  VkFormat format = ktx.format;
+  bool decode = !canSampleFormat(physicalDevice, format);
+
+  TextureCompression::Format compression;
+  if (decode) {
+    if (!KTX2::toCompressionFormat(format, compression)) {
+      throw std::runtime_error("texture format not supported by the device: " + std::string(texPath));
+    }
+    format = KTX2::isSRGB(format) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    std::cout << "Decoding " << texPath << " on the CPU, the device can't sample format " << ktx.format << "\n";
+  }
+
+  // Pack the levels back to back in the staging buffer. Every level is a
+  // whole number of blocks so the offsets stay block aligned
+  std::vector<MipGenerator::MipLevel> levels(ktx.levels.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < ktx.levels.size(); i++) {
+    levels[i].width = ktx.levels[i].width;
+    levels[i].height = ktx.levels[i].height;
+    levels[i].offset = offset;
+    levels[i].size = decode ? static_cast<size_t>(levels[i].width) * levels[i].height * 4
+                            : static_cast<size_t>(ktx.levels[i].size);
+    offset += levels[i].size;
+  }
+  VkDeviceSize imageSize = offset;
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+
+  createBuffer(physicalDevice, device, imageSize,
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+               &stagingBuffer, &stagingBufferMemory);
+  void *data;
+  vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+  uint8_t *staging = static_cast<uint8_t *>(data);
+  for (size_t i = 0; i < levels.size(); i++) {
+    const uint8_t *blocks = file.data() + ktx.levels[i].offset;
+    if (!decode) {
+      memcpy(staging + levels[i].offset, blocks, levels[i].size);
+    } else if (!TextureCompression::decompressImage(blocks, levels[i].width, levels[i].height,
+                                                    compression, staging + levels[i].offset)) {
+      std::cout << "Level " << i << " of " << texPath << " uses BC7 modes that can't be decoded\n";
+    }
+  }
+  vkUnmapMemory(device, stagingBufferMemory);
+
+  file.close();
+
+  createTextureImage(texture, format, physicalDevice, device, commandPool, submitQueue,
+                     stagingBuffer, mipCopyRegions(levels), false, extraUsage);
+
+  // Clean up staging resources
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+
+  createTextureImageView(texture, format, device);
 
   return texture;
 }
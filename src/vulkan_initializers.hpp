@@ -232,7 +232,7 @@ inline VkDescriptorImageInfo create_descriptor_texture_raw(VkSampler sampler, Vk
     return descriptorImageInfo;
   }
 
-inline VkDescriptorImageInfo create_descriptor_texture(Utils::Texture &texture)
+inline VkDescriptorImageInfo create_descriptor_texture(const Utils::Texture &texture)
 {
 	VkDescriptorImageInfo descriptor{};
 	descriptor.sampler   = texture.sampler;
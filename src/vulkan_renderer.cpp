@@ -19,29 +19,51 @@ VulkanRenderer::VulkanRenderer(SDL_Window *sdlWindow) {
 }
 
 VulkanRenderer::~VulkanRenderer() {
+  // Retired textures and the last frames may still be in flight
+  vkDeviceWaitIdle(mLogicalDevice);
 
-  for (size_t i = 0; i < mModels.size(); i++)
+  for (size_t i = 0; i < mMeshes.size(); i++)
   {
-    vkDestroyBuffer(mLogicalDevice, mModels[i].mVertexBuffer, nullptr);
-    vkFreeMemory(mLogicalDevice, mModels[i].mVertexBufferMemory, nullptr);
+    vkDestroyBuffer(mLogicalDevice, mMeshes[i].mVertexBuffer, nullptr);
+    vkFreeMemory(mLogicalDevice, mMeshes[i].mVertexBufferMemory, nullptr);
+
+    vkDestroyBuffer(mLogicalDevice, mMeshes[i].mIndexBuffer, nullptr);
+    vkFreeMemory(mLogicalDevice, mMeshes[i].mIndexBufferMemory, nullptr);
+  }
 
-    vkDestroyBuffer(mLogicalDevice, mModels[i].mIndexBuffer, nullptr);
-    vkFreeMemory(mLogicalDevice, mModels[i].mIndexBufferMemory, nullptr);
+  for (ObjectBuffer &objects : mObjectBuffers) {
+    destroyObjectBuffer(objects);
+  }
+  vkDestroyBuffer(mLogicalDevice, mUBOScene, nullptr);
+  vkFreeMemory(mLogicalDevice, mUBOSceneMemory, nullptr);
 
-    vkDestroyBuffer(mLogicalDevice, mModels[i].mUniformBuffer, nullptr);
-    vkFreeMemory(mLogicalDevice, mModels[i].mUniformBuffersMemory, nullptr);
+  for (const Utils::Material &material : mMaterials) {
+    mTextureManager.release(material.mTextureIndex);
   }
+  mTextureManager.destroy();
 
+  mPipelineManager.destroy();
+  mShaderObjects.destroy();
+  mDebugDraw.destroy();
+  delete mTextOverlay;
+  mGpuTimer.destroy();
+  mShaderManager.destroy();
+
+  destroyRenderTargets();
   for (auto imageView : mSwapChainImageViews) {
     vkDestroyImageView(mLogicalDevice, imageView, nullptr);
   }
   vkDestroySwapchainKHR(mLogicalDevice, mSwapChain, nullptr);
 
-  for (size_t i = 0; i < mImageAvailableSemaphores.size(); i++) {
-    vkDestroySemaphore(mLogicalDevice, mRenderFinishedSemaphores[i], nullptr);
-    vkDestroySemaphore(mLogicalDevice, mImageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(mLogicalDevice, mInFlightFences[i], nullptr);
-  }
+  destroySyncObjects();
+
+  mDescriptorBuffer.destroy();
+  mDescriptorAllocator.destroy();
+  mPipelineLayoutCache.destroy();
+  mDescriptorLayoutCache.destroy();
+
+  mPipelineCache.save();
+  mPipelineCache.destroy();
 
   vkDestroyCommandPool(mLogicalDevice, mCommandPool, nullptr);
   vkDestroyDevice(mLogicalDevice, nullptr);
@@ -52,6 +74,18 @@ VulkanRenderer::~VulkanRenderer() {
 
 void VulkanRenderer::beginVulkanObjectCreation(){
 
+  auto startupStart = std::chrono::high_resolution_clock::now();
+  // Shared by the scene and text overlay pipelines
+  bool warmCache = mPipelineCache.init(mPhysicalDevice, mLogicalDevice, mPipelineCachePath);
+
+#ifdef VKGAME_SHADER_SOURCE_DIR
+  mShaderManager.init(VKGAME_SHADER_SOURCE_DIR, "shader_cache");
+#else
+  mShaderManager.init("shaders", "shader_cache");
+#endif
+  mSceneVertShader = mBindless ? "bindless.vert" : "simple_shader.vert";
+  mSceneFragShader = mBindless ? "bindless.frag" : "simple_shader.frag";
+
   //pickPhysicalDevice();
   //createLogicalDevice();
 
@@ -59,36 +93,68 @@ void VulkanRenderer::beginVulkanObjectCreation(){
   createSwapChainImageViews();
   
 
-  mTextOverlay = new TextOverlay(mPhysicalDevice, mLogicalDevice, mQueueFamilyIndices.graphicsFamily, mSwapChainImageViews, mSwapChainImageFormat, mSwapChainExtent, mGraphicsQueue);
+  mTextOverlay = new TextOverlay(mPhysicalDevice, mLogicalDevice, mQueueFamilyIndices.graphicsFamily, mSwapChainImageCount, mColorFormat, mMsaaSamples, mSwapChainExtent, mGraphicsQueue, mPipelineCache.getCache(),
+                                 mShaderManager.getSpirv("text.vert"), mShaderManager.getSpirv("text.frag"));
 
   mTextOverlay->beginTextUpdate();
   mTextOverlay->addText("aIs it working?", 0.0f, 0.0f, TextOverlay::alignLeft);
   mTextOverlay->addText("could It BE", static_cast<float>(mSwapChainExtent.width), 0.0f, TextOverlay::alignRight);
-  mTextOverlay->endTextUpdate();
 
   // mSwapChainImageCount is set inside createSwapChain()
   createCommandBuffers(mSwapChainImageCount);
   createSyncObjects(mSwapChainImageCount);
+  mGpuTimer.init(mPhysicalDevice, mLogicalDevice, mQueueFamilyIndices.graphicsFamily, mSwapChainImageCount);
 
   createDepthImage();
   createColorResources();
+#if VKGAME_DEBUG_DRAW
+  mDebugDraw.init(mPhysicalDevice, mLogicalDevice, mSwapChainImageCount, mColorFormat, mDepthFormat, mMsaaSamples,
+                  mShaderManager.getSpirv("debug_draw.vert"), mShaderManager.getSpirv("debug_draw.frag"),
+                  mPipelineCache.getCache());
+#endif
   //loaded before creating the descriptor set bindings
   loadTextures();
 
   //Required for pipeline layout before creation of graphics pipeline
+  mDescriptorLayoutCache.init(mLogicalDevice);
+  mPipelineLayoutCache.init(mLogicalDevice);
   setupDescriptorSetLayout();
 
-  createGraphicsPipeline();
+  auto pipelineStart = std::chrono::high_resolution_clock::now();
+  if (mUseShaderObjects) {
+    createShaderObjects();
+  } else {
+    createPipelineManager();
+    createGraphicsPipeline();
+  }
+  auto pipelineEnd = std::chrono::high_resolution_clock::now();
 
   createUniformBuffers();
-  createDescriptorPool(1);
-
-  //createDescriptorSets();
-  createDescriptorSetsModel();
+  if (mBindless) {
+    createBindlessDescriptorSets();
+  } else if (mUseDescriptorBuffer) {
+    initDescriptorBuffer();
+    createDescriptorBufferSets();
+  } else {
+    // Sized for a typical material set, more pools are added as needed
+    mDescriptorAllocator.init(mLogicalDevice, 16,
+                              {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+                               {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}});
+    createDescriptorSets();
+  }
 
-  buildDrawingCommandBuffers();
+  const DescriptorAllocator::Stats &descriptorStats = mDescriptorAllocator.stats();
+  std::cout << "Descriptor sets: " << descriptorStats.setsAllocated << " in " << descriptorStats.poolsCreated
+            << " pools, " << mDescriptorLayoutCache.size() << " set layouts, " << mPipelineLayoutCache.size()
+            << " pipeline layouts\n";
 
+  auto startupEnd = std::chrono::high_resolution_clock::now();
+  std::cout << "Startup (" << (warmCache ? "warm" : "cold") << " pipeline cache): "
+            << std::chrono::duration<double, std::milli>(startupEnd - startupStart).count() << " ms, scene pipeline "
+            << std::chrono::duration<double, std::milli>(pipelineEnd - pipelineStart).count() << " ms\n";
 
+  // Saved right away so the next run starts warm even if this one doesn't exit cleanly
+  mPipelineCache.save();
 }
 
 void VulkanRenderer::createInstance() {
@@ -211,6 +277,77 @@ void VulkanRenderer::createLogicalDevice() {
   // enable anisotropy
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  // Cooked .ktx2 textures are BC compressed, without it they get decoded on
+  // the CPU when loaded
+  VkPhysicalDeviceFeatures supportedFeatures{};
+  vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+  deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+  // Descriptor indexing (core in 1.2) for the bindless path
+  VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{};
+  supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures2{};
+  supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures2.pNext = &supportedIndexing;
+  vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &supportedFeatures2);
+
+  VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
+  indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+  indexing_features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+  indexing_features.runtimeDescriptorArray = VK_TRUE;
+
+  // The extension is always enabled, the feature is optional
+  mUseShaderObjects = mPreferShaderObjects && ShaderObjectProgram::isSupported(mPhysicalDevice);
+  std::cout << "Scene draws with: " << (mUseShaderObjects ? "shader objects" : "pipelines") << "\n";
+  VkPhysicalDeviceShaderObjectFeaturesEXT shader_object_features{};
+  shader_object_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+  shader_object_features.shaderObject = VK_TRUE;
+
+  // Descriptor buffers (VK_EXT_descriptor_buffer) replace pools and sets
+  // altogether, when available they are used instead of bindless
+  mUseDescriptorBuffer = mPreferDescriptorBuffer && DescriptorBuffer::isSupported(mPhysicalDevice);
+
+  mBindless = mPreferBindless && !mUseDescriptorBuffer &&
+              supportedIndexing.shaderSampledImageArrayNonUniformIndexing &&
+              supportedIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+              supportedIndexing.descriptorBindingPartiallyBound &&
+              supportedIndexing.descriptorBindingVariableDescriptorCount &&
+              supportedIndexing.runtimeDescriptorArray;
+
+  if (mBindless) {
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(mPhysicalDevice, &properties2);
+    mMaxBindlessTextures = std::min(mMaxBindlessTextures,
+                                    indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages);
+  }
+  std::cout << "Descriptor model: "
+            << (mUseDescriptorBuffer ? "descriptor buffer" : mBindless ? "bindless" : "set per material") << "\n";
+
+  std::vector<const char *> enabledExtensions = mDeviceExtensions;
+  if (mUseDescriptorBuffer) {
+    enabledExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+  }
+  // Heap usage and budgets for the perf HUD
+  mMemoryBudget = VulkanHelper::iCheckDeviceExtensionSupport(mPhysicalDevice, {VK_EXT_MEMORY_BUDGET_EXTENSION_NAME});
+  if (mMemoryBudget) {
+    enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  VkPhysicalDeviceBufferDeviceAddressFeatures buffer_address_features{};
+  buffer_address_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+  buffer_address_features.bufferDeviceAddress = VK_TRUE;
+  VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features{};
+  descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+  descriptor_buffer_features.descriptorBuffer = VK_TRUE;
+  descriptor_buffer_features.pNext = &buffer_address_features;
+
   uint32_t enabledLayerCount = 0;
   const char *const *enabledLayerNames;
 
@@ -229,8 +366,8 @@ void VulkanRenderer::createLogicalDevice() {
       queueCreateInfos.data(), 
       enabledLayerCount,
       enabledLayerNames, 
-      static_cast<uint32_t>(mDeviceExtensions.size()), 
-      mDeviceExtensions.data(),
+      static_cast<uint32_t>(enabledExtensions.size()), 
+      enabledExtensions.data(),
       &deviceFeatures);
 
   // Query vk12 features
@@ -256,8 +393,17 @@ extended_dynamic_state3_features.extendedDynamicState3ColorWriteMask = true;
 
 
 dynamic_rendering_feature.pNext = &extended_dynamic_state3_features;
+  if (mBindless) {
+    extended_dynamic_state3_features.pNext = &indexing_features;
+  } else if (mUseDescriptorBuffer) {
+    extended_dynamic_state3_features.pNext = &descriptor_buffer_features;
+  }
 
   createInfo.pNext = &dynamic_rendering_feature;
+  if (mUseShaderObjects) {
+    shader_object_features.pNext = &dynamic_rendering_feature;
+    createInfo.pNext = &shader_object_features;
+  }
   VK_CHECK(vkCreateDevice(mPhysicalDevice, &createInfo, nullptr, &mLogicalDevice), "vkCreateDevice");
 
   vkGetDeviceQueue(mLogicalDevice, mQueueFamilyIndices.graphicsFamily, 0, &mGraphicsQueue);
@@ -292,6 +438,8 @@ void VulkanRenderer::createSyncObjects(uint32_t number) {
   mImageAvailableSemaphores.resize(number);
   mRenderFinishedSemaphores.resize(number);
   mInFlightFences.resize(number);
+  mImageFrameNumbers.assign(number, 0);
+  mTextureDescriptorsDirty.assign(number, false);
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -314,120 +462,240 @@ void VulkanRenderer::createSyncObjects(uint32_t number) {
   }
 }
 
-void VulkanRenderer::buildDrawingCommandBuffers(){
-  // The size of mDrawingCommandBuffers is determined by createCommandBuffers(mSwapChainImageCount);
-  for (int32_t i = 0; i < mDrawingCommandBuffers.size(); ++i) {
-    VulkanHelper::beginDrawingCommandBuffer(mDrawingCommandBuffers[i]);
-
-    VkImageSubresourceRange range{};
-    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    range.baseMipLevel = 0;
-    range.levelCount = VK_REMAINING_MIP_LEVELS;
-    range.baseArrayLayer = 0;
-    range.layerCount = VK_REMAINING_ARRAY_LAYERS;
-
-    VulkanInit::insert_image_memory_barrier(
-        mDrawingCommandBuffers[i], mSwapChainImages[i],
-        0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, range);
-
-    // Normally renderpass, use renderinginfo for dynamic rendering
-    VkRenderingAttachmentInfoKHR renderingColorAttachmentInfo{};
-    renderingColorAttachmentInfo.sType =
-        VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    renderingColorAttachmentInfo.imageView =
-        mColorImageView;
-    renderingColorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    renderingColorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    renderingColorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
-    renderingColorAttachmentInfo.clearValue = clearColor;
-
-    renderingColorAttachmentInfo.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
-    renderingColorAttachmentInfo.resolveImageView = mSwapChainImageViews[i];
-    renderingColorAttachmentInfo.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
-    /*
-    VkRenderingAttachmentInfoKHR renderingColorAttachmentInfo{};
-    renderingColorAttachmentInfo.sType =
-        VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    renderingColorAttachmentInfo.imageView =
-        mSwapChainImageViews[i];
-    renderingColorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    renderingColorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    renderingColorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
-    renderingColorAttachmentInfo.clearValue = clearColor;
-    */
-
-
-
-    VkRenderingInfoKHR renderingInfo{};
-    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
-    renderingInfo.renderArea.offset = {0, 0};
-    renderingInfo.renderArea.extent = mSwapChainExtent;
-    renderingInfo.layerCount = 1;
-    renderingInfo.colorAttachmentCount = 1;
-    renderingInfo.pColorAttachments = &renderingColorAttachmentInfo;
-    //Can add depth attachment here for depth buffering
-    
-    VkRenderingAttachmentInfoKHR renderingDepthAttachmentInfo{};
-    renderingDepthAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    renderingDepthAttachmentInfo.imageView = mDepthImageView;
-    renderingDepthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_STENCIL_ATTACHMENT_OPTIMAL;
-    renderingDepthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    renderingDepthAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    VkClearValue clearColorDepth = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
-    clearColorDepth.depthStencil = {1.0f, 0};
-    renderingDepthAttachmentInfo.clearValue = clearColorDepth;
-    renderingInfo.pDepthAttachment = &renderingDepthAttachmentInfo;
-    renderingInfo.pDepthAttachment = nullptr;
+void VulkanRenderer::destroySyncObjects() {
+  for (size_t i = 0; i < mImageAvailableSemaphores.size(); i++) {
+    vkDestroySemaphore(mLogicalDevice, mRenderFinishedSemaphores[i], nullptr);
+    vkDestroySemaphore(mLogicalDevice, mImageAvailableSemaphores[i], nullptr);
+    vkDestroyFence(mLogicalDevice, mInFlightFences[i], nullptr);
+  }
+  mImageAvailableSemaphores.clear();
+  mRenderFinishedSemaphores.clear();
+  mInFlightFences.clear();
+}
+
+void VulkanRenderer::recordDrawingCommandBuffer(uint32_t imageIndex){
+  TRACE_ZONE("VulkanRenderer::recordDrawingCommandBuffer");
+  // Recorded every frame, the model matrices go in as push constants
+  VkCommandBuffer commandBuffer = mDrawingCommandBuffers[imageIndex];
+  VK_CHECK(vkResetCommandBuffer(commandBuffer, 0), "vkResetCommandBuffer");
+  VulkanHelper::beginDrawingCommandBuffer(commandBuffer);
+  mGpuTimer.beginFrame(commandBuffer, imageIndex);
+  uint32_t frameScope = mGpuTimer.begin(commandBuffer, "frame");
+  mFrameStats.draws = 0;
+  mFrameStats.triangles = 0;
+  mFrameStats.descriptorBinds = 0;
+  mFrameStats.pipelineBinds = 0;
+
+  // Glyph atlas uploads have to happen outside of rendering
+  mTextOverlay->prepareFrame(imageIndex, commandBuffer);
+
+  if (mDrawDebugBounds) {
+    for (size_t k = 0; k < mEntities.size(); k++) {
+      if (mEntities.mVisible[k]) {
+        mDebugDraw.box(mEntities.mBounds[k], glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+      }
+    }
+    // First entity is the light, drawn through whatever is in front of it
+    mDebugDraw.sphere(mEntities.mPositions[0], 0.25f, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f), false);
+  }
+  mDebugDraw.prepareFrame(imageIndex);
+
+  VkImageSubresourceRange range{};
+  range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  range.baseMipLevel = 0;
+  range.levelCount = VK_REMAINING_MIP_LEVELS;
+  range.baseArrayLayer = 0;
+  range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+  VulkanInit::insert_image_memory_barrier(
+      commandBuffer, mSwapChainImages[imageIndex],
+      0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, range);
+
+  // Normally renderpass, use renderinginfo for dynamic rendering
+  VkRenderingAttachmentInfoKHR renderingColorAttachmentInfo{};
+  renderingColorAttachmentInfo.sType =
+      VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  renderingColorAttachmentInfo.imageView =
+      mColorImageView;
+  renderingColorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  renderingColorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  renderingColorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
+  renderingColorAttachmentInfo.clearValue = clearColor;
+
+  renderingColorAttachmentInfo.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+  renderingColorAttachmentInfo.resolveImageView = mSwapChainImageViews[imageIndex];
+  renderingColorAttachmentInfo.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL_KHR;
+  /*
+  VkRenderingAttachmentInfoKHR renderingColorAttachmentInfo{};
+  renderingColorAttachmentInfo.sType =
+      VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  renderingColorAttachmentInfo.imageView =
+      mSwapChainImageViews[imageIndex];
+  renderingColorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  renderingColorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  renderingColorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  VkClearValue clearColor = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
+  renderingColorAttachmentInfo.clearValue = clearColor;
+  */
+
+
+
+  VkRenderingInfoKHR renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+  renderingInfo.renderArea.offset = {0, 0};
+  renderingInfo.renderArea.extent = mSwapChainExtent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachments = &renderingColorAttachmentInfo;
+  //Can add depth attachment here for depth buffering
   
-    // dynamic rendering end
-    //===============================================================
+  VkRenderingAttachmentInfoKHR renderingDepthAttachmentInfo{};
+  renderingDepthAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+  renderingDepthAttachmentInfo.imageView = mDepthImageView;
+  renderingDepthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  renderingDepthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  // Only needed within the pass
+  renderingDepthAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  VkClearValue clearColorDepth = {{{0.2f, 0.2f, 0.2f, 1.0f}}};
+  clearColorDepth.depthStencil = {1.0f, 0};
+  renderingDepthAttachmentInfo.clearValue = clearColorDepth;
+  renderingInfo.pDepthAttachment = &renderingDepthAttachmentInfo;
+
+  // One depth image for every frame, the previous frame's tests have to be
+  // done before this one clears it
+  VkImageSubresourceRange depthRange = range;
+  depthRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (VulkanHelper::hasStencilComponent(mDepthFormat)) {
+    depthRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  }
+  VulkanInit::insert_image_memory_barrier(
+      commandBuffer, mDepthImage,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, depthRange);
+
+  // dynamic rendering end
+  //===============================================================
 
-    vkCmdBeginRendering(mDrawingCommandBuffers[i], &renderingInfo);
+  vkCmdBeginRendering(commandBuffer, &renderingInfo);
 
 PFN_vkCmdSetRasterizationSamplesEXT vkCmdSetRasterizationSamplesEXT     = PFN_vkCmdSetRasterizationSamplesEXT( vkGetDeviceProcAddr( mLogicalDevice, "vkCmdSetRasterizationSamplesEXT" ) );    
-vkCmdSetRasterizationSamplesEXT(mDrawingCommandBuffers[i], mMsaaSamples);
+vkCmdSetRasterizationSamplesEXT(commandBuffer, mMsaaSamples);
 
 
 
-    // drawFromVertices(mDrawingCommandBuffers[i],
-    //                                   mGraphicsPipeline,
-    //                                   mVertices,
-    //                                   mVertexBuffer);
+  // drawFromVertices(commandBuffer,
+  //                                   mGraphicsPipeline,
+  //                                   mVertices,
+  //                                   mVertexBuffer);
 
 
-    // For multiple objects, add more calls to drawFromDescriptors
-    //drawFromDescriptors(mDrawingCommandBuffers[i], mGraphicsPipeline, mVertices, mIndices, mVertexBuffer, mIndexBuffer);
-    //
-    for(int k = 0; k < mModels.size(); k++) {
-
-      drawFromDescriptors(mDrawingCommandBuffers[i], 
-                          mGraphicsPipeline, 
-                          mModels[k].mVertices, 
-                          mModels[k].mIndices, 
-                          mModels[k].mVertexBuffer, 
-                          mModels[k].mIndexBuffer,
-                          mModels[k].mDescriptorSet);
-    }
+  // For multiple objects, add more calls to drawFromDescriptors
+  //drawFromDescriptors(commandBuffer, mGraphicsPipeline, mVertices, mIndices, mVertexBuffer, mIndexBuffer);
+  //
+  uint32_t sceneScope = mGpuTimer.begin(commandBuffer, "scene");
+  VkPipeline boundPipeline = VK_NULL_HANDLE;
+  if (mUseShaderObjects) {
+    mShaderObjects.bind(commandBuffer, mSwapChainExtent, mMsaaSamples);
+  } else {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mGraphicsPipeline);
+    boundPipeline = mGraphicsPipeline;
+    mFrameStats.pipelineBinds++;
+
+    VkViewport viewport = VulkanInit::viewport((float)mSwapChainExtent.width, (float)mSwapChainExtent.height, 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor = VulkanInit::rect2D(mSwapChainExtent.width, mSwapChainExtent.height, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  }
 
-    vkCmdEndRendering(mDrawingCommandBuffers[i]);
+  if (mBindless) {
+    // Bound once, every draw finds its object data and texture through the instance index
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mBindlessSets[imageIndex], 0, nullptr);
+    mFrameStats.descriptorBinds++;
+  } else if (mUseDescriptorBuffer) {
+    mDescriptorBuffer.bind(commandBuffer);
+  }
+  uint32_t boundMaterial = UINT32_MAX;
+  for(size_t k = 0; k < mEntities.size(); k++) {
+    if (!mEntities.mVisible[k]) {
+      continue;
+    }
+    const Utils::Mesh &mesh = mMeshes[mEntities.mMeshes[k]];
+    mFrameStats.draws++;
+    mFrameStats.triangles += mesh.mIndexCount / 3;
+
+    // Only rebind when the material changes
+    uint32_t material = mEntities.mMaterials[k];
+    if (material != boundMaterial) {
+      if (!mUseShaderObjects) {
+        // Permutations still compiling draw with the default pipeline meanwhile
+        VkPipeline pipeline = mPipelineManager.getPipeline(sceneStateKey(mMaterials[material]), mGraphicsPipeline);
+        if (pipeline != boundPipeline) {
+          vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+          boundPipeline = pipeline;
+          mFrameStats.pipelineBinds++;
+        }
+      }
+      size_t set = material * mSwapChainImageCount + imageIndex;
+      if (mUseDescriptorBuffer) {
+        mDescriptorBuffer.bindSet(commandBuffer, mPipelineLayout, 0, mDescriptorBufferSets[set]);
+        mFrameStats.descriptorBinds++;
+      } else if (!mBindless) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSets[set], 0, nullptr);
+        mFrameStats.descriptorBinds++;
+      }
+      boundMaterial = material;
+    }
 
-    VulkanInit::insert_image_memory_barrier(
-        mDrawingCommandBuffers[i], mSwapChainImages[i],
-        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0,
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, range);
+    if (mBindless) {
+      drawBindless(commandBuffer,
+                   mesh.mIndexCount,
+                   mesh.mVertexBuffer,
+                   mesh.mIndexBuffer,
+                   static_cast<uint32_t>(k));
+      continue;
+    }
 
+    Utils::ModelPushConstants pushConstants{};
+    pushConstants.modelPos = glm::translate(glm::mat4(1.0f), mEntities.mPositions[k]);
+    pushConstants.objectIndex = static_cast<uint32_t>(k);
 
-    VK_CHECK(vkEndCommandBuffer(mDrawingCommandBuffers[i]), "vkEndCommandBuffer"); 
+    drawFromDescriptors(commandBuffer, 
+                        mesh.mIndexCount, 
+                        mesh.mVertexBuffer, 
+                        mesh.mIndexBuffer,
+                        pushConstants);
   }
 
+  mGpuTimer.end(commandBuffer, sceneScope);
+
+  uint32_t overlayScope = mGpuTimer.begin(commandBuffer, "overlay");
+  // After the scene so depth tested lines are hidden by it
+  mDebugDraw.draw(commandBuffer, imageIndex, mProjMatrix * mViewMatrix, mSwapChainExtent);
+
+  // Last in the pass so it lands in the same MSAA resolve as the scene, no
+  // second pass loading and storing the swapchain image
+  mTextOverlay->draw(commandBuffer, imageIndex);
+  mGpuTimer.end(commandBuffer, overlayScope);
+
+  vkCmdEndRendering(commandBuffer);
+
+  VulkanInit::insert_image_memory_barrier(
+      commandBuffer, mSwapChainImages[imageIndex],
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, range);
+
+  mGpuTimer.end(commandBuffer, frameScope);
+  VK_CHECK(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer"); 
 }
 
 void VulkanRenderer::createSwapChain(VkSurfaceKHR surface) {
@@ -526,6 +794,7 @@ void VulkanRenderer::createDepthImage() {
       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
        VK_FORMAT_D24_UNORM_S8_UINT},
       VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+  mDepthFormat = format;
 
 	VkImageCreateInfo image_create_info = VulkanInit::image_create_info();
 	image_create_info.imageType         = VK_IMAGE_TYPE_2D;
@@ -566,7 +835,7 @@ void VulkanRenderer::createDepthImage() {
 // for MSAA
 void VulkanRenderer::createColorResources() {
 
-  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+  VkFormat format = mColorFormat;
 	VkImageCreateInfo image_create_info = VulkanInit::image_create_info();
 	image_create_info.imageType         = VK_IMAGE_TYPE_2D;
 	image_create_info.format            = format;
@@ -582,7 +851,7 @@ void VulkanRenderer::createColorResources() {
 	image_create_info.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	VK_CHECK(vkCreateImage(mLogicalDevice, &image_create_info, nullptr, &mColorImage), "vkCreateImage");
   VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(mLogicalDevice, mDepthImage, &memRequirements);
+  vkGetImageMemoryRequirements(mLogicalDevice, mColorImage, &memRequirements);
 
   VkMemoryAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -597,211 +866,95 @@ void VulkanRenderer::createColorResources() {
 
 }
 
+void VulkanRenderer::destroyRenderTargets() {
+  vkDestroyImageView(mLogicalDevice, mDepthImageView, nullptr);
+  vkDestroyImage(mLogicalDevice, mDepthImage, nullptr);
+  vkFreeMemory(mLogicalDevice, mDepthImageMemory, nullptr);
+
+  vkDestroyImageView(mLogicalDevice, mColorImageView, nullptr);
+  vkDestroyImage(mLogicalDevice, mColorImage, nullptr);
+  vkFreeMemory(mLogicalDevice, mColorImageMemory, nullptr);
+}
+
+
+void VulkanRenderer::createPipelineManager() {
+  VkPipelineCreateFlags flags = mUseDescriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  uint32_t workerCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+  mPipelineManager.init(mLogicalDevice, mPipelineCache.getCache(), mPipelineLayout, flags, workerCount);
+
+  mSceneShaders = mPipelineManager.addShaderProgram(mShaderManager.getSpirv(mSceneVertShader),
+                                                   mShaderManager.getSpirv(mSceneFragShader));
+  mSceneVertexLayout = mPipelineManager.addVertexLayout(mSceneVertexBinding, mSceneVertexAttributes);
+}
+
+RenderStateKey VulkanRenderer::sceneStateKey(const Utils::Material &material) const {
+  RenderStateKey key{};
+  key.shaderProgram = mSceneShaders;
+  key.vertexLayout = mSceneVertexLayout;
+  key.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  key.polygonMode = VK_POLYGON_MODE_FILL;
+  key.cullMode = material.mCullMode;
+  key.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  key.depthTest = VK_TRUE;
+  key.depthWrite = material.mAlphaBlend ? VK_FALSE : VK_TRUE;
+  key.depthCompare = VK_COMPARE_OP_LESS;
+  key.alphaBlend = material.mAlphaBlend ? VK_TRUE : VK_FALSE;
+  key.colorFormat = mColorFormat;
+  key.depthFormat = mDepthFormat;
+  return key;
+}
 
 void VulkanRenderer::createGraphicsPipeline() {
+  // The default material's pipeline for the current swapchain, built right
+  // away since every other permutation falls back to it while compiling.
+  // Already built if only the size of the swapchain changed
+  mGraphicsPipeline = mPipelineManager.getPipelineNow(sceneStateKey(Utils::Material{}));
+}
 
-  //================================================================================================
-  // Create pipeline
-  //================================================================================================
-  VkGraphicsPipelineCreateInfo PIPElineInfo{};
-  PIPElineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-
-
-  //================================================================================================
-  // Create shader stage
-  //================================================================================================
-  std::string vertShaderPath = "shaders/simple_shader.vert.spv";
-  std::string fragShaderPath = "shaders/simple_shader.frag.spv";
-  auto vertShaderCode = VulkanHelper::readFile(vertShaderPath);
-  auto fragShaderCode = VulkanHelper::readFile(fragShaderPath);
-
-  // Vertex Shader
-  VkShaderModule vertShaderModule =
-      VulkanHelper::createShaderModule(mLogicalDevice, vertShaderCode);
-  VkShaderModule fragShaderModule =
-      VulkanHelper::createShaderModule(mLogicalDevice, fragShaderCode);
-
-  std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
-  shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, vertShaderCode, VK_SHADER_STAGE_VERTEX_BIT));
-  shaderStages.push_back(VulkanHelper::loadShader(mLogicalDevice, fragShaderCode, VK_SHADER_STAGE_FRAGMENT_BIT));
-
-  PIPElineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());;
-  PIPElineInfo.pStages = shaderStages.data();
-  //================================================================================================
-  // pVertexInputState
-  //================================================================================================
-  auto bindingDescription = Utils::Vertex::getBindingDescription();
-  auto attributeDescriptions = Utils::Vertex::getAttributeDescriptions();
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-  vertexInputInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription; // Optional
-
-  vertexInputInfo.vertexAttributeDescriptionCount =
-      static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.pVertexAttributeDescriptions =
-      attributeDescriptions.data(); // Optional
-
-  PIPElineInfo.pVertexInputState = &vertexInputInfo;
-
-  //================================================================================================
-  // pInputAssemblyState
-  //================================================================================================
-
-  // VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP is usefull for drawing quads, e.g.
-  // mIndices = {0, 1, 3, 2};
-  // the second and third vertex of every triangle are used as first two vertices of the next triangle
-  // the order is set as pi = {vi, vi+(1+i%2), vi+(2-i%2)}
-  // will draw similar as 
-  // mIndices = {0, 1, 2, 2, 3, 0}; in VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST mode
-  VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = 
-    VulkanInit::pipeline_input_assembly_state_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-
-  PIPElineInfo.pInputAssemblyState = &inputAssemblyState;
-
-  //================================================================================================
-  // pViewportState
-  //================================================================================================
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)mSwapChainExtent.width;
-  viewport.height = (float)mSwapChainExtent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = mSwapChainExtent;
-
-  //Can also be set in rendering command buffer if not here
-  VkPipelineViewportStateCreateInfo viewportState = VulkanInit::pipeline_viewport_state_create_Info(1, 1, 0);
-  viewportState.pViewports = &viewport;
-  viewportState.pScissors = &scissor;
-
-  PIPElineInfo.pViewportState = &viewportState;
-
-  //================================================================================================
-  // pRasterizationState
-  //================================================================================================
-  //VkPipelineRasterizationStateCreateInfo rasterizationState = VulkanInit::pipeline_rasterization_state_create_info(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
-  VkPipelineRasterizationStateCreateInfo rasterizationState = VulkanInit::pipeline_rasterization_state_create_info(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, 0);
-
-  PIPElineInfo.pRasterizationState = &rasterizationState;
-  //================================================================================================
-  // pMultisampleState
-  //================================================================================================
-  VkPipelineMultisampleStateCreateInfo multisampleState = 
-    VulkanInit::pipeline_multisample_state_create_info(mMsaaSamples, 0);
-
-  //PIPElineInfo.pMultisampleState = &multisampleState;
-  PIPElineInfo.pMultisampleState = nullptr;
-
-  //================================================================================================
-  // pDepthStencilState
-  //================================================================================================
-  VkPipelineDepthStencilStateCreateInfo  depthStencilState = 
-  VulkanInit::pipeline_depthstencil_state_create_info(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS);
-
-  PIPElineInfo.pDepthStencilState = &depthStencilState;
-  //================================================================================================
-  // pColorBlendState
-  //================================================================================================
-  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-  colorBlendAttachment.colorWriteMask =
-      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_FALSE;
-  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
-  colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;             // Optional
-  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;  // Optional
-  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;             // Optional
-
-  VkPipelineColorBlendStateCreateInfo colorBlendState = 
-    VulkanInit::pipeline_colorblend_state_create_info(1, &colorBlendAttachment);
-
-  PIPElineInfo.pColorBlendState = &colorBlendState;
-  //================================================================================================
-
-  // PIPElineInfo.pDynamicState = nullptr; // Optional
-  //
-  VkPipelineDynamicStateCreateInfo dynamic_state_info{};
-dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-const VkDynamicState dynamicStates[] = {
-VK_DYNAMIC_STATE_SAMPLE_MASK_EXT,
-VK_DYNAMIC_STATE_ALPHA_TO_COVERAGE_ENABLE_EXT,
-VK_DYNAMIC_STATE_ALPHA_TO_ONE_ENABLE_EXT ,
-VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT };
-dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
-dynamic_state_info.pDynamicStates = dynamicStates;
-
-  PIPElineInfo.pDynamicState = &dynamic_state_info; // Optional
-
-  //================================================================================================
-  // pipelineLayout
-  //================================================================================================
-  // VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  // pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-  // // Descriptor set layouts
-  // pipelineLayoutInfo.setLayoutCount = 1; // Optional
-
-  // VkDescriptorSetLayout descriptorSetLayout =
-  //     VulkanInit::create_descriptorSetLayout(mLogicalDevice);
-  // pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout; // Optional
-
-  // // Push constants
-  // pipelineLayoutInfo.pushConstantRangeCount = 0;    // Optional
-  // pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-  // VK_CHECK(vkCreatePipelineLayout(mLogicalDevice, &pipelineLayoutInfo, nullptr, &mPipelineLayout), 
-  //          "vkCreatePipelineLayout");
-
-  PIPElineInfo.layout = mPipelineLayout;
-  //================================================================================================
-  PIPElineInfo.renderPass = nullptr;
-  PIPElineInfo.subpass = 0;
-  //================================================================================================
-  PIPElineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-  PIPElineInfo.basePipelineIndex = -1;              // Optional
-  //================================================================================================
-  // For dynamic rendering
-  //================================================================================================
-  VkPipelineRenderingCreateInfoKHR pipeline_rendering_create_info{};
-  pipeline_rendering_create_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
-
-  pipeline_rendering_create_info.colorAttachmentCount = 1;
-  pipeline_rendering_create_info.pColorAttachmentFormats =
-      &mSwapChainImageFormat;
-
-  pipeline_rendering_create_info.depthAttachmentFormat =
-      VulkanHelper::findSupportedFormat(
-          mPhysicalDevice,
-          {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
-           VK_FORMAT_D24_UNORM_S8_UINT},
-          VK_IMAGE_TILING_OPTIMAL,
-          VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-
-  pipeline_rendering_create_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
-
-  PIPElineInfo.pNext = &pipeline_rendering_create_info;
-
-  //================================================================================================
-  VK_CHECK(vkCreateGraphicsPipelines(mLogicalDevice, VK_NULL_HANDLE, 1, &PIPElineInfo, nullptr, &mGraphicsPipeline),
-           "vkCreateGraphicsPipelines");
-
-  // Cleanup===========
-  vkDestroyShaderModule(mLogicalDevice, fragShaderModule, nullptr);
-  vkDestroyShaderModule(mLogicalDevice, vertShaderModule, nullptr);
-  //================================================================================================
+void VulkanRenderer::createShaderObjects() {
+  // Same shaders and layout as createGraphicsPipeline(), the state is set when recording
+  auto vertShaderCode = mShaderManager.getSpirv(mSceneVertShader);
+  auto fragShaderCode = mShaderManager.getSpirv(mSceneFragShader);
+
+  mShaderObjects.create(mLogicalDevice, vertShaderCode, fragShaderCode, mDescriptorSetLayout, mScenePushConstants,
+                        mSceneVertexBinding, mSceneVertexAttributes);
 }
 
-void VulkanRenderer::createVertexBuffer(std::vector<Utils::Vertex> vertices, VkBuffer *vertexBuffer, VkDeviceMemory *vertexBufferMemory) {
+void VulkanRenderer::reloadChangedShaders() {
+  TRACE_ZONE("VulkanRenderer::reloadChangedShaders");
+  std::vector<std::string> changed = mShaderManager.pollChanges();
+  bool sceneChanged = false;
+  bool textChanged = false;
+  for (const std::string &name : changed) {
+    sceneChanged |= name == mSceneVertShader || name == mSceneFragShader;
+    textChanged |= name == "text.vert" || name == "text.frag";
+  }
+  if (!sceneChanged && !textChanged) {
+    return;
+  }
+
+  // Only the changed shaders are swapped, the old ones may still be in use
+  vkDeviceWaitIdle(mLogicalDevice);
+  if (textChanged) {
+    mTextOverlay->reloadShaders(mShaderManager.getSpirv("text.vert"), mShaderManager.getSpirv("text.frag"));
+    std::cout << "Reloaded text.vert / text.frag\n";
+  }
+  if (!sceneChanged) {
+    return;
+  }
+  if (mUseShaderObjects) {
+    mShaderObjects.destroy();
+    createShaderObjects();
+  } else {
+    mPipelineManager.reloadShaderProgram(mSceneShaders, mShaderManager.getSpirv(mSceneVertShader),
+                                         mShaderManager.getSpirv(mSceneFragShader));
+    createGraphicsPipeline();
+  }
+  std::cout << "Reloaded " << mSceneVertShader << " / " << mSceneFragShader << "\n";
+}
+
+void VulkanRenderer::createVertexBuffer(const std::vector<Utils::Vertex> &vertices, VkBuffer *vertexBuffer, VkDeviceMemory *vertexBufferMemory) {
+  TRACE_ZONE("VulkanRenderer::createVertexBuffer");
 
   VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
   // Create a staging buffer as source for cpu accessible then copy over to
@@ -832,7 +985,8 @@ void VulkanRenderer::createVertexBuffer(std::vector<Utils::Vertex> vertices, VkB
   vkFreeMemory(mLogicalDevice, stagingBufferMemory, nullptr);
 }
 
-void VulkanRenderer::createIndexBuffer(std::vector<uint32_t> indices, VkBuffer *indexBuffer, VkDeviceMemory *indexBufferMemory) {
+void VulkanRenderer::createIndexBuffer(const std::vector<uint32_t> &indices, VkBuffer *indexBuffer, VkDeviceMemory *indexBufferMemory) {
+  TRACE_ZONE("VulkanRenderer::createIndexBuffer");
   VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
   VkBuffer stagingBuffer = VK_NULL_HANDLE;
@@ -860,171 +1014,326 @@ void VulkanRenderer::createIndexBuffer(std::vector<uint32_t> indices, VkBuffer *
   vkFreeMemory(mLogicalDevice, stagingBufferMemory, nullptr);
 }
 
-void VulkanRenderer::createUniformBuffers() {
-  VkDeviceSize bufferSize = sizeof(Utils::UniformBufferObject);
+uint32_t VulkanRenderer::createMesh(const std::vector<Utils::Vertex> &vertices, const std::vector<uint32_t> &indices) {
+  Utils::Mesh mesh;
 
-  VulkanHelper::createBuffer(mPhysicalDevice, mLogicalDevice, bufferSize,
-                        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                        &mUBOScene, &mUBOSceneMemory);
+  createVertexBuffer(vertices, &mesh.mVertexBuffer, &mesh.mVertexBufferMemory);
+  createIndexBuffer(indices, &mesh.mIndexBuffer, &mesh.mIndexBufferMemory);
+  mesh.mIndexCount = static_cast<uint32_t>(indices.size());
+
+  // Only the bounds are kept from the vertex data, the caller is free to
+  // drop its copy once the mesh is uploaded
+  if (!vertices.empty()) {
+    mesh.mBounds.min = vertices[0].pos;
+    mesh.mBounds.max = vertices[0].pos;
+  }
+  for (const Utils::Vertex &vertex : vertices) {
+    mesh.mBounds.min = glm::min(mesh.mBounds.min, vertex.pos);
+    mesh.mBounds.max = glm::max(mesh.mBounds.max, vertex.pos);
+  }
+
+  mMeshes.push_back(mesh);
+  return static_cast<uint32_t>(mMeshes.size() - 1);
+}
 
+Entity VulkanRenderer::createEntity(glm::vec3 position, uint32_t mesh, uint32_t material) {
+  return mEntities.createEntity(position, mesh, material);
 }
 
-void VulkanRenderer::createUniformBufferForModel(VkBuffer *modelBuffer, VkDeviceMemory *modelMemory) {
-  VkDeviceSize bufferSizeModel = sizeof(Utils::UniformBufferObjectModel);
+void VulkanRenderer::createUniformBuffers() {
+  VkDeviceSize bufferSize = sizeof(Utils::UniformBufferObject);
+
+  // Descriptor buffers reference the UBO by its device address
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+  VkMemoryAllocateFlags allocateFlags = 0;
+  if (mUseDescriptorBuffer) {
+    usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    allocateFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+  }
 
-  VulkanHelper::createBuffer(mPhysicalDevice, mLogicalDevice, bufferSizeModel,
-                        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+  VulkanHelper::createBuffer(mPhysicalDevice, mLogicalDevice, bufferSize,
+                        usage,
                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                        modelBuffer, modelMemory);                                              
+                        &mUBOScene, &mUBOSceneMemory, allocateFlags);
+
 }
 
 void VulkanRenderer::loadTextures() {
 
+  mTextureManager.init(mPhysicalDevice, mLogicalDevice, mCommandPool, mGraphicsQueue, mMaxAnisotropy);
+
   std::filesystem::path p = std::filesystem::current_path();
 
-  // load a texture per model
-  for(int i = 0; i < mModels.size(); i++) {
-  
-    Utils::Texture firstTexture = VulkanHelper::loadTexture((p.generic_string() + "/textures/amdtexture.jpg").c_str(),
-                                                          VK_FORMAT_R8G8B8A8_SRGB,
-                                                          mPhysicalDevice,
-                                                          mLogicalDevice,
-                                                          mCommandPool,
-                                                          mGraphicsQueue,
-                                                          mMsaaSamples);
-    mTextures.push_back(firstTexture);
+  // Prefer the cooked texture (see tools/texture_cooker) over the source image
+  std::filesystem::path texturePath = p / "textures" / "amdtexture.ktx2";
+  if (!std::filesystem::exists(texturePath)) {
+    texturePath = p / "textures" / "amdtexture.jpg";
   }
-}
 
-void VulkanRenderer::createDescriptorPool(int number) {
-
-  std::vector<VkDescriptorPoolSize> poolSizes{};
-
-  VkDescriptorPoolSize poolSizeUBO{};
-  poolSizeUBO.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizeUBO.descriptorCount = static_cast<uint32_t>(number);
-  poolSizes.push_back(poolSizeUBO);
+  // The manager only loads each file once, no matter how many materials use it
+  for (Utils::Material &material : mMaterials) {
+    material.mTextureIndex = mTextureManager.acquire(texturePath.generic_string(), VK_FORMAT_R8G8B8A8_SRGB);
+  }
+  std::cout << "Textures loaded: " << mTextureManager.loadedCount() << " for " << mMaterials.size() << " materials\n";
+}
 
-  VkDescriptorPoolSize poolSizeIMGSampler{};
-  poolSizeIMGSampler.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizeIMGSampler.descriptorCount = static_cast<uint32_t>(number);
-  poolSizes.push_back(poolSizeIMGSampler);
+void VulkanRenderer::setupDescriptorSetLayout()
+{
+  // The layouts and vertex input follow whatever the scene shaders declare,
+  // hot reloaded shaders have to keep the same interface
+  std::vector<SpirvReflect::Module> modules(2);
+  std::string error;
+  if (!SpirvReflect::reflect(mShaderManager.getSpirv(mSceneVertShader), modules[0], error) ||
+      !SpirvReflect::reflect(mShaderManager.getSpirv(mSceneFragShader), modules[1], error)) {
+    throw std::runtime_error("failed to reflect scene shaders: " + error);
+  }
 
-  VkDescriptorPoolCreateInfo poolInfo{};
-  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-  poolInfo.pPoolSizes = poolSizes.data();
-  poolInfo.maxSets = static_cast<uint32_t>(mModels.size());
+  std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings;
+  std::vector<VkDescriptorBindingFlags> binding_flags;
+  bool updateAfterBind = false;
+  for (const SpirvReflect::DescriptorBinding &binding : SpirvReflect::mergeBindings(modules)) {
+    if (binding.set != 0) {
+      throw std::runtime_error("scene shaders may only use descriptor set 0, " + binding.name + " is in set " +
+                               std::to_string(binding.set));
+    }
+    if (binding.count == 0) {
+      // A runtime sized array is the bindless texture table, it can be
+      // written while command buffers using it are recorded
+      set_layout_bindings.push_back(VulkanInit::descriptor_set_layout_binding(binding.type, binding.stages, binding.binding, mMaxBindlessTextures));
+      binding_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                              VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT);
+      updateAfterBind = true;
+    } else {
+      set_layout_bindings.push_back(VulkanInit::descriptor_set_layout_binding(binding.type, binding.stages, binding.binding, binding.count));
+      binding_flags.push_back(0);
+    }
+  }
 
-  if (vkCreateDescriptorPool(mLogicalDevice, &poolInfo, nullptr, &mDescriptorPool) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to create descriptor pool!");
+  VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info{};
+  binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  binding_flags_create_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+  binding_flags_create_info.pBindingFlags = binding_flags.data();
+
+  VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
+      VulkanInit::descriptor_set_layout_create_info(set_layout_bindings.data(), static_cast<uint32_t>(set_layout_bindings.size()));
+  if (updateAfterBind) {
+    descriptor_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    descriptor_layout_create_info.pNext = &binding_flags_create_info;
+  } else if (mUseDescriptorBuffer) {
+    descriptor_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
   }
+  mDescriptorSetLayout = mDescriptorLayoutCache.getLayout(descriptor_layout_create_info);
 
+  mScenePushConstants = SpirvReflect::mergePushConstants(modules);
+  if (!mBindless) {
+    // drawFromDescriptors() always pushes the whole struct
+    mScenePushConstants.stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+    mScenePushConstants.size = std::max<uint32_t>(mScenePushConstants.size, sizeof(Utils::ModelPushConstants));
+  }
+  std::vector<VkPushConstantRange> push_constant_ranges;
+  if (mScenePushConstants.size > 0) {
+    push_constant_ranges.push_back(mScenePushConstants);
+  }
+  mPipelineLayout = mPipelineLayoutCache.getLayout({mDescriptorSetLayout}, push_constant_ranges);
+
+  // The inputs are packed in location order, which has to be how
+  // Utils::Vertex is laid out since that is what the vertex buffers hold
+  mSceneVertexBinding = Utils::Vertex::getBindingDescription();
+  uint32_t stride = SpirvReflect::vertexAttributes(modules[0], mSceneVertexBinding.binding, mSceneVertexAttributes);
+  if (stride != mSceneVertexBinding.stride) {
+    std::cout << mSceneVertShader << " inputs don't match Utils::Vertex (" << stride << " bytes), using its attributes\n";
+    mSceneVertexAttributes = Utils::Vertex::getAttributeDescriptions();
+  }
 }
 
-void VulkanRenderer::setupDescriptorSetLayout()
+void VulkanRenderer::createDescriptorSets()
 {
-	std::vector<VkDescriptorSetLayoutBinding> set_layout_bindings = {
-	    VulkanInit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-	    VulkanInit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1),
-      VulkanInit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
-	};
+  //Create a descriptor set per material and swapchain image, so a set is
+  //only rewritten once the frames using it are done
+  size_t first = mDescriptorSets.size() / mSwapChainImageCount;
+  std::cout << "Creating: " << (mMaterials.size() - first) * mSwapChainImageCount << " DescriptorSets\n";
 
-	VkDescriptorSetLayoutCreateInfo descriptor_layout_create_info =
-	    VulkanInit::descriptor_set_layout_create_info(set_layout_bindings.data(), static_cast<uint32_t>(set_layout_bindings.size()));
+  for (size_t i = first; i < mMaterials.size(); i++) {
+    VkDescriptorBufferInfo matrix_buffer_descriptor = VulkanInit::create_descriptor_buffer(mUBOScene, sizeof(Utils::UniformBufferObject), 0);
+    const Utils::Texture &texture = mTextureManager.getTexture(mMaterials[i].mTextureIndex);
+    VkDescriptorImageInfo environment_image_descriptor = VulkanInit::create_descriptor_texture(texture);
 
-	VK_CHECK(vkCreateDescriptorSetLayout(mLogicalDevice, &descriptor_layout_create_info, nullptr, &mDescriptorSetLayout), "vkCreateDescriptorSetLayout");
+    std::cout << "Texture: " << texture.texPath << " descriptorsetindex: " << i * mSwapChainImageCount << "\n";
 
-	VkPipelineLayoutCreateInfo pipeline_layout_create_info =
-	    VulkanInit::pipeline_layout_create_info(
-	        &mDescriptorSetLayout,
-	        1);
+    for (uint32_t image = 0; image < mSwapChainImageCount; image++) {
+      VkDescriptorSet set = mDescriptorAllocator.allocate(mDescriptorSetLayout);
+      mDescriptorSets.push_back(set);
+      std::vector<VkWriteDescriptorSet> write_descriptor_sets        = {
+            VulkanInit::write_descriptor_set_from_buffer(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &matrix_buffer_descriptor),
+            VulkanInit::write_descriptor_set_from_image(set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &environment_image_descriptor)
+        };
 
-	VK_CHECK(vkCreatePipelineLayout(mLogicalDevice, &pipeline_layout_create_info, nullptr, &mPipelineLayout), "vkCreatePipelineLayout");
+      vkUpdateDescriptorSets(mLogicalDevice, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+    }
+  }
 }
 
-// Note, not used when loading models
-void VulkanRenderer::createDescriptorSets()
+void VulkanRenderer::initDescriptorBuffer()
 {
-  //Create a descriptor set per image
-  std::cout << "Creating: " << mTextures.size() << " DescriptorSets\n";
-  mDescriptorSets.resize(mTextures.size());
+  // Headroom for materials added later
+  mDescriptorBuffer.init(mPhysicalDevice, mLogicalDevice, mDescriptorSetLayout,
+                         static_cast<uint32_t>(std::max<size_t>(mMaterials.size() * 2, 64) * mSwapChainImageCount));
+}
 
-  //The layouts array must equal to the number of descriptor sets you want to allocate
-  std::vector<VkDescriptorSetLayout> layoutsArray;
-  for (size_t i = 0; i < mTextures.size(); i++) {
-    layoutsArray.push_back(mDescriptorSetLayout);
+void VulkanRenderer::createDescriptorBufferSets()
+{
+  // Same contents as createDescriptorSets(), written straight into the buffer
+  size_t first = mDescriptorBufferSets.size() / mSwapChainImageCount;
+  if (mMaterials.size() * mSwapChainImageCount > mDescriptorBuffer.capacity()) {
+    throw std::runtime_error("More materials than the descriptor buffer has sets for");
   }
 
-	VkDescriptorSetAllocateInfo alloc_info =
-	    VulkanInit::descriptor_set_allocate_info(
-	        mDescriptorPool,
-	        layoutsArray.data(),
-            static_cast<uint32_t>(mTextures.size()));
-
-	VK_CHECK(vkAllocateDescriptorSets(mLogicalDevice, &alloc_info, mDescriptorSets.data()), "vkAllocateDescriptorSets");
-
-  for (size_t i = 0; i < mTextures.size(); i++) {
-    VkDescriptorBufferInfo matrix_buffer_descriptor = VulkanInit::create_descriptor_buffer(mUBOScene, sizeof(Utils::UniformBufferObject), 0);
-    VkDescriptorBufferInfo matrix_buffer_descriptor_model = VulkanInit::create_descriptor_buffer(mModels[0].mUniformBuffer, sizeof(Utils::UniformBufferObjectModel), 0);
-    VkDescriptorImageInfo environment_image_descriptor = VulkanInit::create_descriptor_texture(mTextures[i]);
-    std::vector<VkWriteDescriptorSet> write_descriptor_sets        = {
-          VulkanInit::write_descriptor_set_from_buffer(mDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &matrix_buffer_descriptor),
-          VulkanInit::write_descriptor_set_from_buffer(mDescriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &matrix_buffer_descriptor_model),
-          VulkanInit::write_descriptor_set_from_image(mDescriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &environment_image_descriptor)
-      };
-
-    mTextures[i].descriptor_set_index = static_cast<uint32_t>(i);
+  for (size_t i = first; i < mMaterials.size(); i++) {
+    const Utils::Texture &texture = mTextureManager.getTexture(mMaterials[i].mTextureIndex);
+    for (uint32_t image = 0; image < mSwapChainImageCount; image++) {
+      VkDeviceSize set = mDescriptorBuffer.allocateSet();
+      mDescriptorBufferSets.push_back(set);
 
-    std::cout << "Texture: " << mTextures[i].texPath << " descriptorsetindex: " << mTextures[i].descriptor_set_index << "\n";
+      mDescriptorBuffer.writeUniformBuffer(set, 0, mUBOScene, sizeof(Utils::UniformBufferObject));
+      mDescriptorBuffer.writeCombinedImageSampler(set, 2, VulkanInit::create_descriptor_texture(texture));
+    }
+  }
+}
 
-    vkUpdateDescriptorSets(mLogicalDevice, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+void VulkanRenderer::createBindlessDescriptorSets()
+{
+  // Sized for a set per swapchain image, independent of how many entities or materials there are
+  mDescriptorAllocator.init(mLogicalDevice, mSwapChainImageCount,
+                            {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+                             {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+                             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(mMaxBindlessTextures)}},
+                            VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+
+  VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count_info{};
+  variable_count_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+  variable_count_info.descriptorSetCount = 1;
+  variable_count_info.pDescriptorCounts = &mMaxBindlessTextures;
+
+  VkDescriptorBufferInfo scene_descriptor = VulkanInit::create_descriptor_buffer(mUBOScene, sizeof(Utils::UniformBufferObject), 0);
+  mObjectBuffers.resize(mSwapChainImageCount);
+  for (uint32_t image = 0; image < mSwapChainImageCount; image++) {
+    mBindlessSets.push_back(mDescriptorAllocator.allocate(mDescriptorSetLayout, &variable_count_info));
+    VkWriteDescriptorSet write_descriptor_set = VulkanInit::write_descriptor_set_from_buffer(mBindlessSets[image], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &scene_descriptor);
+    vkUpdateDescriptorSets(mLogicalDevice, 1, &write_descriptor_set, 0, nullptr);
+
+    // Written every frame by updateUniformBuffer, one entry per entity
+    reserveObjectBuffer(image, mEntities.size());
+    updateBindlessTextures(image);
   }
 }
 
-void VulkanRenderer::createDescriptorSetsModel()
+void VulkanRenderer::reserveObjectBuffer(uint32_t imageIndex, size_t count)
 {
+  ObjectBuffer &objects = mObjectBuffers[imageIndex];
+  if (objects.mBuffer != VK_NULL_HANDLE && objects.mCapacity >= count) {
+    return;
+  }
+  // Doubling keeps entities added one at a time from reallocating every frame
+  size_t capacity = std::max<size_t>({count, objects.mCapacity * 2, 1});
+  destroyObjectBuffer(objects);
 
-  std::vector<VkDescriptorSet> descriptorSets;
+  VkDeviceSize objectBufferSize = sizeof(Utils::ObjectData) * capacity;
+  VulkanHelper::createBuffer(mPhysicalDevice, mLogicalDevice, objectBufferSize,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &objects.mBuffer, &objects.mMemory);
+  void *data;
+  VK_CHECK(vkMapMemory(mLogicalDevice, objects.mMemory, 0, objectBufferSize, 0, &data), "vkMapMemory");
+  objects.mData = static_cast<Utils::ObjectData *>(data);
+  objects.mCapacity = capacity;
 
-  descriptorSets.resize(mModels.size());
+  VkDescriptorBufferInfo object_descriptor = VulkanInit::create_descriptor_buffer(objects.mBuffer, objectBufferSize, 0);
+  VkWriteDescriptorSet write_descriptor_set = VulkanInit::write_descriptor_set_from_buffer(mBindlessSets[imageIndex], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &object_descriptor);
+  vkUpdateDescriptorSets(mLogicalDevice, 1, &write_descriptor_set, 0, nullptr);
+}
 
-  std::vector<VkDescriptorSetLayout> layoutsArray;
+void VulkanRenderer::destroyObjectBuffer(ObjectBuffer &objects)
+{
+  if (objects.mBuffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vkUnmapMemory(mLogicalDevice, objects.mMemory);
+  vkDestroyBuffer(mLogicalDevice, objects.mBuffer, nullptr);
+  vkFreeMemory(mLogicalDevice, objects.mMemory, nullptr);
+  objects = ObjectBuffer{};
+}
 
-  for (size_t i = 0; i < mModels.size(); i++) {
-    layoutsArray.push_back(mDescriptorSetLayout);
+void VulkanRenderer::updateBindlessTextures(uint32_t imageIndex)
+{
+  size_t textureCount = std::min<size_t>(mTextureManager.handleCount(), mMaxBindlessTextures);
+  if (textureCount < mTextureManager.handleCount()) {
+    std::cout << "More textures than bindless slots, only the first " << mMaxBindlessTextures << " are visible\n";
   }
-  VkDescriptorSetAllocateInfo alloc_info = VulkanInit::descriptor_set_allocate_info(
-	      mDescriptorPool,
-	      layoutsArray.data(),
-        static_cast<uint32_t>(mModels.size()));
 
-	VK_CHECK(vkAllocateDescriptorSets(mLogicalDevice, &alloc_info, descriptorSets.data()), "vkAllocateDescriptorSets");
-   
-  for (size_t i = 0; i < mModels.size(); i++) {
-     VkDescriptorBufferInfo matrix_buffer_descriptor = VulkanInit::create_descriptor_buffer(mUBOScene, sizeof(Utils::UniformBufferObject), 0);
-     VkDescriptorBufferInfo matrix_buffer_descriptor_model = VulkanInit::create_descriptor_buffer(mModels[i].mUniformBuffer, sizeof(Utils::UniformBufferObjectModel), 0);
-     VkDescriptorImageInfo environment_image_descriptor = VulkanInit::create_descriptor_texture(mTextures[0]);
+  std::vector<VkDescriptorImageInfo> image_descriptors;
+  std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+  image_descriptors.reserve(textureCount);
+  for (TextureHandle handle = 0; handle < textureCount; handle++) {
+    // Evicted textures get the manager's fallback
+    const Utils::Texture &texture = mTextureManager.getTexture(handle);
+    image_descriptors.push_back(VulkanInit::create_descriptor_texture(texture));
+    VkWriteDescriptorSet write_descriptor_set = VulkanInit::write_descriptor_set_from_image(mBindlessSets[imageIndex], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &image_descriptors.back());
+    write_descriptor_set.dstArrayElement = handle;
+    write_descriptor_sets.push_back(write_descriptor_set);
+  }
+  vkUpdateDescriptorSets(mLogicalDevice, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+}
 
-     std::vector<VkWriteDescriptorSet> write_descriptor_sets        = {
-          VulkanInit::write_descriptor_set_from_buffer(descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &matrix_buffer_descriptor),
-          VulkanInit::write_descriptor_set_from_buffer(descriptorSets[i], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &matrix_buffer_descriptor_model),
-          VulkanInit::write_descriptor_set_from_image(descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &environment_image_descriptor)
-      };
+void VulkanRenderer::updateTextureDescriptors(uint32_t imageIndex)
+{
+  if (mUseDescriptorBuffer) {
+    for (size_t i = 0; i < mMaterials.size(); i++) {
+      const Utils::Texture &texture = mTextureManager.getTexture(mMaterials[i].mTextureIndex);
+      mDescriptorBuffer.writeCombinedImageSampler(mDescriptorBufferSets[i * mSwapChainImageCount + imageIndex], 2, VulkanInit::create_descriptor_texture(texture));
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < mMaterials.size(); i++) {
+    VkDescriptorImageInfo image_descriptor = VulkanInit::create_descriptor_texture(mTextureManager.getTexture(mMaterials[i].mTextureIndex));
+    VkWriteDescriptorSet write_descriptor_set = VulkanInit::write_descriptor_set_from_image(mDescriptorSets[i * mSwapChainImageCount + imageIndex], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &image_descriptor);
+    vkUpdateDescriptorSets(mLogicalDevice, 1, &write_descriptor_set, 0, nullptr);
+  }
+}
 
-    mTextures[0].descriptor_set_index = 0;
+void VulkanRenderer::updateTextureStreaming() {
+  TRACE_ZONE("VulkanRenderer::updateTextureStreaming");
+  // Rough size on screen of every texture: the bounding sphere of the biggest
+  // visible entity using it, projected with the current field of view
+  std::vector<float> footprints(mTextureManager.handleCount(), 0.0f);
+  float pixelsPerUnit = (mSwapChainExtent.height * 0.5f) / std::tan(glm::radians(mFieldOfView) * 0.5f);
+  for (size_t i = 0; i < mEntities.size(); i++) {
+    if (!mEntities.mVisible[i]) {
+      continue;
+    }
+    const Utils::AABB &bounds = mEntities.mBounds[i];
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+    float distance = std::max(glm::length(center - mCameraPos), 0.1f);
+    float footprint = 2.0f * radius / distance * pixelsPerUnit;
+
+    TextureHandle texture = mMaterials[mEntities.mMaterials[i]].mTextureIndex;
+    footprints[texture] = std::max(footprints[texture], footprint);
+  }
 
-    vkUpdateDescriptorSets(mLogicalDevice, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr); 
+  mTextureManager.updateStreaming(footprints);
 
-    mModels[i].mDescriptorSet = descriptorSets[i];
+  // The old images stay alive until the frames in flight are done with
+  // them, each image's descriptors move to the new views when it is recorded
+  if (mTextureManager.takeViewsChanged()) {
+    std::fill(mTextureDescriptorsDirty.begin(), mTextureDescriptorsDirty.end(), true);
   }
 }
 
 void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
+  TRACE_ZONE("VulkanRenderer::updateUniformBuffer");
   
   Utils::UniformBufferObject ubo{};
 
@@ -1058,11 +1367,13 @@ void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
 
 
   ubo.proj = glm::perspective(
-    glm::radians(45.0f), // The vertical Field of View, in radians: the amount of "zoom". Think "camera lens". Usually between 90° (extra wide) and 30° (quite zoomed in)
+    glm::radians(mFieldOfView), // The vertical Field of View, in radians: the amount of "zoom". Think "camera lens". Usually between 90° (extra wide) and 30° (quite zoomed in)
     mSwapChainExtent.width / (float)mSwapChainExtent.height, // Aspect Ratio. Depends on the size of your window. Notice that 4/3 == 800/600 == 1280/960
     0.1f, // Near clipping plane. Keep as big as possible, or you'll get precision issues.
     20.0f); // Far clipping plane. Keep as little as possible.
 
+  mProjMatrix = ubo.proj;
+
   // Or, for an ortho camera :
   /*
   ubo.proj = glm::ortho(-2.0f, // left
@@ -1073,30 +1384,33 @@ void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
                          5.0f); // far
   */
 
-  // First model is the light
-  ubo.light = mModels[0].mPosition;
+  // First entity is the light
+  ubo.light = mEntities.mPositions[0];
 
   ubo.camPos = mCameraPos;
 
   void *data; vkMapMemory(mLogicalDevice, mUBOSceneMemory, 0, sizeof(ubo), 0, &data); 
   memcpy(data, &ubo, sizeof(ubo)); 
   vkUnmapMemory(mLogicalDevice, mUBOSceneMemory);
-  for (size_t i = 0; i < mModels.size(); i++) {
-    Utils::UniformBufferObjectModel uboModel{};
-    uboModel.modelPos = glm::translate(glm::mat4(1.0f), mModels[i].mPosition);
-
-    void *dataModel; 
-    vkMapMemory(mLogicalDevice, mModels[i].mUniformBuffersMemory, 0, sizeof(uboModel), 0, &dataModel); 
-    memcpy(dataModel, &uboModel, sizeof(uboModel)); 
-    vkUnmapMemory(mLogicalDevice, mModels[i].mUniformBuffersMemory);  
+  if (mBindless) {
+    // This image's buffer, indexed by entity in the shader. Entities may
+    // have been added since it was last written
+    reserveObjectBuffer(currentImage, mEntities.size());
+    Utils::ObjectData *objectData = mObjectBuffers[currentImage].mData;
+    for (size_t i = 0; i < mEntities.size(); i++) {
+      objectData[i].modelPos = glm::translate(glm::mat4(1.0f), mEntities.mPositions[i]);
+      objectData[i].textureIndex = mMaterials[mEntities.mMaterials[i]].mTextureIndex;
+    }
   }
 
+  mEntities.updateBounds(mMeshes);
+
 
 }
 
 void VulkanRenderer::cleanupSwapChain() {
-  vkDestroyPipeline(mLogicalDevice, mGraphicsPipeline, nullptr);
-
+  // Pipelines are kept, only what depends on the resolution goes
+  destroyRenderTargets();
   for (size_t i = 0; i < mSwapChainImageViews.size(); i++) {
     vkDestroyImageView(mLogicalDevice, mSwapChainImageViews[i], nullptr);
   }
@@ -1105,6 +1419,38 @@ void VulkanRenderer::cleanupSwapChain() {
 
 }
 
+void VulkanRenderer::recreatePerImageState() {
+  vkFreeCommandBuffers(mLogicalDevice, mCommandPool, static_cast<uint32_t>(mDrawingCommandBuffers.size()),
+                       mDrawingCommandBuffers.data());
+  destroySyncObjects();
+  createCommandBuffers(mSwapChainImageCount);
+  // Starts the images over at frame 0, every frame so far is done
+  createSyncObjects(mSwapChainImageCount);
+  mCompletedFrame = mFrameNumber;
+  mCurrentSwapChainImage = 0;
+
+  // The sets are indexed material * mSwapChainImageCount + image, so they
+  // are all made again rather than added to
+  if (mBindless) {
+    for (ObjectBuffer &objects : mObjectBuffers) {
+      destroyObjectBuffer(objects);
+    }
+    mObjectBuffers.clear();
+    mBindlessSets.clear();
+    mDescriptorAllocator.destroy();
+    createBindlessDescriptorSets();
+  } else if (mUseDescriptorBuffer) {
+    mDescriptorBufferSets.clear();
+    mDescriptorBuffer.destroy();
+    initDescriptorBuffer();
+    createDescriptorBufferSets();
+  } else {
+    mDescriptorSets.clear();
+    mDescriptorAllocator.reset();
+    createDescriptorSets();
+  }
+}
+
 void VulkanRenderer::recreateSwapChain() {
   Uint32 flags = SDL_GetWindowFlags(mWindow);
   Utils::showWindowFlags(flags);
@@ -1116,19 +1462,32 @@ void VulkanRenderer::recreateSwapChain() {
     SDL_WaitEvent(&event);
   }
   vkDeviceWaitIdle(mLogicalDevice);
+  auto recreateStart = std::chrono::high_resolution_clock::now();
   cleanupSwapChain();
 
+  uint32_t oldImageCount = mSwapChainImageCount;
   createSwapChain(mSurface);
   createSwapChainImageViews();
   createDepthImage();
+  createColorResources();
 
-  delete mTextOverlay;
-  mTextOverlay = new TextOverlay(mPhysicalDevice, mLogicalDevice, mQueueFamilyIndices.graphicsFamily, mSwapChainImageViews, mSwapChainImageFormat, mSwapChainExtent, mGraphicsQueue);
+  if (mSwapChainImageCount != oldImageCount) {
+    recreatePerImageState();
+  }
 
-  createGraphicsPipeline();
+  mTextOverlay->resize(mSwapChainImageCount, mColorFormat, mSwapChainExtent);
+  mDebugDraw.resize(mSwapChainImageCount);
+  mGpuTimer.resize(mSwapChainImageCount);
 
-  buildDrawingCommandBuffers();
+  // The color target keeps its format, so this finds the pipeline already
+  // built. Shader objects don't depend on it at all
+  if (!mUseShaderObjects) {
+    createGraphicsPipeline();
+  }
 
+  auto recreateEnd = std::chrono::high_resolution_clock::now();
+  std::cout << "Swapchain recreated (" << mSwapChainExtent.width << "x" << mSwapChainExtent.height << ") in "
+            << std::chrono::duration<double, std::milli>(recreateEnd - recreateStart).count() << " ms\n";
 }
 
 void VulkanRenderer::drawFromVertices(VkCommandBuffer commandBuffer,
@@ -1144,7 +1503,7 @@ void VulkanRenderer::drawFromVertices(VkCommandBuffer commandBuffer,
 
   vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                           mPipelineLayout, 0, 1,
-                          &mDescriptorSets[mTextures[0].descriptor_set_index], 0,
+                          &mDescriptorSets[0], 0,
                           nullptr);
 
 
@@ -1173,29 +1532,44 @@ void VulkanRenderer::drawFromIndices(VkCommandBuffer commandBuffer,
 
 
 void VulkanRenderer::drawFromDescriptors(VkCommandBuffer commandBuffer,
-                                         VkPipeline graphicsPipeline,
-                                         std::vector<Utils::Vertex> vertices,
-                                         std::vector<uint32_t> indices,
+                                         uint32_t indexCount,
                                          VkBuffer vertexBuffer,
                                          VkBuffer indexBuffer,
-                                         VkDescriptorSet descriptorSet) {
-
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    graphicsPipeline);
+                                         const Utils::ModelPushConstants &pushConstants) {
 
   VkBuffer vertexBuffers[] = {vertexBuffer};
   VkDeviceSize offsets[] = {0};
   vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
   vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-  
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+  vkCmdPushConstants(commandBuffer, mPipelineLayout, mScenePushConstants.stageFlags, 0, sizeof(pushConstants), &pushConstants);
    
-  vkCmdDrawIndexed(commandBuffer, (uint32_t)indices.size(), 1, 0, 0, 0);
+  vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+
+}
+
+void VulkanRenderer::drawBindless(VkCommandBuffer commandBuffer,
+                                  uint32_t indexCount,
+                                  VkBuffer vertexBuffer,
+                                  VkBuffer indexBuffer,
+                                  uint32_t objectIndex) {
+  VkBuffer vertexBuffers[] = {vertexBuffer};
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
+  // gl_InstanceIndex starts at firstInstance, the shader reads its object data with it
+  vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, objectIndex);
 }
 
 void VulkanRenderer::drawFrame() {
+  TRACE_ZONE("VulkanRenderer::drawFrame");
+  auto updateStart = std::chrono::high_resolution_clock::now();
+  reloadChangedShaders();
+
+  auto waitStart = std::chrono::high_resolution_clock::now();
   vkWaitForFences(mLogicalDevice, 1, &mInFlightFences[mCurrentSwapChainImage], VK_TRUE,
                   UINT64_MAX);
 
@@ -1212,22 +1586,52 @@ void VulkanRenderer::drawFrame() {
     throw std::runtime_error("failed to acquire swap chain image!");
   }
 
+  // The command buffer of this image gets re-recorded, the last submission using it has to be done
+  {
+    TRACE_ZONE("wait for image fence");
+    vkWaitForFences(mLogicalDevice, 1, &mInFlightFences[mCurrentSwapChainImage], VK_TRUE,
+                    UINT64_MAX);
+  }
   vkResetFences(mLogicalDevice, 1, &mInFlightFences[mCurrentSwapChainImage]);
+  auto waitEnd = std::chrono::high_resolution_clock::now();
+
+  mCompletedFrame = std::max(mCompletedFrame, mImageFrameNumbers[mCurrentSwapChainImage]);
+  mImageFrameNumbers[mCurrentSwapChainImage] = ++mFrameNumber;
+  mTextureManager.beginFrame(mFrameNumber, mCompletedFrame);
+  updateTextureStreaming();
+  // Nothing in flight uses this image's sets any more
+  if (mTextureDescriptorsDirty[mCurrentSwapChainImage]) {
+    if (mBindless) {
+      updateBindlessTextures(mCurrentSwapChainImage);
+    } else {
+      updateTextureDescriptors(mCurrentSwapChainImage);
+    }
+    mTextureDescriptorsDirty[mCurrentSwapChainImage] = false;
+  }
 
   // std::cout << "Current frame: " << mCurrentSwapChainImage << "\n";
 
-  updateUniformBuffer(0);
+  updateUniformBuffer(mCurrentSwapChainImage);
 
+  auto recordStart = std::chrono::high_resolution_clock::now();
+  recordDrawingCommandBuffer(mCurrentSwapChainImage);
+  auto recordEnd = std::chrono::high_resolution_clock::now();
+  mFrameStats.waitMs = (float)std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+  mFrameStats.updateMs = (float)std::chrono::duration<double, std::milli>((waitStart - updateStart) + (recordStart - waitEnd)).count();
+  mFrameStats.recordMs = (float)std::chrono::duration<double, std::milli>(recordEnd - recordStart).count();
+
+  // The text overlay is recorded into it as well
   std::vector<VkCommandBuffer> commandBuffers = {
 			mDrawingCommandBuffers[mCurrentSwapChainImage]
 		};
 
-  commandBuffers.push_back(mTextOverlay->mCommandBuffers[mCurrentSwapChainImage]);
-
-  VulkanHelper::submitCommandBuffers(
-       commandBuffers, mGraphicsQueue,
-       mImageAvailableSemaphores[mCurrentSwapChainImage],
-       mRenderFinishedSemaphores[mCurrentSwapChainImage], mInFlightFences[mCurrentSwapChainImage]);
+  {
+    TRACE_ZONE("vkQueueSubmit");
+    VulkanHelper::submitCommandBuffers(
+         commandBuffers, mGraphicsQueue,
+         mImageAvailableSemaphores[mCurrentSwapChainImage],
+         mRenderFinishedSemaphores[mCurrentSwapChainImage], mInFlightFences[mCurrentSwapChainImage]);
+  }
 
   // Now present the image
   VkSemaphore signalSemaphores[] = {mRenderFinishedSemaphores[mCurrentSwapChainImage]};
@@ -1252,7 +1656,12 @@ void VulkanRenderer::drawFrame() {
 
   // presentInfo.pResults = nullptr; // Optional
   presentInfo.pResults = resultsArray.data(); // Optional
-  result = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+  {
+    TRACE_ZONE("vkQueuePresentKHR");
+    result = vkQueuePresentKHR(mPresentQueue, &presentInfo);
+  }
+  auto presentEnd = std::chrono::high_resolution_clock::now();
+  mFrameStats.submitMs = (float)std::chrono::duration<double, std::milli>(presentEnd - recordEnd).count();
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
     std::cout << "drawFrame Need to recreate swapchain\n";
     recreateSwapChain();
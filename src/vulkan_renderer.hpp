@@ -7,6 +7,18 @@
 #include <vulkan_initializers.hpp>
 
 #include <text_overlay.hpp>
+#include <debug_draw.hpp>
+#include <gpu_timer.hpp>
+#include <trace.hpp>
+#include <entity_store.hpp>
+#include <texture_manager.hpp>
+#include <descriptor_allocator.hpp>
+#include <descriptor_buffer.hpp>
+#include <pipeline_cache.hpp>
+#include <shader_object.hpp>
+#include <pipeline_manager.hpp>
+#include <shader_manager.hpp>
+#include <spirv_reflect.hpp>
 
 #include <filesystem>
 #include <string>
@@ -51,6 +63,15 @@ public:
   VkQueue mPresentQueue;
 
   VkSampleCountFlagBits mMsaaSamples;
+  // Requested anisotropy for texture samplers, clamped to the device limit
+  float mMaxAnisotropy = 16.0f;
+  // Vertical field of view in degrees
+  float mFieldOfView = 45.0f;
+  // Read by the perf HUD
+  Utils::FrameStats mFrameStats;
+  GpuTimer mGpuTimer;
+  // VK_EXT_memory_budget, enabled when available
+  bool mMemoryBudget = false;
   //===================================================
   // Command Submission
   uint32_t mCurrentSwapChainImage = 0;
@@ -61,6 +82,15 @@ public:
   std::vector<VkSemaphore> mImageAvailableSemaphores;
   std::vector<VkSemaphore> mRenderFinishedSemaphores;
   std::vector<VkFence> mInFlightFences;
+  // Frames are numbered from 1 as they are submitted, mImageFrameNumbers
+  // holds the last frame submitted with each swapchain image. A signaled
+  // image fence means that frame and every one before it has completed
+  uint64_t mFrameNumber = 0;
+  uint64_t mCompletedFrame = 0;
+  std::vector<uint64_t> mImageFrameNumbers;
+  // Per swapchain image, its texture descriptors still point at views the
+  // streamer replaced. Rewritten when the image is recorded next
+  std::vector<bool> mTextureDescriptorsDirty;
 
   //===================================================
   // Swapchain
@@ -77,13 +107,41 @@ public:
   VkImageView mDepthImageView;
 
   //color image for msaa
+  // Multisampled color target the scene, overlay and debug draw pipelines
+  // are built for, resolved into the swapchain image
+  VkFormat mColorFormat = VK_FORMAT_R8G8B8A8_SRGB;
   VkImage mColorImage;
   VkDeviceMemory mColorImageMemory;
   VkImageView mColorImageView;
   //===================================================
   // Pipeline
+  // Owned by mPipelineLayoutCache
   VkPipelineLayout mPipelineLayout;
+  PipelineLayoutCache mPipelineLayoutCache;
   VkPipeline mGraphicsPipeline;
+  PipelineCache mPipelineCache;
+  // Owns every scene pipeline, one per render state permutation. Viewport
+  // and scissor are dynamic so they survive swapchain resizes.
+  // mGraphicsPipeline is the default material's for the current swapchain
+  PipelineManager mPipelineManager;
+  // Compiles the GLSL sources and reloads them when they change
+  ShaderManager mShaderManager;
+  std::string mSceneVertShader;
+  std::string mSceneFragShader;
+  uint32_t mSceneShaders = 0;
+  uint32_t mSceneVertexLayout = 0;
+  // Reflected from the scene shaders in setupDescriptorSetLayout()
+  VkPushConstantRange mScenePushConstants{};
+  VkVertexInputBindingDescription mSceneVertexBinding{};
+  std::vector<VkVertexInputAttributeDescription> mSceneVertexAttributes;
+  VkFormat mDepthFormat = VK_FORMAT_UNDEFINED;
+  // Shader object mode (VK_EXT_shader_object): the scene is drawn with linked
+  // VkShaderEXT objects and fully dynamic state instead of mGraphicsPipeline
+  bool mPreferShaderObjects = true;
+  bool mUseShaderObjects = false;
+  ShaderObjectProgram mShaderObjects;
+  // Relative to the working directory
+  std::string mPipelineCachePath = "pipeline_cache.bin";
   //===================================================
   // Pipeline inputs
 
@@ -93,25 +151,65 @@ public:
   //VkBuffer mUBOModel;
   //VkDeviceMemory mUBOModelMemory;
 
-  std::vector<Utils::Texture> mTextures;
+  TextureManager mTextureManager;
 
-  VkDescriptorPool mDescriptorPool;
+  DescriptorLayoutCache mDescriptorLayoutCache;
+  DescriptorAllocator mDescriptorAllocator;
+  // Owned by mDescriptorLayoutCache
   VkDescriptorSetLayout mDescriptorSetLayout{VK_NULL_HANDLE};
+  // One per material and swapchain image, at material * mSwapChainImageCount + image
   std::vector<VkDescriptorSet> mDescriptorSets;
 
+  // Bindless mode: a single set with every texture in one array and the
+  // per entity data in a storage buffer indexed by gl_InstanceIndex.
+  // There is a copy of the set per swapchain image so texture updates never
+  // touch a set a frame in flight uses.
+  // Falls back to a set per entity without descriptor indexing support
+  bool mPreferBindless = true;
+  bool mBindless = false;
+  uint32_t mMaxBindlessTextures = 1024;
+  std::vector<VkDescriptorSet> mBindlessSets;
+  // The per entity data, one persistently mapped buffer per swapchain image
+  // so a frame never writes what an earlier one in flight still reads.
+  // Grows with the entity count, binding 1 of the image's set follows it
+  struct ObjectBuffer {
+    VkBuffer mBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory mMemory = VK_NULL_HANDLE;
+    Utils::ObjectData *mData = nullptr;
+    size_t mCapacity = 0;
+  };
+  std::vector<ObjectBuffer> mObjectBuffers;
+
+  // Descriptor buffer mode (VK_EXT_descriptor_buffer): the per material sets
+  // are written straight into a mapped buffer, no pools or vkUpdateDescriptorSets.
+  // Takes priority over bindless when the device supports it
+  bool mPreferDescriptorBuffer = true;
+  bool mUseDescriptorBuffer = false;
+  DescriptorBuffer mDescriptorBuffer;
+  // Offset of each material's set in mDescriptorBuffer, indexed like mDescriptorSets
+  std::vector<VkDeviceSize> mDescriptorBufferSets;
+
 
   TextOverlay *mTextOverlay;
+  // Compiled out of release builds, see debug_draw.hpp
+  DebugDraw mDebugDraw;
+  // Entity bounds and the light
+  bool mDrawDebugBounds = false;
 
   
   //===================================================
-  //Models abstraction
-  std::vector<Utils::Model> mModels;
+  //Scene
+  std::vector<Utils::Mesh> mMeshes;
+  std::vector<Utils::Material> mMaterials;
+  EntityStore mEntities;
 
   //===================================================
   glm::vec3 mCameraPos;
   glm::mat4 mCameraRotation;
 
   glm::mat4 mViewMatrix;
+  // Set in updateUniformBuffer()
+  glm::mat4 mProjMatrix;
   //===================================================
   // Functions
   VulkanRenderer(SDL_Window *sdlWindow);
@@ -127,40 +225,67 @@ public:
   void createCommandPool();
   void createCommandBuffers(uint32_t number);
   void createSyncObjects(uint32_t number);
+  void destroySyncObjects();
 
-  void buildDrawingCommandBuffers();
+  void recordDrawingCommandBuffer(uint32_t imageIndex);
 
   // Swapchain
   void createSwapChain(VkSurfaceKHR surface);
   void createSwapChainImageViews();
   void cleanupSwapChain();
   void recreateSwapChain();
+  // Everything indexed by swapchain image is made again for a new image
+  // count. Nothing may be in flight
+  void recreatePerImageState();
 
   void createDepthImage();
   void createColorResources();
+  // Depth and MSAA color images, recreated with the swapchain
+  void destroyRenderTargets();
 
-  //DescriptorSetLayout, pipelineLayout
+  //DescriptorSetLayout, pipelineLayout and vertex input, reflected from the scene shaders
   void setupDescriptorSetLayout();
   // Pipeline
+  void createPipelineManager();
+  RenderStateKey sceneStateKey(const Utils::Material &material) const;
   void createGraphicsPipeline();
+  void createShaderObjects();
+  // Swaps the scene shaders if their sources changed on disk
+  void reloadChangedShaders();
 
   // Pipeline inputs
   //void createVertexBuffer(std::vector<Utils::Vertex> vertices);
-  void createVertexBuffer(std::vector<Utils::Vertex> vertices, VkBuffer *vertexBuffer, VkDeviceMemory *vertexBufferMemory);
+  void createVertexBuffer(const std::vector<Utils::Vertex> &vertices, VkBuffer *vertexBuffer, VkDeviceMemory *vertexBufferMemory);
   //void createIndexBuffer(std::vector<uint32_t> indices);
-  void createIndexBuffer(std::vector<uint32_t> indices, VkBuffer *indexBuffer, VkDeviceMemory *indexBufferMemory); 
+  void createIndexBuffer(const std::vector<uint32_t> &indices, VkBuffer *indexBuffer, VkDeviceMemory *indexBufferMemory); 
   void createUniformBuffers();
 
-  void createUniformBufferForModel(VkBuffer *modelBuffer, VkDeviceMemory *modelMemory);
+  // Scene
+  uint32_t createMesh(const std::vector<Utils::Vertex> &vertices, const std::vector<uint32_t> &indices);
+  Entity createEntity(glm::vec3 position, uint32_t mesh, uint32_t material);
+
   void loadTextures();
   
-  void createDescriptorPool(int number);
+  // One set per material, the model matrix is a push constant.
+  // Can be called again after adding materials, only the new ones get a set
   void createDescriptorSets();
-  void createDescriptorSetsModel();
+  void createBindlessDescriptorSets();
+  void createDescriptorBufferSets();
+  void initDescriptorBuffer();
+  // Writes every loaded texture into the image's bindless array, at its handle
+  void updateBindlessTextures(uint32_t imageIndex);
+  // Makes room for count entities in the image's object buffer. Only called
+  // while the image isn't in flight, the old buffer is destroyed right away
+  void reserveObjectBuffer(uint32_t imageIndex, size_t count);
+  void destroyObjectBuffer(ObjectBuffer &objects);
+  // Points binding 2 of the image's material sets at their texture's current view
+  void updateTextureDescriptors(uint32_t imageIndex);
 
   // Rendering functionality
 
   void updateUniformBuffer(uint32_t currentImage);
+  // Feeds the screen size of each texture to the texture streamer
+  void updateTextureStreaming();
 
   void drawFromVertices(VkCommandBuffer commandBuffer,
                         VkPipeline graphicsPipeline,
@@ -173,13 +298,19 @@ public:
                        std::vector<uint16_t> indices, VkBuffer vertexBuffer,
                        VkBuffer indexBuffer);
 
+  // Expects the pipeline and the material's descriptor set to be bound already
   void drawFromDescriptors(VkCommandBuffer commandBuffer,
-                           VkPipeline graphicsPipeline,
-                           std::vector<Utils::Vertex> vertices,
-                           std::vector<uint32_t> indices,
+                           uint32_t indexCount,
                            VkBuffer vertexBuffer,
                            VkBuffer indexBuffer,
-                           VkDescriptorSet descriptorSet);
+                           const Utils::ModelPushConstants &pushConstants);
+
+  // Bindless draw, expects the pipeline and the image's bindless set to be bound already
+  void drawBindless(VkCommandBuffer commandBuffer,
+                    uint32_t indexCount,
+                    VkBuffer vertexBuffer,
+                    VkBuffer indexBuffer,
+                    uint32_t objectIndex);
 
   void drawFrame();
 };
@@ -0,0 +1,150 @@
+// Counts heap allocations on the per frame text paths, which are meant to
+// have none once warmed up: formatting into a TextBuffer, and PerfHud::update()
+// refreshing its lines through the text overlay.
+//
+// Run from the build folder, the overlay loads fonts/ and shaders/ from
+// there. The PerfHud part is skipped when there is no Vulkan device.
+
+#include "headless_vulkan.hpp"
+
+#include <perf_hud.hpp>
+#include <text_buffer.hpp>
+#include <text_overlay.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <vector>
+
+static std::atomic<uint64_t> gAllocations{0};
+
+void *operator new(std::size_t size) {
+  gAllocations++;
+  if (void *memory = std::malloc(size > 0 ? size : 1)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+
+static int gFailures = 0;
+
+#define CHECK(condition, message)                                                                  \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      std::cout << "FAILED: " << message << " (" << #condition << ", line " << __LINE__ << ")\n"; \
+      gFailures++;                                                                                 \
+    }                                                                                              \
+  } while (0)
+
+static void testTextBuffer() {
+  TextBuffer<128> buffer;
+  uint64_t before = gAllocations;
+  for (int i = 0; i < 1000; i++) {
+    buffer.clear().append("CPU frame ").append(16.667f + i).append(" ms (").append(1000.0f / (i + 1), 1)
+        .append(" fps) draws ").append(static_cast<int64_t>(i) * 123457).append(" hud ").append(0.001f * i, 3);
+  }
+  uint64_t allocations = gAllocations - before;
+  CHECK(allocations == 0, "TextBuffer::append allocated " << allocations << " times");
+
+  buffer.clear().append("a").append(1.5f).append(static_cast<int64_t>(-42));
+  CHECK(buffer.view() == "a1.50-42", "formatted \"" << buffer.view() << "\"");
+
+  // Cut off at the capacity, a number that doesn't fit is left out
+  TextBuffer<8> small;
+  small.append("0123456789");
+  CHECK(small.view() == "01234567", "cut off to \"" << small.view() << "\"");
+  small.clear().append("12345").append(1234.5f);
+  CHECK(small.view() == "12345", "number past the capacity gave \"" << small.view() << "\"");
+}
+
+// The overlay's part of the frame, outside what's counted: the driver may
+// allocate when recording and submitting
+static void prepare(HeadlessVulkan &vulkan, TextOverlay &overlay, uint32_t imageIndex) {
+  VkCommandBuffer commandBuffer = VulkanHelper::beginSingleTimeCommands(vulkan.device, vulkan.commandPool);
+  overlay.prepareFrame(imageIndex, commandBuffer);
+  VulkanHelper::endSingleTimeCommands(vulkan.device, vulkan.commandPool, commandBuffer, vulkan.queue);
+}
+
+static void testPerfHud(HeadlessVulkan &vulkan) {
+  const uint32_t imageCount = 3;
+  TextOverlay overlay(vulkan.physicalDevice, vulkan.device, vulkan.queueFamily, imageCount, VK_FORMAT_B8G8R8A8_UNORM,
+                      VK_SAMPLE_COUNT_1_BIT, {1280, 720}, vulkan.queue, VK_NULL_HANDLE,
+                      VulkanHelper::readFile("shaders/text.vert.spv"), VulkanHelper::readFile("shaders/text.frag.spv"));
+  VulkanEngine::PerfHud hud;
+  hud.init(&overlay, vulkan.physicalDevice, false);
+  hud.setVisible(true);
+
+  // The hud's own time is measured, so any digit can show up. Keeping them
+  // all referenced means the glyph cache never has to add one while counting
+  TextOverlay::TextHandle digits = overlay.createText(0.0f, 700.0f, TextOverlay::alignLeft);
+  overlay.setText(digits, "0123456789.-");
+
+  // Every frame is long enough to refresh the lines, the values cycle so the
+  // longest strings are laid out before counting starts
+  const float frameTimes[] = {250.0f, 312.5f, 1000.0f, 4000.0f};
+  std::vector<VulkanEngine::GpuTimer::Scope> scopes = {{"shadow", 0.5f}, {"scene", 2.25f}};
+  Utils::FrameStats stats;
+  auto frame = [&](uint32_t i) {
+    float frameMs = frameTimes[i % 4];
+    stats.waitMs = frameMs * 0.1f;
+    stats.updateMs = frameMs * 0.01f;
+    stats.recordMs = frameMs * 0.02f;
+    stats.submitMs = frameMs * 0.03f;
+    stats.draws = 100 * (i % 4 + 1);
+    stats.triangles = 100000 * (i % 4 + 1);
+    stats.descriptorBinds = 10 * (i % 4 + 1);
+    stats.pipelineBinds = i % 4 + 1;
+    scopes[1].milliseconds = frameMs * 0.005f;
+
+    overlay.beginTextUpdate();
+    hud.update(frameMs, stats, scopes);
+  };
+
+  for (uint32_t i = 0; i < 16; i++) {
+    frame(i);
+    prepare(vulkan, overlay, i % imageCount);
+  }
+
+  uint64_t allocations = 0;
+  for (uint32_t i = 0; i < 40; i++) {
+    uint64_t before = gAllocations;
+    frame(i);
+    allocations += gAllocations - before;
+    prepare(vulkan, overlay, i % imageCount);
+  }
+  CHECK(allocations == 0, "PerfHud::update allocated " << allocations << " times in 40 refreshes");
+
+  overlay.destroyText(digits);
+  hud.setVisible(false);
+}
+
+int main() {
+  testTextBuffer();
+
+  HeadlessVulkan vulkan;
+  if (vulkan.create()) {
+    try {
+      testPerfHud(vulkan);
+    } catch (const std::exception &e) {
+      std::cout << "FAILED: " << e.what() << "\n";
+      gFailures++;
+    }
+  } else {
+    std::cout << "PerfHud part skipped\n";
+  }
+  vulkan.destroy();
+
+  if (gFailures > 0) {
+    std::cout << gFailures << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "allocation_test passed\n";
+  return 0;
+}
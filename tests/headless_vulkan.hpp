@@ -0,0 +1,116 @@
+#pragma once
+
+// Vulkan device without a window or swapchain for the standalone tests. The
+// first device with a graphics queue and dynamic rendering is used, the same
+// features the renderer turns on for what the tests touch.
+
+#include <vulkan_initializers.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// What ctest takes as skipped, see SKIP_RETURN_CODE in CMakeLists.txt
+#define HEADLESS_VULKAN_SKIP 77
+
+struct HeadlessVulkan {
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t queueFamily = 0;
+  VkQueue queue = VK_NULL_HANDLE;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+
+  // false when there is no usable device, the test should skip then
+  bool create() {
+    VkApplicationInfo appInfo = VulkanInit::application_info();
+    VkInstanceCreateInfo instanceInfo{};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+    if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS) {
+      std::cout << "No Vulkan instance\n";
+      return false;
+    }
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+    for (VkPhysicalDevice candidate : devices) {
+      if (hasDynamicRendering(candidate) && findGraphicsQueue(candidate, queueFamily)) {
+        physicalDevice = candidate;
+        break;
+      }
+    }
+    if (physicalDevice == VK_NULL_HANDLE) {
+      std::cout << "No Vulkan device with a graphics queue and dynamic rendering\n";
+      return false;
+    }
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = VulkanInit::device_queue_create_info(queueFamily, 1, &priority);
+    const char *extensions[] = {VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME};
+    VkPhysicalDeviceFeatures features{};
+    VkDeviceCreateInfo deviceInfo = VulkanInit::device_create_info(1, &queueInfo, 0, nullptr, 1, extensions, &features);
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRendering{};
+    dynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+    dynamicRendering.dynamicRendering = VK_TRUE;
+    deviceInfo.pNext = &dynamicRendering;
+    if (vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
+      std::cout << "vkCreateDevice failed\n";
+      return false;
+    }
+    vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+    VkCommandPoolCreateInfo poolInfo = VulkanInit::command_pool_create_info();
+    poolInfo.queueFamilyIndex = queueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+      std::cout << "vkCreateCommandPool failed\n";
+      return false;
+    }
+    return true;
+  }
+
+  void destroy() {
+    if (device != VK_NULL_HANDLE) {
+      vkDeviceWaitIdle(device);
+      if (commandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, commandPool, nullptr);
+      }
+      vkDestroyDevice(device, nullptr);
+    }
+    if (instance != VK_NULL_HANDLE) {
+      vkDestroyInstance(instance, nullptr);
+    }
+    *this = HeadlessVulkan();
+  }
+
+  static bool hasDynamicRendering(VkPhysicalDevice candidate) {
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(candidate, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(candidate, nullptr, &extensionCount, extensions.data());
+    for (const VkExtensionProperties &extension : extensions) {
+      if (strcmp(extension.extensionName, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool findGraphicsQueue(VkPhysicalDevice candidate, uint32_t &family) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+    for (uint32_t i = 0; i < familyCount; i++) {
+      if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        family = i;
+        return true;
+      }
+    }
+    return false;
+  }
+};
@@ -0,0 +1,172 @@
+// Standalone checks of the CPU mip generator: box filter output on odd and
+// non power of two sizes, and the SSE2/NEON path against the scalar one.
+//
+// usage: mip_generator_test [--bench]
+//
+// --bench also times both paths on a 2048x2048 image.
+
+#include <mip_generator.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static int gFailures = 0;
+
+#define CHECK(condition, message)                                                                  \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      std::cout << "FAILED: " << message << " (" << #condition << ", line " << __LINE__ << ")\n"; \
+      gFailures++;                                                                                 \
+    }                                                                                              \
+  } while (0)
+
+static std::vector<uint8_t> randomImage(uint32_t width, uint32_t height, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+  for (uint8_t &value : pixels) {
+    value = static_cast<uint8_t>(random() & 0xff);
+  }
+  return pixels;
+}
+
+// Written out from the definition rather than shared with the generator:
+// rows averaged first, then the two columns, each rounding up, and the last
+// row or column repeated when the size is 1
+static std::vector<uint8_t> referenceDownsample(const std::vector<uint8_t> &src, uint32_t width, uint32_t height) {
+  uint32_t dstWidth = width > 1 ? width / 2 : 1;
+  uint32_t dstHeight = height > 1 ? height / 2 : 1;
+  std::vector<uint8_t> dst(static_cast<size_t>(dstWidth) * dstHeight * 4);
+  auto at = [&](uint32_t x, uint32_t y, uint32_t c) -> uint32_t {
+    x = x < width ? x : width - 1;
+    y = y < height ? y : height - 1;
+    return src[(static_cast<size_t>(y) * width + x) * 4 + c];
+  };
+  for (uint32_t y = 0; y < dstHeight; y++) {
+    for (uint32_t x = 0; x < dstWidth; x++) {
+      for (uint32_t c = 0; c < 4; c++) {
+        uint32_t even = (at(2 * x, 2 * y, c) + at(2 * x, 2 * y + 1, c) + 1) >> 1;
+        uint32_t odd = (at(2 * x + 1, 2 * y, c) + at(2 * x + 1, 2 * y + 1, c) + 1) >> 1;
+        dst[(static_cast<size_t>(y) * dstWidth + x) * 4 + c] = static_cast<uint8_t>((even + odd + 1) >> 1);
+      }
+    }
+  }
+  return dst;
+}
+
+static void testKnownValues() {
+  // One channel counts up, the others are constant
+  uint8_t pixels[16] = {0, 10, 20, 255,
+                        1, 10, 20, 255,
+                        2, 10, 20, 255,
+                        3, 10, 20, 255};
+  uint8_t out[4] = {};
+  MipGenerator::downsampleBox(pixels, 2, 2, out);
+  // avg(avg(0, 2), avg(1, 3)) = avg(1, 2) = 2 rounding up
+  CHECK(out[0] == 2, "2x2 average");
+  CHECK(out[1] == 10 && out[2] == 20 && out[3] == 255, "constant channels stay constant");
+}
+
+static void testSizes() {
+  const uint32_t sizes[][2] = {{1, 1}, {2, 1}, {1, 2}, {1, 7}, {7, 1}, {3, 3}, {3, 5}, {5, 3},
+                               {9, 2}, {17, 9}, {31, 33}, {33, 31}, {64, 64}, {100, 37},
+                               {255, 129}, {257, 3}, {640, 360}};
+  uint32_t seed = 1;
+  for (const auto &size : sizes) {
+    uint32_t width = size[0];
+    uint32_t height = size[1];
+    std::vector<uint8_t> src = randomImage(width, height, seed++);
+    std::vector<uint8_t> expected = referenceDownsample(src, width, height);
+
+    // Filled with a marker so writes past the level show up
+    std::vector<uint8_t> simd(expected.size() + 64, 0xcd);
+    std::vector<uint8_t> scalar(expected.size() + 64, 0xcd);
+    MipGenerator::downsampleBox(src.data(), width, height, simd.data());
+    MipGenerator::downsampleBoxScalar(src.data(), width, height, scalar.data());
+
+    std::string name = std::to_string(width) + "x" + std::to_string(height);
+    CHECK(memcmp(simd.data(), expected.data(), expected.size()) == 0, "downsampleBox " << name);
+    CHECK(memcmp(scalar.data(), expected.data(), expected.size()) == 0, "downsampleBoxScalar " << name);
+    bool untouched = true;
+    for (size_t i = expected.size(); i < simd.size(); i++) {
+      untouched &= simd[i] == 0xcd && scalar[i] == 0xcd;
+    }
+    CHECK(untouched, "nothing written past the level " << name);
+  }
+}
+
+static void testChain() {
+  std::vector<uint8_t> src = randomImage(100, 37, 42);
+  std::vector<uint8_t> chain;
+  std::vector<MipGenerator::MipLevel> levels = MipGenerator::generateMipChain(src.data(), 100, 37, chain);
+
+  // 100x37, 50x18, 25x9, 12x4, 6x2, 3x1, 1x1
+  const uint32_t expected[][2] = {{100, 37}, {50, 18}, {25, 9}, {12, 4}, {6, 2}, {3, 1}, {1, 1}};
+  CHECK(levels.size() == 7 && MipGenerator::mipLevelCount(100, 37) == 7, "level count of 100x37");
+  size_t offset = 0;
+  for (size_t i = 0; i < levels.size() && i < 7; i++) {
+    CHECK(levels[i].width == expected[i][0] && levels[i].height == expected[i][1], "size of level " << i);
+    CHECK(levels[i].offset == offset && levels[i].size == levels[i].width * levels[i].height * 4u,
+          "offset of level " << i);
+    offset += levels[i].size;
+  }
+  CHECK(chain.size() == offset, "chain size");
+  CHECK(memcmp(chain.data(), src.data(), src.size()) == 0, "level 0 is a copy");
+
+  // Every level is the box filter of the one above
+  for (size_t i = 1; i < levels.size(); i++) {
+    const MipGenerator::MipLevel &parent = levels[i - 1];
+    std::vector<uint8_t> above(chain.begin() + parent.offset, chain.begin() + parent.offset + parent.size);
+    std::vector<uint8_t> expectedLevel = referenceDownsample(above, parent.width, parent.height);
+    CHECK(memcmp(chain.data() + levels[i].offset, expectedLevel.data(), expectedLevel.size()) == 0,
+          "contents of level " << i);
+  }
+}
+
+static void bench() {
+  const uint32_t size = 2048;
+  const int runs = 20;
+  std::vector<uint8_t> src = randomImage(size, size, 7);
+  std::vector<uint8_t> dst(static_cast<size_t>(size / 2) * (size / 2) * 4);
+
+  auto time = [&](void (*downsample)(const uint8_t *, uint32_t, uint32_t, uint8_t *)) {
+    downsample(src.data(), size, size, dst.data());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < runs; i++) {
+      downsample(src.data(), size, size, dst.data());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+  };
+  double simdMs = time(MipGenerator::downsampleBox);
+  double scalarMs = time(MipGenerator::downsampleBoxScalar);
+  std::cout << "2048x2048 -> 1024x1024: downsampleBox " << simdMs << " ms, scalar " << scalarMs << " ms ("
+            << scalarMs / simdMs << "x)\n";
+
+  std::vector<uint8_t> chain;
+  auto start = std::chrono::high_resolution_clock::now();
+  MipGenerator::generateMipChain(src.data(), size, size, chain);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Full 2048x2048 chain: " << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms\n";
+}
+
+int main(int argc, char *argv[]) {
+  testKnownValues();
+  testSizes();
+  testChain();
+
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    bench();
+  }
+
+  if (gFailures > 0) {
+    std::cout << gFailures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "mip_generator_test passed\n";
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Standalone checks of the text overlay on a headless device: more text than
+// TEXTOVERLAY_MAX_CHAR_COUNT is cut off at the cap without running into the
+// draw command behind the glyphs, and every swapchain image has its own slot
+// that prepareFrame() of another image leaves alone.
+//
+// Run from the build folder, it loads fonts/ and shaders/ from there. Exits
+// with 77 (skipped) when there is no Vulkan device.
+
+#include "headless_vulkan.hpp"
+
+#include <text_overlay.hpp>
+
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <string>
+
+static int gFailures = 0;
+
+#define CHECK(condition, message)                                                                  \
+  do {                                                                                             \
+    if (!(condition)) {                                                                            \
+      std::cout << "FAILED: " << message << " (" << #condition << ", line " << __LINE__ << ")\n"; \
+      gFailures++;                                                                                 \
+    }                                                                                              \
+  } while (0)
+
+static const uint32_t kImageCount = 3;
+static const VkExtent2D kExtent = {1280, 720};
+
+static bool closeTo(float a, float b) { return std::fabs(a - b) < 1e-5f; }
+
+// Records prepareFrame() like the renderer does at the start of a frame and
+// waits for it, so the next image starts from a finished submission
+static void prepare(HeadlessVulkan &vulkan, TextOverlay &overlay, uint32_t imageIndex) {
+  VkCommandBuffer commandBuffer = VulkanHelper::beginSingleTimeCommands(vulkan.device, vulkan.commandPool);
+  overlay.prepareFrame(imageIndex, commandBuffer);
+  VulkanHelper::endSingleTimeCommands(vulkan.device, vulkan.commandPool, commandBuffer, vulkan.queue);
+}
+
+static void checkDrawCommand(TextOverlay &overlay, uint32_t imageIndex, uint32_t instanceCount) {
+  const VkDrawIndirectCommand &command = overlay.slotDrawCommand(imageIndex);
+  CHECK(command.instanceCount == instanceCount, "image " << imageIndex << " draws " << command.instanceCount);
+  // Written once when the buffer is made, a glyph past the cap would land here
+  CHECK(command.vertexCount == 4, "image " << imageIndex << " vertex count " << command.vertexCount);
+  CHECK(command.firstVertex == 0, "image " << imageIndex << " first vertex " << command.firstVertex);
+  CHECK(command.firstInstance == 0, "image " << imageIndex << " first instance " << command.firstInstance);
+}
+
+static void checkRect(TextOverlay &overlay, uint32_t imageIndex, uint32_t glyph, float x0, float y0, float x1, float y1) {
+  glm::vec4 rect = overlay.slotGlyphRect(imageIndex, glyph);
+  glm::vec4 expected(x0 / kExtent.width * 2.0f - 1.0f, y0 / kExtent.height * 2.0f - 1.0f,
+                     x1 / kExtent.width * 2.0f - 1.0f, y1 / kExtent.height * 2.0f - 1.0f);
+  CHECK(closeTo(rect.x, expected.x) && closeTo(rect.y, expected.y) && closeTo(rect.z, expected.z) && closeTo(rect.w, expected.w),
+        "image " << imageIndex << " glyph " << glyph << " isn't the rect added");
+}
+
+static void testSlots(HeadlessVulkan &vulkan) {
+  TextOverlay overlay(vulkan.physicalDevice, vulkan.device, vulkan.queueFamily, kImageCount, VK_FORMAT_B8G8R8A8_UNORM,
+                      VK_SAMPLE_COUNT_1_BIT, kExtent, vulkan.queue, VK_NULL_HANDLE,
+                      VulkanHelper::readFile("shaders/text.vert.spv"), VulkanHelper::readFile("shaders/text.frag.spv"));
+
+  // Each slot has room for the capped glyphs and the draw command behind them
+  VkDeviceSize slotSize = overlay.slotOffset(1);
+  CHECK(slotSize >= TEXTOVERLAY_MAX_CHAR_COUNT * 2 * sizeof(glm::vec4) + sizeof(VkDrawIndirectCommand),
+        "slot of " << slotSize << " bytes is too small");
+  for (uint32_t image = 0; image < kImageCount; image++) {
+    CHECK(overlay.slotOffset(image) == image * slotSize, "slot " << image << " at " << overlay.slotOffset(image));
+    checkDrawCommand(overlay, image, 0);
+  }
+
+  // Image 0: 40 lines of 64 characters, more than the cap, and a rect that
+  // doesn't fit anymore. Every character is printable so each is a quad
+  const uint32_t lines = 40;
+  std::string line(64, ' ');
+  overlay.beginTextUpdate();
+  for (uint32_t l = 0; l < lines; l++) {
+    for (size_t c = 0; c < line.size(); c++) {
+      line[c] = static_cast<char>('!' + (l + c) % 94);
+    }
+    overlay.addText(line, 0.0f, 20.0f * l, TextOverlay::alignLeft);
+  }
+  overlay.addRect(0.0f, 0.0f, 100.0f, 100.0f);
+  prepare(vulkan, overlay, 0);
+  checkDrawCommand(overlay, 0, TEXTOVERLAY_MAX_CHAR_COUNT);
+  glm::vec4 lastGlyph = overlay.slotGlyphRect(0, TEXTOVERLAY_MAX_CHAR_COUNT - 1);
+
+  // Image 1: a short string and a rect
+  overlay.beginTextUpdate();
+  overlay.addText("abc", 100.0f, 100.0f, TextOverlay::alignLeft);
+  overlay.addRect(10.0f, 20.0f, 30.0f, 40.0f);
+  prepare(vulkan, overlay, 1);
+  checkDrawCommand(overlay, 1, 4);
+  checkRect(overlay, 1, 3, 10.0f, 20.0f, 30.0f, 40.0f);
+
+  // Image 2: only a rect
+  overlay.beginTextUpdate();
+  overlay.addRect(50.0f, 60.0f, 70.0f, 80.0f);
+  prepare(vulkan, overlay, 2);
+  checkDrawCommand(overlay, 2, 1);
+  checkRect(overlay, 2, 0, 50.0f, 60.0f, 70.0f, 80.0f);
+
+  // The other images didn't touch slot 0 or 1
+  checkDrawCommand(overlay, 0, TEXTOVERLAY_MAX_CHAR_COUNT);
+  glm::vec4 stillLast = overlay.slotGlyphRect(0, TEXTOVERLAY_MAX_CHAR_COUNT - 1);
+  CHECK(stillLast == lastGlyph, "slot 0 changed when another image was prepared");
+  checkDrawCommand(overlay, 1, 4);
+  checkRect(overlay, 1, 3, 10.0f, 20.0f, 30.0f, 40.0f);
+
+  // Image 0 comes around again with less text, only what's new is drawn
+  overlay.beginTextUpdate();
+  overlay.addRect(1.0f, 2.0f, 3.0f, 4.0f);
+  prepare(vulkan, overlay, 0);
+  checkDrawCommand(overlay, 0, 1);
+  checkRect(overlay, 0, 0, 1.0f, 2.0f, 3.0f, 4.0f);
+  checkDrawCommand(overlay, 2, 1);
+}
+
+int main() {
+  HeadlessVulkan vulkan;
+  if (!vulkan.create()) {
+    vulkan.destroy();
+    std::cout << "text_overlay_test skipped\n";
+    return HEADLESS_VULKAN_SKIP;
+  }
+
+  try {
+    testSlots(vulkan);
+  } catch (const std::exception &e) {
+    std::cout << "FAILED: " << e.what() << "\n";
+    gFailures++;
+  }
+  vulkan.destroy();
+
+  if (gFailures > 0) {
+    std::cout << gFailures << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "text_overlay_test passed\n";
+  return 0;
+}
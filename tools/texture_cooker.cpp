@@ -0,0 +1,94 @@
+// Offline texture cooker, encodes an image and its mip chain to a block
+// compressed KTX2 file the renderer can upload without decoding.
+//
+// usage: texture_cooker <input image> <output.ktx2> [bc1|bc3|bc5|bc7] [--linear]
+//
+// Colour textures are treated as sRGB unless --linear is passed, BC5 is always
+// linear since it is meant for normal maps.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <ktx2.hpp>
+#include <mip_generator.hpp>
+#include <texture_compression.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void printUsage() {
+  std::cout << "usage: texture_cooker <input image> <output.ktx2> [bc1|bc3|bc5|bc7] [--linear]\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printUsage();
+    return 1;
+  }
+
+  std::string inputPath = argv[1];
+  std::string outputPath = argv[2];
+  TextureCompression::Format compression = TextureCompression::Format::BC7;
+  bool srgb = true;
+
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "bc1") {
+      compression = TextureCompression::Format::BC1;
+    } else if (arg == "bc3") {
+      compression = TextureCompression::Format::BC3;
+    } else if (arg == "bc5") {
+      compression = TextureCompression::Format::BC5;
+    } else if (arg == "bc7") {
+      compression = TextureCompression::Format::BC7;
+    } else if (arg == "--linear") {
+      srgb = false;
+    } else {
+      std::cout << "Unknown argument: " << arg << "\n";
+      printUsage();
+      return 1;
+    }
+  }
+
+  int width, height, channels;
+  stbi_uc *pixels = stbi_load(inputPath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (!pixels) {
+    std::cout << "Failed to load " << inputPath << ": " << stbi_failure_reason() << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::vector<uint8_t> chain;
+  std::vector<MipGenerator::MipLevel> mips =
+      MipGenerator::generateMipChain(pixels, width, height, chain);
+  stbi_image_free(pixels);
+
+  std::vector<std::vector<uint8_t>> levels(mips.size());
+  size_t compressedBytes = 0;
+  for (size_t i = 0; i < mips.size(); i++) {
+    levels[i].resize(TextureCompression::compressedSize(compression, mips[i].width, mips[i].height));
+    TextureCompression::compressImage(chain.data() + mips[i].offset,
+                                      mips[i].width,
+                                      mips[i].height,
+                                      compression,
+                                      levels[i].data());
+    compressedBytes += levels[i].size();
+  }
+
+  auto end = std::chrono::high_resolution_clock::now();
+  float milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+  VkFormat format = KTX2::toVkFormat(compression, srgb);
+  if (!KTX2::write(outputPath, format, width, height, levels)) {
+    std::cout << "Failed to write " << outputPath << "\n";
+    return 1;
+  }
+
+  std::cout << outputPath << ": " << width << "x" << height << ", " << levels.size() << " levels, "
+            << chain.size() << " -> " << compressedBytes << " bytes in " << milliseconds << "ms\n";
+  return 0;
+}